@@ -0,0 +1,240 @@
+// Synthetic NanoAOD-like input for the MultiDraw benchmarks.
+// Usage: mkBenchInput <output prefix> [events per file = 50000] [files = 4] [seed = 1]
+// Writes <prefix>_<i>.root, each holding a tree "Events" with jagged lepton and jet collections, dilepton
+// and dijet variables, and the usual event weights. Kinematics are only loosely realistic; what matters is
+// that the branch types, the array sizes, and the compression resemble the production trees.
+
+#include "TFile.h"
+#include "TTree.h"
+#include "TRandom3.h"
+#include "TMath.h"
+#include "TString.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <memory>
+#include <iostream>
+#include <stdexcept>
+
+namespace {
+
+  constexpr int kMaxLepton = 8;
+  constexpr int kMaxJet = 24;
+
+  struct Event {
+    UInt_t run{1};
+    UInt_t luminosityBlock{0};
+    ULong64_t event{0};
+    Int_t PV_npvsGood{0};
+
+    Int_t nLepton{0};
+    Float_t Lepton_pt[kMaxLepton]{};
+    Float_t Lepton_eta[kMaxLepton]{};
+    Float_t Lepton_phi[kMaxLepton]{};
+    Int_t Lepton_pdgId[kMaxLepton]{};
+    Int_t Lepton_isTight[kMaxLepton]{};
+    Float_t Lepton_RecoSF[kMaxLepton]{};
+
+    Int_t nJet{0};
+    Float_t Jet_pt[kMaxJet]{};
+    Float_t Jet_eta[kMaxJet]{};
+    Float_t Jet_phi[kMaxJet]{};
+    Float_t Jet_btagDeepB[kMaxJet]{};
+    Float_t Jet_qgl[kMaxJet]{};
+
+    Int_t nCleanJet{0};
+    Float_t CleanJet_pt[kMaxJet]{};
+    Float_t CleanJet_eta[kMaxJet]{};
+    Float_t CleanJet_phi[kMaxJet]{};
+    Int_t CleanJet_jetIdx[kMaxJet]{};
+
+    Float_t PuppiMET_pt{0.};
+    Float_t PuppiMET_phi{0.};
+    Float_t mll{0.};
+    Float_t ptll{0.};
+    Float_t drll{0.};
+    Float_t mth{0.};
+    Float_t mjj{0.};
+    Float_t detajj{0.};
+
+    Float_t XSWeight{0.};
+    Float_t SFweight2l{0.};
+    Float_t puWeight{0.};
+    Float_t GenLepMatch2l{0.};
+  };
+
+  void
+  book(TTree& _tree, Event& _e)
+  {
+    _tree.Branch("run", &_e.run, "run/i");
+    _tree.Branch("luminosityBlock", &_e.luminosityBlock, "luminosityBlock/i");
+    _tree.Branch("event", &_e.event, "event/l");
+    _tree.Branch("PV_npvsGood", &_e.PV_npvsGood, "PV_npvsGood/I");
+
+    _tree.Branch("nLepton", &_e.nLepton, "nLepton/I");
+    _tree.Branch("Lepton_pt", _e.Lepton_pt, "Lepton_pt[nLepton]/F");
+    _tree.Branch("Lepton_eta", _e.Lepton_eta, "Lepton_eta[nLepton]/F");
+    _tree.Branch("Lepton_phi", _e.Lepton_phi, "Lepton_phi[nLepton]/F");
+    _tree.Branch("Lepton_pdgId", _e.Lepton_pdgId, "Lepton_pdgId[nLepton]/I");
+    _tree.Branch("Lepton_isTight", _e.Lepton_isTight, "Lepton_isTight[nLepton]/I");
+    _tree.Branch("Lepton_RecoSF", _e.Lepton_RecoSF, "Lepton_RecoSF[nLepton]/F");
+
+    _tree.Branch("nJet", &_e.nJet, "nJet/I");
+    _tree.Branch("Jet_pt", _e.Jet_pt, "Jet_pt[nJet]/F");
+    _tree.Branch("Jet_eta", _e.Jet_eta, "Jet_eta[nJet]/F");
+    _tree.Branch("Jet_phi", _e.Jet_phi, "Jet_phi[nJet]/F");
+    _tree.Branch("Jet_btagDeepB", _e.Jet_btagDeepB, "Jet_btagDeepB[nJet]/F");
+    _tree.Branch("Jet_qgl", _e.Jet_qgl, "Jet_qgl[nJet]/F");
+
+    _tree.Branch("nCleanJet", &_e.nCleanJet, "nCleanJet/I");
+    _tree.Branch("CleanJet_pt", _e.CleanJet_pt, "CleanJet_pt[nCleanJet]/F");
+    _tree.Branch("CleanJet_eta", _e.CleanJet_eta, "CleanJet_eta[nCleanJet]/F");
+    _tree.Branch("CleanJet_phi", _e.CleanJet_phi, "CleanJet_phi[nCleanJet]/F");
+    _tree.Branch("CleanJet_jetIdx", _e.CleanJet_jetIdx, "CleanJet_jetIdx[nCleanJet]/I");
+
+    _tree.Branch("PuppiMET_pt", &_e.PuppiMET_pt, "PuppiMET_pt/F");
+    _tree.Branch("PuppiMET_phi", &_e.PuppiMET_phi, "PuppiMET_phi/F");
+    _tree.Branch("mll", &_e.mll, "mll/F");
+    _tree.Branch("ptll", &_e.ptll, "ptll/F");
+    _tree.Branch("drll", &_e.drll, "drll/F");
+    _tree.Branch("mth", &_e.mth, "mth/F");
+    _tree.Branch("mjj", &_e.mjj, "mjj/F");
+    _tree.Branch("detajj", &_e.detajj, "detajj/F");
+
+    _tree.Branch("XSWeight", &_e.XSWeight, "XSWeight/F");
+    _tree.Branch("SFweight2l", &_e.SFweight2l, "SFweight2l/F");
+    _tree.Branch("puWeight", &_e.puWeight, "puWeight/F");
+    _tree.Branch("GenLepMatch2l", &_e.GenLepMatch2l, "GenLepMatch2l/F");
+  }
+
+  double
+  deltaPhi(double _phi1, double _phi2)
+  {
+    double dphi(_phi1 - _phi2);
+    while (dphi > TMath::Pi())
+      dphi -= 2. * TMath::Pi();
+    while (dphi < -TMath::Pi())
+      dphi += 2. * TMath::Pi();
+    return dphi;
+  }
+
+  //! Invariant mass and transverse momentum of two massless objects
+  void
+  pairKinematics(double _pt1, double _eta1, double _phi1, double _pt2, double _eta2, double _phi2, Float_t& _mass, Float_t* _pt = nullptr)
+  {
+    _mass = std::sqrt(std::max(0., 2. * _pt1 * _pt2 * (std::cosh(_eta1 - _eta2) - std::cos(_phi1 - _phi2))));
+    if (_pt != nullptr) {
+      double px(_pt1 * std::cos(_phi1) + _pt2 * std::cos(_phi2));
+      double py(_pt1 * std::sin(_phi1) + _pt2 * std::sin(_phi2));
+      *_pt = std::sqrt(px * px + py * py);
+    }
+  }
+
+  void
+  generate(TRandom3& _rand, Event& _e)
+  {
+    _e.PV_npvsGood = std::max(1, _rand.Poisson(30.));
+
+    _e.nLepton = std::min(kMaxLepton, 1 + _rand.Poisson(1.3));
+    for (int iL(0); iL != _e.nLepton; ++iL) {
+      _e.Lepton_pt[iL] = 10. + _rand.Exp(30.);
+      _e.Lepton_eta[iL] = _rand.Uniform(-2.5, 2.5);
+      _e.Lepton_phi[iL] = _rand.Uniform(-TMath::Pi(), TMath::Pi());
+      _e.Lepton_pdgId[iL] = (_rand.Rndm() < 0.5 ? 11 : 13) * (_rand.Rndm() < 0.5 ? 1 : -1);
+      _e.Lepton_isTight[iL] = _rand.Rndm() < 0.8 ? 1 : 0;
+      _e.Lepton_RecoSF[iL] = _rand.Gaus(0.98, 0.02);
+    }
+    std::sort(_e.Lepton_pt, _e.Lepton_pt + _e.nLepton, [](Float_t a, Float_t b) { return a > b; });
+
+    _e.nJet = std::min(kMaxJet, _rand.Poisson(4.));
+    for (int iJ(0); iJ != _e.nJet; ++iJ) {
+      _e.Jet_pt[iJ] = 15. + _rand.Exp(40.);
+      _e.Jet_eta[iJ] = _rand.Uniform(-4.7, 4.7);
+      _e.Jet_phi[iJ] = _rand.Uniform(-TMath::Pi(), TMath::Pi());
+      double u(_rand.Rndm());
+      _e.Jet_btagDeepB[iJ] = u * u * u;
+      _e.Jet_qgl[iJ] = _rand.Rndm();
+    }
+    std::sort(_e.Jet_pt, _e.Jet_pt + _e.nJet, [](Float_t a, Float_t b) { return a > b; });
+
+    _e.nCleanJet = 0;
+    for (int iJ(0); iJ != _e.nJet; ++iJ) {
+      if (_e.Jet_pt[iJ] < 20. || _rand.Rndm() < 0.1) // "overlaps with a lepton"
+        continue;
+
+      int iC(_e.nCleanJet++);
+      _e.CleanJet_pt[iC] = _e.Jet_pt[iJ];
+      _e.CleanJet_eta[iC] = _e.Jet_eta[iJ];
+      _e.CleanJet_phi[iC] = _e.Jet_phi[iJ];
+      _e.CleanJet_jetIdx[iC] = iJ;
+    }
+
+    _e.PuppiMET_pt = _rand.Exp(40.);
+    _e.PuppiMET_phi = _rand.Uniform(-TMath::Pi(), TMath::Pi());
+
+    _e.mll = _e.ptll = _e.drll = _e.mth = -9999.;
+    if (_e.nLepton >= 2) {
+      pairKinematics(_e.Lepton_pt[0], _e.Lepton_eta[0], _e.Lepton_phi[0], _e.Lepton_pt[1], _e.Lepton_eta[1], _e.Lepton_phi[1], _e.mll, &_e.ptll);
+      double deta(_e.Lepton_eta[0] - _e.Lepton_eta[1]);
+      double dphi(deltaPhi(_e.Lepton_phi[0], _e.Lepton_phi[1]));
+      _e.drll = std::sqrt(deta * deta + dphi * dphi);
+      _e.mth = std::sqrt(std::max(0., 2. * _e.ptll * _e.PuppiMET_pt * (1. - std::cos(_rand.Uniform(0., TMath::Pi())))));
+    }
+
+    _e.mjj = _e.detajj = -9999.;
+    if (_e.nCleanJet >= 2) {
+      pairKinematics(_e.CleanJet_pt[0], _e.CleanJet_eta[0], _e.CleanJet_phi[0], _e.CleanJet_pt[1], _e.CleanJet_eta[1], _e.CleanJet_phi[1], _e.mjj);
+      _e.detajj = std::abs(_e.CleanJet_eta[0] - _e.CleanJet_eta[1]);
+    }
+
+    _e.XSWeight = 0.0123;
+    _e.SFweight2l = _rand.Gaus(1., 0.05);
+    _e.puWeight = _rand.Gaus(1., 0.1);
+    _e.GenLepMatch2l = _rand.Rndm() < 0.95 ? 1. : 0.;
+  }
+
+}
+
+int
+main(int argc, char** argv)
+{
+  if (argc < 2) {
+    std::cerr << "Usage: mkBenchInput <output prefix> [events per file = 50000] [files = 4] [seed = 1]" << std::endl;
+    return 1;
+  }
+
+  TString prefix(argv[1]);
+  long nEvents(argc > 2 ? std::atol(argv[2]) : 50000);
+  int nFiles(argc > 3 ? std::atoi(argv[3]) : 4);
+  unsigned seed(argc > 4 ? std::atoi(argv[4]) : 1);
+
+  TRandom3 rand(seed);
+  Event e;
+
+  for (int iF(0); iF != nFiles; ++iF) {
+    TString fileName(TString::Format("%s_%d.root", prefix.Data(), iF));
+    std::unique_ptr<TFile> file(TFile::Open(fileName, "recreate"));
+    if (!file || file->IsZombie())
+      throw std::runtime_error(("Cannot open " + fileName).Data());
+
+    auto* tree(new TTree("Events", "Events"));
+    book(*tree, e);
+
+    e.luminosityBlock = iF + 1;
+
+    for (long iE(0); iE != nEvents; ++iE) {
+      e.event = ULong64_t(iF) * nEvents + iE;
+      generate(rand, e);
+      tree->Fill();
+    }
+
+    file->cd();
+    tree->Write();
+    file->Close();
+
+    std::cout << "Wrote " << nEvents << " events to " << fileName << std::endl;
+  }
+
+  return 0;
+}
@@ -0,0 +1,498 @@
+// Throughput benchmark of MultiDraw::execute().
+// Usage: runBench <input file pattern> [options]
+//   -n <entries>     number of entries to process (default: all)
+//   -t <n1,n2,...>   numbers of threads (default: 1)
+//   -s <s1,s2,...>   scenarios (default: all; see below)
+//   -r <repeats>     runs per configuration; the fastest is reported (default: 1)
+//   -o <file>        also write the results as a tab-separated table
+//   -d               dynamic scheduling
+//   -c               compile the formulas
+//   -x               share common subexpressions among the formulas
+//   -p               disable the unused input branches
+// Scenarios:
+//   simple     one selection, eight plots
+//   cuts       48 cuts with three categories each, eight plot lists per cut, atoms shared among the cuts
+//   aliases    cuts and plots on scalar and array aliases
+//   functions  plots and aliases computed by TTreeFunctions
+//   reweight   global histogram reweight, per-tree and per-plot reweights, graph lookups
+//   full       all of the above together
+// For each scenario and number of threads, the table lists the wall and CPU times, the throughput, the
+// speedup and parallel efficiency with respect to the first number of threads, and the resident memory.
+// Input is expected in the format written by mkBenchInput.
+
+#include "../interface/MultiDraw.h"
+#include "../interface/FunctionLibrary.h"
+#include "../interface/TTreeFunction.h"
+
+#include "TH1D.h"
+#include "TH2D.h"
+#include "TGraph.h"
+#include "TObjArray.h"
+#include "TString.h"
+#include "TMath.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <ctime>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <sys/resource.h>
+#include <unistd.h>
+
+namespace {
+
+  //! Scalar sum of the clean jet pt above 30 GeV
+  class HT : public multidraw::TTreeFunction {
+  public:
+    char const* getName() const override { return "HT"; }
+    char const* getConfig() const override { return "ptmin=30"; }
+    TTreeFunction* clone() const override { return new HT(); }
+
+    unsigned getNdata() override { return 1; }
+    double evaluate(unsigned) override {
+      double ht(0.);
+      for (Float_t pt : *pt_) {
+        if (pt > 30.)
+          ht += pt;
+      }
+      return ht;
+    }
+
+  protected:
+    void bindTree_(multidraw::FunctionLibrary& _library) override { _library.bindArrayColumn(pt_, "CleanJet_pt"); }
+
+  private:
+    multidraw::ColumnView<Float_t> const* pt_{nullptr};
+  };
+
+  //! |delta phi| between each clean jet and the MET
+  class JetMETDPhi : public multidraw::TTreeFunction {
+  public:
+    char const* getName() const override { return "JetMETDPhi"; }
+    char const* getConfig() const override { return ""; }
+    TTreeFunction* clone() const override { return new JetMETDPhi(); }
+
+    int getMultiplicity() override { return 1; }
+    unsigned getNdata() override { return phi_->size(); }
+    double evaluate(unsigned _i) override {
+      double dphi(std::abs((*phi_)[_i] - (*metPhi_)[0]));
+      return dphi > TMath::Pi() ? 2. * TMath::Pi() - dphi : dphi;
+    }
+
+    bool hasEvaluateAll() const override { return true; }
+    void evaluateAll(double* _out) override {
+      double metPhi((*metPhi_)[0]);
+      unsigned n(phi_->size());
+      Float_t const* phi(phi_->data());
+      for (unsigned i(0); i != n; ++i) {
+        double dphi(std::abs(phi[i] - metPhi));
+        _out[i] = dphi > TMath::Pi() ? 2. * TMath::Pi() - dphi : dphi;
+      }
+    }
+
+  protected:
+    void bindTree_(multidraw::FunctionLibrary& _library) override {
+      _library.bindArrayColumn(phi_, "CleanJet_phi");
+      _library.bindValueColumn(metPhi_, "PuppiMET_phi");
+    }
+
+  private:
+    multidraw::ColumnView<Float_t> const* phi_{nullptr};
+    multidraw::ColumnView<Float_t> const* metPhi_{nullptr};
+  };
+
+  struct Variable {
+    char const* name;
+    char const* expr;
+    int nbins;
+    double xmin;
+    double xmax;
+  };
+
+  std::vector<Variable> const variables{
+    {"mll", "mll", 40, 0., 200.},
+    {"ptll", "ptll", 40, 0., 200.},
+    {"mth", "mth", 40, 0., 200.},
+    {"met", "PuppiMET_pt", 40, 0., 200.},
+    {"mjj", "mjj", 40, 0., 1000.},
+    {"detajj", "detajj", 35, 0., 7.},
+    {"lep_pt", "Lepton_pt", 40, 0., 200.},
+    {"jet_pt", "CleanJet_pt", 40, 0., 400.}
+  };
+
+  // Cut fragments combined into the cuts of the "cuts" and "full" scenarios
+  std::vector<std::pair<char const*, char const*>> const flavours{
+    {"ee", "Lepton_pdgId[0] * Lepton_pdgId[1] == -11*11"},
+    {"mm", "Lepton_pdgId[0] * Lepton_pdgId[1] == -13*13"},
+    {"em", "Lepton_pdgId[0] * Lepton_pdgId[1] == -11*13"},
+    {"ll", "Lepton_pdgId[0] * Lepton_pdgId[1] < 0"}
+  };
+
+  std::vector<std::pair<char const*, char const*>> const jetBins{
+    {"0j", "Sum$(CleanJet_pt > 30.) == 0"},
+    {"1j", "Sum$(CleanJet_pt > 30.) == 1"},
+    {"2j", "Sum$(CleanJet_pt > 30.) == 2"},
+    {"ge2j", "Sum$(CleanJet_pt > 30.) >= 2"}
+  };
+
+  std::vector<std::pair<char const*, char const*>> const regions{
+    {"sr", "mll > 12. && mth > 60. && Sum$(CleanJet_pt > 20. && Jet_btagDeepB[CleanJet_jetIdx] > 0.2217) == 0"},
+    {"top", "mll > 50. && Sum$(CleanJet_pt > 20. && Jet_btagDeepB[CleanJet_jetIdx] > 0.2217) > 0"},
+    {"dy", "TMath::Abs(mll - 91.) < 15. && mth < 60."}
+  };
+
+  std::vector<char const*> const categories{
+    "ptll < 30.",
+    "ptll >= 30. && ptll < 60.",
+    "ptll >= 60."
+  };
+
+  char const* const supercut("nLepton >= 2 && Lepton_pt[0] > 25. && Lepton_pt[1] > 13. && PuppiMET_pt > 20.");
+  char const* const eventWeight("XSWeight * SFweight2l * puWeight * GenLepMatch2l");
+
+  //! Histograms and lookup objects of a benchmark run
+  class Objects {
+  public:
+    TH1D* makeHist(TString const& _name, Variable const& _var) {
+      auto* hist(new TH1D(_name, _var.expr, _var.nbins, _var.xmin, _var.xmax));
+      hists_.emplace_back(hist);
+      return hist;
+    }
+
+    TObjArray* makeList(TString const& _name, Variable const& _var, unsigned _n) {
+      lists_.emplace_back(new TObjArray());
+      for (unsigned i(0); i != _n; ++i)
+        lists_.back()->Add(makeHist(TString::Format("%s_%d", _name.Data(), i), _var));
+      return lists_.back().get();
+    }
+
+    template<class T>
+    T* keep(T* _obj) {
+      others_.emplace_back(_obj);
+      return _obj;
+    }
+
+  private:
+    std::vector<std::unique_ptr<TH1>> hists_{};
+    std::vector<std::unique_ptr<TObjArray>> lists_{};
+    std::vector<std::unique_ptr<TObject>> others_{};
+  };
+
+  void
+  setupSimple(multidraw::MultiDraw& _drawer, Objects& _objects)
+  {
+    _drawer.setFilter(supercut);
+    _drawer.addCut("simple", "mll > 12.");
+    for (auto& var : variables)
+      _drawer.addPlot(_objects.makeHist(TString("simple_") + var.name, var), var.expr, "simple");
+  }
+
+  void
+  setupCuts(multidraw::MultiDraw& _drawer, Objects& _objects, char const* _weight)
+  {
+    _drawer.setFilter(supercut);
+
+    for (auto& flavour : flavours) {
+      for (auto& jetBin : jetBins) {
+        for (auto& region : regions) {
+          TString name(TString::Format("%s_%s_%s", region.first, flavour.first, jetBin.first));
+          _drawer.addCut(name, TString::Format("%s && %s && %s", flavour.second, jetBin.second, region.second));
+
+          for (auto* category : categories)
+            _drawer.addCategory(name, category);
+
+          for (auto& var : variables)
+            _drawer.addPlotList(_objects.makeList(name + "_" + var.name, var, categories.size()), var.expr, name, _weight);
+        }
+      }
+    }
+  }
+
+  void
+  setupAliases(multidraw::MultiDraw& _drawer, Objects& _objects)
+  {
+    _drawer.addAlias("nTightLep", "Sum$(Lepton_isTight)");
+    _drawer.addAlias("njet", "Sum$(CleanJet_pt > 30.)");
+    _drawer.addAlias("bVeto", "Sum$(CleanJet_pt > 20. && Jet_btagDeepB[CleanJet_jetIdx] > 0.2217) == 0");
+    _drawer.addAlias("lep2pt", "Alt$(Lepton_pt[1], 0.)");
+    _drawer.addAlias("centralJetPt", "CleanJet_pt * (TMath::Abs(CleanJet_eta) < 2.5)");
+    _drawer.addAlias("leadJetQgl", "Alt$(Jet_qgl[CleanJet_jetIdx[0]], -1.)");
+
+    _drawer.setFilter(TString(supercut) + " && nTightLep >= 2");
+
+    std::vector<std::pair<char const*, char const*>> cuts{
+      {"alias_0j", "njet == 0 && bVeto"},
+      {"alias_1j", "njet == 1 && bVeto"},
+      {"alias_2j", "njet >= 2 && bVeto && mjj > 200."},
+      {"alias_top", "njet >= 1 && !bVeto"}
+    };
+
+    std::vector<Variable> aliasVariables{
+      {"njet", "njet", 10, 0., 10.},
+      {"lep2pt", "lep2pt", 40, 0., 200.},
+      {"central_jet_pt", "centralJetPt", 40, 0., 400.},
+      {"lead_jet_qgl", "leadJetQgl", 20, -1., 1.}
+    };
+
+    for (auto& cut : cuts) {
+      _drawer.addCut(cut.first, cut.second);
+      for (auto& var : aliasVariables)
+        _drawer.addPlot(_objects.makeHist(TString(cut.first) + "_" + var.name, var), var.expr, cut.first);
+    }
+  }
+
+  void
+  setupFunctions(multidraw::MultiDraw& _drawer, Objects& _objects)
+  {
+    _drawer.addAlias("ht", HT());
+
+    _drawer.setFilter(supercut);
+    _drawer.addCut("func_incl", "mll > 12.");
+    _drawer.addCut("func_ht", "ht > 100.");
+
+    Variable htVar{"ht", "ht", 50, 0., 1000.};
+    Variable dphiVar{"jet_met_dphi", "", 32, 0., 3.2};
+
+    for (char const* cut : {"func_incl", "func_ht"}) {
+      _drawer.addPlot(_objects.makeHist(TString(cut) + "_ht_alias", htVar), "ht", cut);
+      _drawer.addPlot(_objects.makeHist(TString(cut) + "_ht", htVar), HT(), cut);
+      _drawer.addPlot(_objects.makeHist(TString(cut) + "_jet_met_dphi", dphiVar), JetMETDPhi(), cut);
+    }
+  }
+
+  void
+  setupReweight(multidraw::MultiDraw& _drawer, Objects& _objects)
+  {
+    // pileup profile reweight
+    auto* pu(_objects.keep(new TH1D("bench_pu", "", 80, 0., 80.)));
+    for (int iX(1); iX <= 80; ++iX)
+      pu->SetBinContent(iX, 1. + 0.3 * std::sin(iX * 0.1));
+    _drawer.setReweight("PV_npvsGood", pu);
+
+    // per-tree weights and reweights
+    _drawer.setTreeWeight(0, false, 1.1);
+    _drawer.setTreeReweight(1, false, "Lepton_RecoSF[0] * Lepton_RecoSF[1]");
+
+    double x[10];
+    double y[10];
+    for (int i(0); i != 10; ++i) {
+      x[i] = i * 25.;
+      y[i] = 1. + 0.02 * i;
+    }
+    auto* ptllCorrection(_objects.keep(new TGraph(10, x, y)));
+    _drawer.setTreeReweight(2, true, "ptll", ptllCorrection);
+
+    _drawer.setFilter(supercut);
+    _drawer.addCut("reweight", "mll > 12.");
+    for (auto& var : variables)
+      _drawer.addPlot(_objects.makeHist(TString("reweight_") + var.name, var), var.expr, "reweight", eventWeight);
+  }
+
+  struct Options {
+    TString input{};
+    long nEntries{-1};
+    std::vector<unsigned> threads{1};
+    std::vector<std::string> scenarios{"simple", "cuts", "aliases", "functions", "reweight", "full"};
+    unsigned repeats{1};
+    TString output{};
+    bool dynamic{false};
+    bool compile{false};
+    bool share{false};
+    bool prune{false};
+  };
+
+  struct Result {
+    std::string scenario{};
+    unsigned threads{0};
+    long long events{0};
+    double wall{0.};
+    double cpu{0.};
+    double rssMB{0.};
+    double peakRssMB{0.};
+  };
+
+  std::vector<std::string>
+  splitList(char const* _arg)
+  {
+    std::vector<std::string> items;
+    std::stringstream ss(_arg);
+    std::string item;
+    while (std::getline(ss, item, ','))
+      items.push_back(item);
+    return items;
+  }
+
+  double
+  currentRssMB()
+  {
+    std::ifstream statm("/proc/self/statm");
+    long size(0);
+    long resident(0);
+    statm >> size >> resident;
+    return resident * double(sysconf(_SC_PAGESIZE)) / (1024. * 1024.);
+  }
+
+  double
+  peakRssMB()
+  {
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss / 1024.; // kB on Linux
+  }
+
+  Result
+  run(Options const& _opts, std::string const& _scenario, unsigned _nThreads)
+  {
+    multidraw::MultiDraw drawer("Events");
+    drawer.addInputPath(_opts.input);
+    drawer.setWeightBranch("");
+    drawer.setPrintLevel(-1);
+    drawer.setInputMultiplexing(_nThreads);
+    if (_opts.dynamic)
+      drawer.setSchedulingMode(multidraw::MultiDraw::kDynamic);
+    drawer.setCompileFormulas(_opts.compile);
+    drawer.setShareSubexpressions(_opts.share);
+    drawer.setPruneBranches(_opts.prune);
+
+    Objects objects;
+
+    if (_scenario == "simple")
+      setupSimple(drawer, objects);
+    else if (_scenario == "cuts")
+      setupCuts(drawer, objects, "");
+    else if (_scenario == "aliases")
+      setupAliases(drawer, objects);
+    else if (_scenario == "functions")
+      setupFunctions(drawer, objects);
+    else if (_scenario == "reweight")
+      setupReweight(drawer, objects);
+    else if (_scenario == "full") {
+      // each setup sets the filter; the last one (the plain preselection of setupCuts) is used
+      setupAliases(drawer, objects);
+      setupFunctions(drawer, objects);
+      setupReweight(drawer, objects);
+      setupCuts(drawer, objects, eventWeight);
+    }
+    else
+      throw std::runtime_error("Unknown scenario " + _scenario);
+
+    Result result;
+    result.scenario = _scenario;
+    result.threads = _nThreads;
+
+    std::clock_t cpuStart(std::clock());
+    auto wallStart(std::chrono::steady_clock::now());
+
+    drawer.execute(_opts.nEntries);
+
+    result.wall = std::chrono::duration_cast<std::chrono::duration<double>>(std::chrono::steady_clock::now() - wallStart).count();
+    result.cpu = double(std::clock() - cpuStart) / CLOCKS_PER_SEC;
+    result.events = drawer.getTotalEvents();
+    result.rssMB = currentRssMB();
+    result.peakRssMB = peakRssMB();
+
+    return result;
+  }
+
+}
+
+int
+main(int argc, char** argv)
+{
+  if (argc < 2 || argv[1][0] == '-') {
+    std::cerr << "Usage: runBench <input file pattern> [-n entries] [-t threads,...] [-s scenario,...] [-r repeats] [-o output] [-d] [-c] [-x]" << std::endl;
+    return 1;
+  }
+
+  Options opts;
+  opts.input = argv[1];
+
+  for (int iA(2); iA < argc; ++iA) {
+    std::string arg(argv[iA]);
+    bool hasValue(iA + 1 < argc);
+
+    if (arg == "-n" && hasValue)
+      opts.nEntries = std::atol(argv[++iA]);
+    else if (arg == "-t" && hasValue) {
+      opts.threads.clear();
+      for (auto& item : splitList(argv[++iA]))
+        opts.threads.push_back(std::atoi(item.c_str()));
+    }
+    else if (arg == "-s" && hasValue)
+      opts.scenarios = splitList(argv[++iA]);
+    else if (arg == "-r" && hasValue)
+      opts.repeats = std::max(1, std::atoi(argv[++iA]));
+    else if (arg == "-o" && hasValue)
+      opts.output = argv[++iA];
+    else if (arg == "-d")
+      opts.dynamic = true;
+    else if (arg == "-c")
+      opts.compile = true;
+    else if (arg == "-x")
+      opts.share = true;
+    else if (arg == "-p")
+      opts.prune = true;
+    else {
+      std::cerr << "Unknown argument " << arg << std::endl;
+      return 1;
+    }
+  }
+
+  TH1::AddDirectory(false);
+
+  std::vector<Result> results;
+
+  for (auto& scenario : opts.scenarios) {
+    for (unsigned nThreads : opts.threads) {
+      Result best;
+      for (unsigned iR(0); iR != opts.repeats; ++iR) {
+        Result result(run(opts, scenario, nThreads));
+        if (iR == 0 || result.wall < best.wall)
+          best = result;
+      }
+      results.push_back(best);
+
+      std::cerr << scenario << " " << nThreads << " threads: " << (best.events / best.wall) << " events/s" << std::endl;
+    }
+  }
+
+  std::stringstream table;
+  table << "scenario\tthreads\tevents\twall_s\tcpu_s\tevents_per_s\tspeedup\tefficiency\trss_MB\tpeak_rss_MB" << std::endl;
+
+  Result const* reference(nullptr);
+  for (auto& result : results) {
+    // speedup with respect to the first thread count of the scenario
+    if (reference == nullptr || reference->scenario != result.scenario)
+      reference = &result;
+
+    double rate(result.events / result.wall);
+    double speedup(rate / (reference->events / reference->wall));
+    double efficiency(speedup * reference->threads / result.threads);
+
+    table << result.scenario << "\t" << result.threads << "\t" << result.events << "\t";
+    table << std::fixed << std::setprecision(3) << result.wall << "\t" << result.cpu << "\t";
+    table << std::setprecision(0) << rate << "\t";
+    table << std::setprecision(2) << speedup << "\t" << efficiency << "\t";
+    table << std::setprecision(1) << result.rssMB << "\t" << result.peakRssMB << std::endl;
+    table.unsetf(std::ios::floatfield);
+  }
+
+  std::cout << table.str();
+
+  if (opts.output.Length() != 0) {
+    std::ofstream out(opts.output.Data());
+    out << table.str();
+  }
+
+  return 0;
+}
@@ -0,0 +1,75 @@
+#ifndef multidraw_AliasCache_h
+#define multidraw_AliasCache_h
+
+#include "TString.h"
+
+#include <vector>
+#include <map>
+#include <memory>
+#include <mutex>
+
+namespace multidraw {
+
+  //! Persistent store of alias values per input file.
+  /*!
+   * For each input file, the cache holds one column per alias definition. A column stores the values of the
+   * alias for the local entries in which it was evaluated. Columns are identified by a key (see
+   * MultiDraw::setAliasCache) that changes whenever the alias, an alias it may depend on, or the branch
+   * replacements and friend trees of its drawer change.
+   *
+   * Each input file has a sidecar ROOT file <directory>/aliases_<md5 of input path>.root. It holds the UUID of
+   * the input file (a rewritten input invalidates all columns) and, per column, the vectors entries_<key>,
+   * offsets_<key>, and values_<key>. Entries missing from a column (e.g. rejected by a different filter in
+   * the run that wrote it) are evaluated and added to the column by the next save(). Columns of other alias
+   * definitions are kept, so the sidecar files only grow; delete the directory to clear the cache.
+   */
+  class AliasCache {
+  public:
+    struct Column {
+      //! Local entry numbers, in increasing order (not enforced during recording)
+      std::vector<Long64_t> entries{};
+      //! Values of entry i are values[offsets[i]] to values[offsets[i + 1]]
+      std::vector<unsigned> offsets{0};
+      std::vector<double> values{};
+
+      //! Values of the entry and their number, or nullptr if the entry is not recorded
+      double const* find(Long64_t entry, unsigned& n) const;
+      void add(Long64_t entry, double const* values, unsigned n);
+      bool empty() const { return entries.empty(); }
+    };
+
+    struct FileRecord {
+      TString uuid{};
+      std::map<TString, Column> columns{};
+
+      //! Column of the key, or nullptr
+      Column const* getColumn(TString const& key) const;
+    };
+
+    AliasCache(char const* directory);
+
+    //! Record of the file, or nullptr if not cached or stale. Thread safe.
+    FileRecord const* find(char const* path, TString const& uuid);
+
+    //! Add the values recorded by a thread in a part of a file. Thread safe.
+    void add(char const* path, FileRecord&&);
+
+    //! Merge the recorded values into the sidecar files. Returns the number of files written.
+    unsigned save();
+
+  private:
+    TString cachePath_(char const* path) const;
+    std::unique_ptr<FileRecord> load_(char const* path) const;
+
+    TString directory_;
+
+    std::mutex mutex_{};
+    //! Loaded records (nullptr = no sidecar file)
+    std::map<TString, std::unique_ptr<FileRecord>> loaded_{};
+    //! Records of this job, per file
+    std::map<TString, std::vector<FileRecord>> recorded_{};
+  };
+
+}
+
+#endif
@@ -0,0 +1,68 @@
+#ifndef multidraw_AliasStore_h
+#define multidraw_AliasStore_h
+
+#include "TString.h"
+
+#include <vector>
+#include <deque>
+#include <memory>
+
+class TTree;
+class TBranch;
+
+namespace multidraw {
+
+  //! Per-thread store of the alias values of the current event.
+  /*!
+   * Values are kept in plain buffers that are overwritten for every event, so the memory use does not grow
+   * with the number of processed events. For TTreeFormulas to find the aliases by name, the store owns a
+   * TTree that is added as a friend to the input chain. The tree is never filled; its branches point to the
+   * buffers of the store and GetEntry on them does not read anything.
+   * TTreeFunctions can access the values directly through FunctionLibrary::getAliasStore().
+   */
+  class AliasStore {
+  public:
+    AliasStore(char const* treeName = "_aliases");
+    ~AliasStore();
+
+    TTree& getTree() const { return *tree_; }
+
+    //! Book an alias and return its index in the store.
+    /*!
+     * Array aliases are represented as a variable-length array with a counter branch size__<name>.
+     */
+    unsigned book(char const* name, bool isArray);
+
+    unsigned size() const { return entries_.size(); }
+    //! Index of the alias; -1 if not found
+    int find(char const* name) const;
+
+    TString const& getName(unsigned i) const { return entries_.at(i).name; }
+    bool isArray(unsigned i) const { return entries_.at(i).nbranch != nullptr; }
+
+    unsigned getNdata(unsigned i) const { return entries_[i].nD; }
+    double const* data(unsigned i) const { return entries_[i].values.data(); }
+    double get(unsigned i, unsigned iD = 0) const { return entries_[i].values[iD]; }
+
+    //! Set a scalar alias value.
+    void set(unsigned i, double v) { entries_[i].values[0] = v; }
+    //! Set the number of elements of an array alias and return the value buffer.
+    double* resize(unsigned i, unsigned n);
+
+  private:
+    struct Entry {
+      TString name{};
+      TBranch* nbranch{nullptr};
+      TBranch* vbranch{nullptr};
+      unsigned nD{1};
+      std::vector<double> values{};
+    };
+
+    std::unique_ptr<TTree> tree_{};
+    // deque to keep the addresses of the counters stable
+    std::deque<Entry> entries_{};
+  };
+
+}
+
+#endif
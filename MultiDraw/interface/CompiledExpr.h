@@ -40,10 +40,14 @@ namespace multidraw {
 
     unsigned getNdata();
     double evaluate(unsigned);
+    //! Write the values of all instances to out, which must hold getNdata() values. Call getNdata() first.
+    void evaluateAll(double* out);
 
   private:
     TTreeFormulaCached* formula_{};
     TTreeFunction* function_{};
+    //! Function implements the batch interface (TTreeFunction::evaluateAll)
+    bool batch_{false};
   };
 
   typedef std::unique_ptr<CompiledExpr> CompiledExprPtr;
@@ -2,6 +2,8 @@
 #define multidraw_Cut_h
 
 #include "ExprFiller.h"
+#include "CutAtomLibrary.h"
+#include "Profiler.h"
 
 #include "TString.h"
 
@@ -25,17 +27,22 @@ namespace multidraw {
 
     unsigned getNFillers() const { return fillers_.size(); }
     ExprFiller const* getFiller(unsigned i) const { return fillers_.at(i).get(); }
+    ExprFiller* getFiller(unsigned i) { return fillers_.at(i).get(); }
 
     void setCutExpr(char const* expr) { cutExpr_ = expr; }
     TString const& getCutExpr() const { return cutExpr_; }
 
     void addCategory(char const* expr) { categoryExprs_.emplace_back(expr); }
+    std::vector<TString> const& getCategoryExprs() const { return categoryExprs_; }
     void setCategorization(char const* expr);
+    TString const& getCategorizationExpr() const { return categorizationExpr_; }
     int getNCategories() const;
 
     void addFiller(ExprFillerPtr&& _filler) { fillers_.emplace_back(std::move(_filler)); }
 
     void bindTree(FormulaLibrary&, FunctionLibrary&);
+    //! Register the top-level && clauses of the cut expression to the atom library and use it in evaluate()
+    void bindAtoms(CutAtomLibrary&);
     void unlinkTree();
     std::unique_ptr<Cut> threadClone(FormulaLibrary&, FunctionLibrary&) const;
 
@@ -43,10 +50,24 @@ namespace multidraw {
 
     void initialize();
     bool evaluate();
+    //! Category index of each iteration (-1 = rejected) determined by the last evaluate()
+    std::vector<int> const& getCategoryIndex() const { return categoryIndex_; }
+    //! Set the result of evaluate() from a previous evaluation of the same event (see CutCache)
+    void setCategoryIndex(int const* begin, int const* end) { categoryIndex_.assign(begin, end); }
     void fillExprs(std::vector<double> const& eventWeights);
 
+    //! Hand the histogram buffers of the thread-clone fillers to the main-thread fillers
+    void reduceExprs();
+    //! Add the reduced histogram buffers to the histograms of the main-thread fillers
+    void finalizeExprs();
+
     unsigned getCount() const { return counter_; }
 
+    //! Count and time (in the sampled entries, see Profiler) the fill calls of the individual fillers
+    void setProfileFillers(bool);
+    //! Profile counters of the fillers, in the order of getFiller
+    std::vector<ProfileCounter> const& getFillerProfiles() const { return fillerProfiles_; }
+
   protected:
     TString name_{""};
     TString cutExpr_{""};
@@ -60,6 +81,14 @@ namespace multidraw {
     TTreeFormulaCached* compiledCut_{};
     std::vector<TTreeFormulaCached*> compiledCategories_{};
     TTreeFormulaCached* compiledCategorization_{};
+
+    CutAtomLibrary* atoms_{nullptr};
+    CutAtomLibrary::Mask atomMask_{};
+    // the atoms fully determine the cut result
+    bool atomsComplete_{false};
+
+    bool profileFillers_{false};
+    std::vector<ProfileCounter> fillerProfiles_{};
   };
 
   typedef std::unique_ptr<Cut> CutPtr;
@@ -0,0 +1,67 @@
+#ifndef multidraw_CutAtomLibrary_h
+#define multidraw_CutAtomLibrary_h
+
+#include "TString.h"
+
+#include <vector>
+#include <unordered_map>
+#include <string>
+#include <cstdint>
+
+class TTreeFormulaCached;
+
+namespace multidraw {
+
+  class FormulaLibrary;
+
+  //! Shared store of the top-level && clauses ("atoms") of the cut expressions.
+  /*!
+   * Cut expressions are split on the top-level && and each distinct clause is compiled once. Clause values
+   * of the current event are kept in a bitset and evaluated lazily, so that a clause shared by many cuts
+   * (e.g. the supercut or a region selection) is evaluated only once per event, and all cuts containing a
+   * failing clause are rejected with a mask test.
+   * Only clauses that evaluate to a single value (TTreeFormula multiplicity 0) are used as atoms; clauses
+   * iterating over arrays must be evaluated together with the rest of the expression.
+   */
+  class CutAtomLibrary {
+  public:
+    //! Set of atoms of a cut
+    struct Mask {
+      std::vector<std::pair<unsigned, std::uint64_t>> words{}; // (word index, bits)
+      std::vector<unsigned> atoms{};
+    };
+
+    CutAtomLibrary(FormulaLibrary& library) : library_(library) {}
+
+    //! Register the atoms of the expression.
+    /*!
+     * Returns the mask of the scalar atoms. The last argument is set to true if the expression is fully
+     * represented by the mask.
+     */
+    Mask addExpression(char const* expr, bool& complete);
+
+    //! Forget the atom values of the previous event.
+    void resetEvent();
+
+    //! Test if all atoms in the mask are true, evaluating them if necessary.
+    bool test(Mask const&);
+
+    unsigned size() const { return formulas_.size(); }
+
+    //! Split the expression on the top-level &&. Returns a single element if there is a top-level ||, a bitwise operator, or a ternary.
+    static std::vector<TString> split(char const* expr);
+
+  private:
+    bool evaluate_(unsigned);
+
+    FormulaLibrary& library_;
+    std::unordered_map<std::string, unsigned> indices_{};
+    std::vector<TTreeFormulaCached*> formulas_{};
+    std::vector<bool> scalar_{};
+    std::vector<std::uint64_t> evaluated_{};
+    std::vector<std::uint64_t> values_{};
+  };
+
+}
+
+#endif
@@ -0,0 +1,85 @@
+#ifndef multidraw_CutCache_h
+#define multidraw_CutCache_h
+
+#include "TString.h"
+
+#include <vector>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <utility>
+
+namespace multidraw {
+
+  //! Persistent record of the filter and cut results per input file.
+  /*!
+   * For each input file, the cache stores the local entry numbers passing the filter and, for each of these
+   * entries, the category indices of the filter and of the cuts (one per iteration, -1 = iteration rejected).
+   * A later run with the same cut configuration (identified by a key string, see MultiDraw::setCutCache)
+   * skips the entries failing the filter without reading them and restores the cut results instead of
+   * evaluating the expressions.
+   *
+   * Each file is stored as a ROOT file <directory>/cuts_<md5 of key and input path>.root holding the key, the
+   * UUID of the input file (records of a rewritten input are ignored), and the compressed entry and result
+   * arrays. Threads record the entry ranges they processed; save() writes the files whose entries were all
+   * processed in this job.
+   *
+   * The result of one entry is a sequence of blocks, one for the filter and one per cut. A block is 0 if the
+   * cut rejected the event, and otherwise n + 1 followed by the n category indices.
+   */
+  class CutCache {
+  public:
+    struct FileRecord {
+      TString uuid{};
+      //! Number of entries of the tree in the file
+      Long64_t nEntries{0};
+      //! Local entries passing the filter, in increasing order
+      std::vector<Long64_t> entries{};
+      //! Result blocks of the entries, concatenated
+      std::vector<int> data{};
+      //! Position of the blocks of each entry in data
+      std::vector<unsigned> offsets{};
+      //! Processed entry ranges [first, last) (recording only)
+      std::vector<std::pair<Long64_t, Long64_t>> ranges{};
+
+      //! Result blocks of the entry, or nullptr if it did not pass the filter
+      int const* find(Long64_t entry) const;
+
+      //! Mark an entry as processed (entries of a thread come in increasing order within a range)
+      void cover(Long64_t entry);
+      //! Append the result blocks of an entry passing the filter
+      void add(Long64_t entry, std::vector<int> const& blocks);
+    };
+
+    //! Constructor. nBlocks = 1 + number of cuts.
+    CutCache(char const* directory, char const* key, unsigned nBlocks);
+
+    //! Complete record of the file, or nullptr if not cached or stale. Thread safe.
+    FileRecord const* find(char const* path, TString const& uuid);
+
+    //! Add the results recorded by a thread for a part of a file. Thread safe.
+    void add(char const* path, FileRecord&&);
+
+    //! Write the files whose entries were all processed. Returns the number of files written.
+    unsigned save();
+
+    unsigned getNBlocks() const { return nBlocks_; }
+
+  private:
+    TString cachePath_(char const* path) const;
+    std::unique_ptr<FileRecord> load_(char const* path, TString const& uuid) const;
+
+    TString directory_;
+    TString key_;
+    unsigned nBlocks_;
+
+    std::mutex mutex_{};
+    //! Loaded records (nullptr = no valid record)
+    std::map<TString, std::unique_ptr<FileRecord>> loaded_{};
+    //! Records of this job, per file
+    std::map<TString, std::vector<FileRecord>> recorded_{};
+  };
+
+}
+
+#endif
@@ -4,9 +4,12 @@
 #include "TTreeFormulaCached.h"
 #include "Reweight.h"
 #include "CompiledExpr.h"
+#include "HistogramBuffer.h"
 
 #include "TString.h"
 
+class TDirectory;
+
 #include <vector>
 #include <memory>
 
@@ -36,6 +39,16 @@ namespace multidraw {
     ReweightSource const* getReweightSource() const { return reweightSource_.get(); }
     Reweight const* getReweight() const { return compiledReweight_.get(); }
 
+    //! Add a weight variation.
+    /*!
+     * The object must be a TObjArray holding, for each category of the cut (a single one if the cut is not
+     * categorized), one object per variation in the order of the addVariation calls. Each entry is filled
+     * into all variations of its category with the weight multiplied by the variation factor; the expressions,
+     * the category and the base weight are evaluated only once.
+     */
+    void addVariation(ReweightSource const&);
+    unsigned getNVariations() const { return variationSources_.size(); }
+
     void bindTree(FormulaLibrary&, FunctionLibrary&);
     void unlinkTree();
     std::unique_ptr<ExprFiller> threadClone(FormulaLibrary&, FunctionLibrary&);
@@ -46,6 +59,24 @@ namespace multidraw {
     //! Merge the underlying object into the main-thread object
     void mergeBack();
 
+    //! Hand the histogram buffer to the main-thread filler (see HistogramBufferReducer)
+    void reduce();
+    //! Add the reduced histogram buffers of all threads to the underlying object (main-thread filler)
+    void finalize();
+
+    //! Number of doubles exchanged through exportBuffer/importBuffer; 0 if the object is not a buffered histogram
+    unsigned getSharedBufferSize() const;
+    //! Write the reduced histogram buffer into a flat array (worker process in process multiplexing)
+    void exportBuffer(double*);
+    //! Add a histogram buffer written by exportBuffer in another process
+    void importBuffer(double const*);
+    //! Write the underlying object(s) to the directory under key (suffixed with _<category> if categorized)
+    void writeObj(TDirectory&, char const* key) const;
+    //! Add the contents of the object(s) written by writeObj in another process
+    void mergeObj(TDirectory&, char const* key);
+    //! Clear the contents of the underlying object(s) (worker process, before filling)
+    void resetObj();
+
     unsigned getCount() const { return counter_; }
 
   protected:
@@ -55,6 +86,17 @@ namespace multidraw {
     virtual void doFill_(unsigned, int = -1) = 0;
     virtual ExprFiller* clone_() = 0;
     virtual void mergeBack_() = 0;
+    //! Filler-specific setup at the end of initialize()
+    virtual void initialize_() {}
+    //! Compile filler-specific expressions at the end of bindTree()
+    virtual void bindTree_(FormulaLibrary&, FunctionLibrary&) {}
+    //! Collect filler-specific thread outputs at the beginning of finalize() (main-thread filler)
+    virtual void finalize_() {}
+
+    //! HistogramBuffer for the object, with the variations interleaved
+    HistogramBufferPtr makeHistBuffer_() const;
+    //! Evaluate the factors of the weight variations for the instance
+    double const* evaluateVariations_(unsigned);
 
     TObject& tobj_;
 
@@ -71,6 +113,17 @@ namespace multidraw {
     ReweightPtr compiledReweight_{nullptr};
 
     bool categorized_{false};
+    //! Fill only the first passing instance of each event
+    bool firstPassOnly_{false};
+
+    std::vector<ReweightSource> variationSources_{};
+    std::vector<ReweightPtr> variationReweights_{};
+    std::vector<double> variationFactors_{};
+
+    // Histogram fillers accumulate into histBuffer_; thread clones share tobj_ with the source
+    bool sharedObj_{false};
+    HistogramBufferPtr histBuffer_{};
+    HistogramBufferReducer histReducer_{};
   };
 
   typedef std::unique_ptr<ExprFiller> ExprFillerPtr;
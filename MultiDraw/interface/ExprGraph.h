@@ -0,0 +1,103 @@
+#ifndef multidraw_ExprGraph_h
+#define multidraw_ExprGraph_h
+
+#include "ExprParser.h"
+
+#include "TString.h"
+
+#include <vector>
+#include <unordered_map>
+#include <string>
+
+class TTreeFormulaCached;
+
+namespace multidraw {
+
+  //! Hash-consed graph of the subexpressions of the formulas in a FormulaLibrary.
+  /*!
+   * Formulas are parsed into expression trees whose nodes are identified by their operation and operand
+   * nodes, so that a subexpression appearing in several formulas (e.g. "ptll>30" in a cut and in the plot
+   * expression "mll*(ptll>30)") or several times in one formula is a single node. Whitespace, redundant
+   * parentheses, and the order of the operands of commutative operators (+ * == != && ||) do not matter.
+   * Node values of the current event are kept in a dense slot array and computed on first use, so each
+   * distinct subexpression and each leaf is evaluated at most once per event.
+   *
+   * Formulas are parsed with ExprParser, as in FormulaCompiler, and evaluated with the same TTreeFormula
+   * semantics. Formulas outside of the supported syntax are not added and stay interpreted.
+   */
+  class ExprGraph {
+  public:
+    ExprGraph() {}
+
+    //! Add the formula to the graph. Returns the index of its root node, or -1 if it cannot be represented.
+    int add(TTreeFormulaCached const&);
+
+    //! Forget the node values of the previous event.
+    void resetEvent();
+
+    //! Value of the node in the current event
+    double evaluate(unsigned node);
+
+    //! Number of distinct nodes
+    unsigned size() const { return nodes_.size(); }
+
+  private:
+    enum Operation {
+      kConstant,
+      kLeaf,
+      kNegate,
+      kNot,
+      kAdd,
+      kSubtract,
+      kMultiply,
+      kDivide,
+      kModulo,
+      kEqual,
+      kNotEqual,
+      kLess,
+      kLessEqual,
+      kGreater,
+      kGreaterEqual,
+      kAnd,
+      kOr,
+      kFunction1,
+      kFunction2
+    };
+
+    struct Node {
+      Operation op{kConstant};
+      unsigned operands[2]{0, 0};
+      double value{0.}; // kConstant
+      unsigned leaf{0}; // kLeaf: index in leaves_
+      long index{-1}; // kLeaf: array index, -1 for scalars
+      double (*function1)(double){nullptr};
+      double (*function2)(double, double){nullptr};
+    };
+
+    //! Leaf read through the formula that resolved it; the formula keeps the leaf pointer up to date
+    struct LeafRef {
+      TTreeFormulaCached const* formula{nullptr};
+      int code{-1};
+    };
+
+    //! Create the nodes of the syntax tree of the formula. Returns false if it cannot be represented.
+    bool build_(TTreeFormulaCached const&, ExprParser::Node const&, unsigned& result);
+    //! Find or create the node
+    unsigned intern_(Node const&);
+    double compute_(Node const&);
+    double readLeaf_(Node const&) const;
+
+    std::vector<Node> nodes_{};
+    std::unordered_map<std::string, unsigned> nodeIndices_{};
+    std::vector<LeafRef> leaves_{};
+    std::unordered_map<std::string, unsigned> leafIndices_{};
+
+    // node values of the current event are valid if the epoch of the node is the current epoch
+    std::vector<double> values_{};
+    std::vector<unsigned> epochs_{};
+    unsigned epoch_{1};
+  };
+
+}
+
+#endif
@@ -0,0 +1,56 @@
+#ifndef multidraw_ExprParser_h
+#define multidraw_ExprParser_h
+
+#include <string>
+#include <vector>
+
+class TLeaf;
+class TTreeFormulaCached;
+
+namespace multidraw {
+
+  //! Parser of the subset of the TTreeFormula syntax that can be evaluated outside of the interpreter.
+  /*!
+   * The syntax tree is the common input of FormulaCompiler (translation into C++) and ExprGraph (shared
+   * subexpressions). Supported are arithmetic (+ - * / %), comparisons, logical operations (&& || !), the
+   * common math functions of TFormula and TMath, numeric literals, and leaves that are either scalars or
+   * arrays indexed with a constant (e.g. Lepton_pt[0]). Constructs whose TFormula precedence differs from C
+   * (mixed && and || or chained comparisons without parentheses) are rejected.
+   */
+  class ExprParser {
+  public:
+    struct Node {
+      enum Type {
+        kNumber,
+        kLeaf,
+        kUnary,
+        kBinary,
+        kFunction
+      };
+
+      Type type{kNumber};
+      //! Literal (kNumber), leaf name as written (kLeaf), operator (kUnary, kBinary), or function name (kFunction)
+      std::string text{};
+      //! Array index of a kLeaf node, -1 for scalars
+      long index{-1};
+      std::vector<Node> operands{};
+    };
+
+    //! Parse the expression. Returns false if it is outside of the supported syntax.
+    /*!
+     * Constants (TMath::Pi()) are returned as kNumber nodes, and the unary + is dropped.
+     */
+    static bool parse(char const* expr, Node& root);
+
+    //! Leaf of a kLeaf node among the leaves that TTreeFormula resolved.
+    /*!
+     * Returns nullptr if the name does not identify a single leaf (TTree aliases, ambiguous names), if the
+     * leaf type is not supported (see TTreeFormulaCached::GetLeafCType), or if an array is not indexed. The
+     * index of the leaf in the formula is returned in the last argument.
+     */
+    static TLeaf* findLeaf(TTreeFormulaCached const&, Node const&, int& code);
+  };
+
+}
+
+#endif
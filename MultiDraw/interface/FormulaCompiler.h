@@ -0,0 +1,55 @@
+#ifndef multidraw_FormulaCompiler_h
+#define multidraw_FormulaCompiler_h
+
+#include "TTreeFormulaCached.h"
+
+#include "TString.h"
+
+#include <vector>
+
+namespace multidraw {
+
+  //! Translates formulas into C++ and compiles them into native code.
+  /*!
+   * Supported expressions are arithmetic (+ - * / %), comparisons, logical operations (&& || !), the common
+   * math functions of TFormula and TMath, numeric literals, and leaves that are either scalars or arrays
+   * indexed with a constant (e.g. Lepton_pt[0]). Anything else (TTree aliases, special functions like Sum$
+   * or Alt$, variable indices, implicit iteration over arrays) is left to the TTreeFormula interpreter.
+   * The semantics of TTreeFormula are preserved, including division by zero returning zero and sqrt and log
+   * of the TFormula functions being protected against negative arguments.
+   *
+   * All translatable formulas given to compile() are written into a single source file, which is built into
+   * a shared library with the compiler given by the environment variable CXX (default g++). The library is
+   * stored in the cache directory under the MD5 hash of the generated source and is reused by later calls
+   * and later jobs that generate the identical source. Within a process, each library is built once: threads
+   * asking for a library that is being built wait for that build. Compilation failures are reported as
+   * warnings, and the formulas then stay interpreted.
+   */
+  class FormulaCompiler {
+  public:
+    //! Constructor.
+    /*!
+     * If cacheDir is empty, the environment variable MULTIDRAW_JIT_CACHE is used. If the variable is not
+     * set either, the cache is placed under the system temporary directory.
+     */
+    FormulaCompiler(char const* cacheDir = "");
+
+    //! Compile the formulas and set the compiled functions to them. Returns the number of compiled formulas.
+    unsigned compile(std::vector<TTreeFormulaCached*> const&);
+
+    //! Translate the formula into a C++ expression.
+    /*!
+     * Returns an empty string if the formula cannot be translated. Leaves are read through the arguments
+     * of TTreeFormulaCached::CompiledFunction; the list of leaves used is returned in the second argument.
+     */
+    static TString translate(TTreeFormulaCached const&, std::vector<TTreeFormulaCached::CompiledLeaf>&);
+
+    TString const& getCacheDir() const { return cacheDir_; }
+
+  private:
+    TString cacheDir_{};
+  };
+
+}
+
+#endif
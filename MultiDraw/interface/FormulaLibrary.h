@@ -2,11 +2,14 @@
 #define multidraw_FormulaLibrary_h
 
 #include "TTreeFormulaCached.h"
+#include "ExprGraph.h"
 
 #include "TString.h"
 
 #include <unordered_map>
+#include <unordered_set>
 #include <list>
+#include <vector>
 #include <memory>
 
 class TTree;
@@ -29,15 +32,57 @@ namespace multidraw {
     void updateFormulaLeaves();
     void resetCache();
 
-    void replaceAll(char const* from, char const* to);
+    //! Replace a leaf in all formulas. Returns true if any formula was modified.
+    bool replaceAll(char const* from, char const* to);
+
+    //! Whether the formula has been modified by replaceAll.
+    bool isVaried(TTreeFormulaCached const& formula) const { return variedFormulas_.count(&formula) != 0; }
+
+    //! Let the formulas not modified by replaceAll use the caches of the same expressions in the nominal library.
+    /*!
+     * Used for systematic variations evaluated on the same tree: unvaried expressions are then computed
+     * once per event for the nominal and all variations. Both libraries must reset their caches for every
+     * event before any evaluation.
+     */
+    void shareCaches(FormulaLibrary const& nominal);
+
+    //! Compile the formulas into native code where possible. Returns the number of compiled formulas.
+    /*!
+     * Must be called after all formulas are created and the branch replacements are done. Formulas that
+     * cannot be translated are interpreted as usual. See FormulaCompiler for the cache directory.
+     */
+    unsigned compileFormulas(char const* cacheDir = "");
+
+    //! Evaluate the formulas through a graph of shared subexpressions. Returns the number of formulas in the graph.
+    /*!
+     * Formulas within the syntax supported by ExprGraph and not compiled are parsed into the graph, so that
+     * subexpressions and leaves common to several formulas are evaluated once per event. Must be called after
+     * all formulas are created and the branch replacements are done; a later replaceAll takes the formulas
+     * out of the graph.
+     */
+    unsigned shareSubexpressions();
+
+    //! Number of distinct subexpressions in the graph
+    unsigned getNSubexpressions() const { return graph_ ? graph_->size() : 0; }
 
     unsigned size() const { return formulas_.size(); }
 
+    //! Switch the profile counters of all caches (see Profiler)
+    void setProfiling(bool);
+
+    //! Caches of the expressions
+    std::unordered_map<std::string, TTreeFormulaCached::CachePtr> const& getCaches() const { return caches_; }
+
+    //! Names of the top-level branches of the given tree (the current tree of the chain or of a friend) read by the formulas
+    std::vector<TString> getBranchNames(TTree const&) const;
+
   private:
     TTree& tree_;
 
     std::unordered_map<std::string, TTreeFormulaCached::CachePtr> caches_{};
     std::list<std::unique_ptr<TTreeFormulaCached>> formulas_{};
+    std::unordered_set<TTreeFormulaCached const*> variedFormulas_{};
+    std::unique_ptr<ExprGraph> graph_{};
   };
 
 }
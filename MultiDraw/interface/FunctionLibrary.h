@@ -9,6 +9,7 @@
 #include "TString.h"
 
 #include <unordered_map>
+#include <vector>
 #include <memory>
 #include <functional>
 
@@ -51,12 +52,85 @@ namespace multidraw {
     void replace(TTreeReader& tr, char const* branchName = nullptr) override;
   };
 
+  //! Contiguous view of the values of a branch in the current entry.
+  /*!
+   * Obtained from FunctionLibrary::getArrayColumn / getValueColumn. The view is refreshed by
+   * FunctionLibrary::setEntry, so functions bind once and then read through raw pointers.
+   */
+  template<typename T>
+  class ColumnView {
+  public:
+    T const* data() const { return data_; }
+    unsigned size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    T const& operator[](unsigned i) const { return data_[i]; }
+    T const* begin() const { return data_; }
+    T const* end() const { return data_ + size_; }
+
+  private:
+    template<typename> friend class ArrayColumnSlot;
+    template<typename> friend class ValueColumnSlot;
+
+    T const* data_{nullptr};
+    unsigned size_{0};
+  };
+
+  class FunctionLibrary;
+
+  //! Binding of a ColumnView to a branch reader.
+  class ColumnSlot {
+  public:
+    ColumnSlot(char const* branchName) : branchName_(branchName) {}
+    virtual ~ColumnSlot() {}
+    TString const& getBranchName() const { return branchName_; }
+    //! Point the view to the data of the current entry
+    virtual void update() = 0;
+    //! Read from a different branch
+    virtual void rebind(FunctionLibrary&, char const* branchName) = 0;
+
+  protected:
+    TString branchName_;
+  };
+
+  typedef std::unique_ptr<ColumnSlot> ColumnSlotPtr;
+
+  template<typename T>
+  class ArrayColumnSlot : public ColumnSlot {
+  public:
+    ArrayColumnSlot(FunctionLibrary& library, char const* branchName) : ColumnSlot(branchName) { rebind(library, branchName); }
+    void update() override;
+    void rebind(FunctionLibrary&, char const* branchName) override;
+    ColumnView<T> const& getView() const { return view_; }
+
+  private:
+    TTreeReaderArray<T>* reader_{nullptr};
+    ColumnView<T> view_{};
+    //! Copy of the values if the reader does not hold them contiguously
+    std::unique_ptr<T[]> buffer_{};
+    unsigned bufferSize_{0};
+  };
+
+  template<typename T>
+  class ValueColumnSlot : public ColumnSlot {
+  public:
+    ValueColumnSlot(FunctionLibrary& library, char const* branchName) : ColumnSlot(branchName) { rebind(library, branchName); }
+    void update() override;
+    void rebind(FunctionLibrary&, char const* branchName) override;
+    ColumnView<T> const& getView() const { return view_; }
+
+  private:
+    TTreeReaderValue<T>* reader_{nullptr};
+    ColumnView<T> view_{};
+  };
+
+  class AliasStore;
+
   class FunctionLibrary {
   public:
     FunctionLibrary(TTree& tree) : reader_(new TTreeReader(&tree)) {}
     ~FunctionLibrary();
 
-    //! Set the TTreeReader entry number and call beginEvent() of all linked functions
+    //! Set the TTreeReader entry number, update the column views, and call beginEvent() of all linked functions
     void setEntry(long long iEntry);
 
     TTreeFunction& getFunction(TTreeFunction const&);
@@ -68,15 +142,38 @@ namespace multidraw {
     template<class T> void bindBranch(TTreeReaderArray<T>*&, char const*);
     template<class T> void bindBranch(TTreeReaderValue<T>*&, char const*);
 
-    // swap branch pointers
-    void replaceAll(char const* from, char const* to);
+    //! Typed views of branches, filled once per entry in setEntry().
+    /*!
+     * The returned reference stays valid for the lifetime of the library. Branch lookup and type checks are
+     * done only here; per entry, the views are refreshed in a single pass over the bound columns.
+     */
+    template<typename T> ColumnView<T> const& getArrayColumn(char const*);
+    template<typename T> ColumnView<T> const& getValueColumn(char const*);
+
+    // convenience
+    template<class T> void bindArrayColumn(ColumnView<T> const*& view, char const* bname) { view = &getArrayColumn<T>(bname); }
+    template<class T> void bindValueColumn(ColumnView<T> const*& view, char const* bname) { view = &getValueColumn<T>(bname); }
+
+    // swap branch pointers; returns true if a branch was replaced
+    // column views are repointed to the reader of the new branch
+    bool replaceAll(char const* from, char const* to);
+
+    //! Names of the branches bound or declared by the functions (as given to bindBranch, i.e. before replaceAll)
+    std::vector<TString> getBranchNames() const;
 
     void addDestructorCallback(std::function<void(void)> const& f) { destructorCallbacks_.push_back(f); }
 
+    //! Values of the MultiDraw aliases for the current event (nullptr if no alias is defined)
+    AliasStore const* getAliasStore() const { return aliasStore_; }
+    void setAliasStore(AliasStore const* store) { aliasStore_ = store; }
+
   private:
     std::unique_ptr<TTreeReader> reader_{};
+    AliasStore const* aliasStore_{nullptr};
     std::unordered_map<std::string, TTreeReaderObjectPtr> branchReaders_{};
     std::unordered_map<TTreeFunction const*, std::unique_ptr<TTreeFunction>> functions_{};
+    std::vector<ColumnSlotPtr> columns_{};
+    std::unordered_map<std::string, ColumnSlot*> columnIndex_{};
 
     std::vector<std::function<void(void)>> destructorCallbacks_;
   };
@@ -192,6 +289,100 @@ multidraw::FunctionLibrary::bindBranch(TTreeReaderArray<T>*& _reader, char const
   _reader = &getArray<T>(_bname);
 }
 
+template<typename T>
+void
+multidraw::ArrayColumnSlot<T>::update()
+{
+  unsigned size(reader_->GetSize());
+  view_.size_ = size;
+  if (size == 0) {
+    view_.data_ = nullptr;
+    return;
+  }
+
+  T const* first(&reader_->At(0));
+  if (size == 1 || &reader_->At(size - 1) == first + size - 1) {
+    // plain arrays and std::vectors
+    view_.data_ = first;
+    return;
+  }
+
+  if (bufferSize_ < size) {
+    buffer_.reset(new T[size]);
+    bufferSize_ = size;
+  }
+  for (unsigned i(0); i != size; ++i)
+    buffer_[i] = reader_->At(i);
+
+  view_.data_ = buffer_.get();
+}
+
+template<typename T>
+void
+multidraw::ArrayColumnSlot<T>::rebind(FunctionLibrary& _library, char const* _branchName)
+{
+  reader_ = &_library.getArray<T>(_branchName);
+  branchName_ = _branchName;
+}
+
+template<typename T>
+void
+multidraw::ValueColumnSlot<T>::update()
+{
+  view_.data_ = reader_->Get();
+  view_.size_ = 1;
+}
+
+template<typename T>
+void
+multidraw::ValueColumnSlot<T>::rebind(FunctionLibrary& _library, char const* _branchName)
+{
+  reader_ = &_library.getValue<T>(_branchName);
+  branchName_ = _branchName;
+}
+
+template<typename T>
+multidraw::ColumnView<T> const&
+multidraw::FunctionLibrary::getArrayColumn(char const* _bname)
+{
+  auto cItr(columnIndex_.find(_bname));
+  if (cItr == columnIndex_.end()) {
+    auto* slot(new ArrayColumnSlot<T>(*this, _bname));
+    columns_.emplace_back(slot);
+    cItr = columnIndex_.emplace(_bname, slot).first;
+  }
+
+  auto* slot(dynamic_cast<ArrayColumnSlot<T>*>(cItr->second));
+  if (slot == nullptr) {
+    std::stringstream ss;
+    ss << "Column " << _bname << " is already bound as a different type" << std::endl;
+    throw std::runtime_error(ss.str());
+  }
+
+  return slot->getView();
+}
+
+template<typename T>
+multidraw::ColumnView<T> const&
+multidraw::FunctionLibrary::getValueColumn(char const* _bname)
+{
+  auto cItr(columnIndex_.find(_bname));
+  if (cItr == columnIndex_.end()) {
+    auto* slot(new ValueColumnSlot<T>(*this, _bname));
+    columns_.emplace_back(slot);
+    cItr = columnIndex_.emplace(_bname, slot).first;
+  }
+
+  auto* slot(dynamic_cast<ValueColumnSlot<T>*>(cItr->second));
+  if (slot == nullptr) {
+    std::stringstream ss;
+    ss << "Column " << _bname << " is already bound as a different type" << std::endl;
+    throw std::runtime_error(ss.str());
+  }
+
+  return slot->getView();
+}
+
 typedef TTreeReaderArray<Float_t> FloatArrayReader;
 typedef TTreeReaderValue<Float_t> FloatValueReader;
 typedef TTreeReaderArray<Int_t> IntArrayReader;
@@ -214,5 +405,11 @@ typedef std::unique_ptr<UCharValueReader> UCharValueReaderPtr;
 typedef std::unique_ptr<UIntArrayReader> UIntArrayReaderPtr;
 typedef std::unique_ptr<UIntValueReader> UIntValueReaderPtr;
 typedef std::unique_ptr<ULong64ValueReader> ULong64ValueReaderPtr;
+typedef multidraw::ColumnView<Float_t> FloatColumn;
+typedef multidraw::ColumnView<Int_t> IntColumn;
+typedef multidraw::ColumnView<Bool_t> BoolColumn;
+typedef multidraw::ColumnView<UChar_t> UCharColumn;
+typedef multidraw::ColumnView<UInt_t> UIntColumn;
+typedef multidraw::ColumnView<ULong64_t> ULong64Column;
 
 #endif
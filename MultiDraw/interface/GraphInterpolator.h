@@ -0,0 +1,56 @@
+#ifndef multidraw_GraphInterpolator_h
+#define multidraw_GraphInterpolator_h
+
+#include "TGraph.h"
+
+#include <vector>
+#include <memory>
+
+namespace multidraw {
+
+  //! Read-only piecewise-cubic interpolation of the points of a TGraph.
+  /*!
+   * The polynomial of each knot is stored as four coefficient arrays (value, first to third order), so an
+   * evaluation is an interval search and a Horner step. The interval is found by index arithmetic if the
+   * knots are equidistant and by a branch-free binary search otherwise. Values outside the knot range are
+   * extrapolated with the polynomial of the first or last knot, as TSpline3::Eval does.
+   * Modes:
+   *  kLinear    Linear interpolation between the knots
+   *  kCubic     Cubic spline, with the coefficients of TSpline3 (the default of Reweight)
+   *  kMonotone  Monotone cubic Hermite interpolation (Fritsch-Carlson); no overshoot between the knots
+   */
+  class GraphInterpolator {
+  public:
+    enum Mode {
+      kLinear,
+      kCubic,
+      kMonotone,
+      nModes
+    };
+
+    GraphInterpolator(TGraph const&, Mode = kCubic);
+
+    Mode getMode() const { return mode_; }
+
+    double eval(double x) const;
+
+  private:
+    unsigned findKnot_(double x) const;
+
+    Mode mode_{kCubic};
+    //! Knot positions
+    std::vector<double> x_{};
+    //! Polynomial coefficients: y + dx * (b + dx * (c + dx * d)), dx = x - x_[i]
+    std::vector<double> y_{};
+    std::vector<double> b_{};
+    std::vector<double> c_{};
+    std::vector<double> d_{};
+    //! Inverse knot spacing for equidistant knots, 0 otherwise
+    double invStep_{0.};
+  };
+
+  typedef std::shared_ptr<GraphInterpolator const> GraphInterpolatorPtr;
+
+}
+
+#endif
@@ -0,0 +1,109 @@
+#ifndef multidraw_HistogramBuffer_h
+#define multidraw_HistogramBuffer_h
+
+#include "HistogramLookup.h"
+
+#include "TH1.h"
+#include "TH2.h"
+#include "TObjArray.h"
+
+#include <vector>
+#include <memory>
+#include <mutex>
+
+namespace multidraw {
+
+  //! Dense per-thread accumulator of histogram contents.
+  /*!
+   * Replaces the per-thread histogram clones of plot fillers. Sum of weights and sum of squared weights of
+   * all bins of all categories are kept in a single contiguous array, together with the fill statistics of
+   * each category. The histograms themselves are only read for the binning (they must not be extendable)
+   * and are written once by writeTo().
+   * Fill semantics are those of TH1::Fill(x, w) and TH2::Fill(x, y, w). The axes are copied to AxisLookups at
+   * construction, so that filling does not call into the histogram.
+   */
+  class HistogramBuffer {
+  public:
+    //! Construct a buffer for a histogram or a TObjArray of histograms (categorized).
+    /*!
+     * With interleave > 1, each group of interleave consecutive histograms of the array must have the same
+     * binning, and the cells of a group are stored bin-major, so that fillVariations() touches one
+     * contiguous block.
+     */
+    HistogramBuffer(TObject const& obj, bool categorized, unsigned interleave = 1);
+
+    //! Whether the histogram(s) can be accumulated with a HistogramBuffer.
+    static bool canBuffer(TObject const& obj, bool categorized);
+
+    void fill(unsigned icat, double x, double w);
+    void fill(unsigned icat, double x, double y, double w);
+
+    //! Fill the same point into the interleave categories starting at firstCat with weights w * factors[i].
+    void fillVariations(unsigned firstCat, double x, double w, double const* factors);
+    void fillVariations(unsigned firstCat, double x, double y, double w, double const* factors);
+
+    //! Add the contents of another buffer of the same histogram(s).
+    void add(HistogramBuffer const&);
+
+    //! Add the contents to the histogram(s).
+    void writeTo(TObject& obj, bool categorized) const;
+
+    //! Number of doubles written by serialize().
+    unsigned serializedSize() const { return categories_.size() * (2 + kNStats) + bins_.size(); }
+    //! Write the contents into a flat array (e.g. shared memory).
+    void serialize(double*) const;
+    //! Add the contents serialized by a buffer of the same histogram(s).
+    void addSerialized(double const*);
+
+  private:
+    // TH1::GetStats array size for up to 2D histograms
+    static constexpr unsigned kNStats = 7;
+
+    struct Category {
+      AxisLookup xaxis{};
+      AxisLookup yaxis{};
+      //! Cell i is at offset + i * stride
+      unsigned offset{0};
+      unsigned stride{1};
+      unsigned nCells{0};
+      double entries{0.};
+      bool weighted{false};
+      double stats[kNStats]{};
+    };
+
+    void writeTo_(TH1&, Category const&) const;
+    void addStats_(Category&, int bin, double x, double w);
+    void addStats_(Category&, int binx, int biny, double x, double y, double w);
+
+    std::vector<Category> categories_{};
+    unsigned interleave_{1};
+    bool statOverflows_{false};
+    //! (sumw, sumw2) of all cells, interleaved
+    std::vector<double> bins_{};
+  };
+
+  typedef std::unique_ptr<HistogramBuffer> HistogramBufferPtr;
+
+  //! Collects the HistogramBuffers of the threads.
+  /*!
+   * Each thread hands its buffer to reduce() when it finishes. If another buffer is already waiting, the two
+   * are added outside the lock and the result is handed in again, so that the merge proceeds pairwise and in
+   * parallel. The remaining buffer is retrieved with release().
+   */
+  class HistogramBufferReducer {
+  public:
+    HistogramBufferReducer() {}
+    // mutex is not copyable; copies start empty
+    HistogramBufferReducer(HistogramBufferReducer const&) {}
+
+    void reduce(HistogramBufferPtr&&);
+    HistogramBufferPtr release();
+
+  private:
+    std::mutex mutex_{};
+    HistogramBufferPtr pending_{};
+  };
+
+}
+
+#endif
@@ -0,0 +1,59 @@
+#ifndef multidraw_HistogramLookup_h
+#define multidraw_HistogramLookup_h
+
+#include "TH1.h"
+
+#include <vector>
+#include <memory>
+
+namespace multidraw {
+
+  //! Bin lookup table of a TAxis
+  /*!
+   * Bins of uniform axes are found by index arithmetic and those of variable-width axes by a branch-free
+   * binary search over the edges, without virtual calls into the axis. Uniform axes where the arithmetic
+   * does not reproduce TAxis::FindFixBin at the bin edges also use the edges.
+   */
+  class AxisLookup {
+  public:
+    AxisLookup() {}
+    AxisLookup(TAxis const&);
+
+    //! Same result as TAxis::FindFixBin
+    int findBin(double x) const;
+    //! findBin with the underflow and overflow mapped to the first and last bins
+    int findBinClamped(double x) const;
+
+    int nbins{1};
+    double xmin{0.};
+    double xmax{0.};
+    //! Bin edges for variable-width bins, empty for uniform bins found by index arithmetic
+    std::vector<double> edges{};
+  };
+
+  //! Read-only snapshot of the contents of a 1D or 2D histogram.
+  /*!
+   * Bin contents are copied to a flat array at construction, so that the lookup does not touch the source
+   * histogram and a single snapshot can be shared by all threads.
+   */
+  class HistogramLookup {
+  public:
+    HistogramLookup(TH1 const&);
+
+    int getDimension() const { return ndim_; }
+
+    //! Content of the bin containing (x, y). With clamp, values outside the axis ranges take the edge bins.
+    double getValue(double x, double y, bool clamp) const;
+
+  private:
+    int ndim_{1};
+    AxisLookup xaxis_{};
+    AxisLookup yaxis_{};
+    std::vector<double> contents_{};
+  };
+
+  typedef std::shared_ptr<HistogramLookup const> HistogramLookupPtr;
+
+}
+
+#endif
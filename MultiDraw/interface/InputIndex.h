@@ -0,0 +1,60 @@
+#ifndef multidraw_InputIndex_h
+#define multidraw_InputIndex_h
+
+#include "TString.h"
+
+#include <vector>
+#include <map>
+#include <string>
+
+namespace multidraw {
+
+  //! Sidecar index of the numbers of entries and the cluster boundaries of input files.
+  /*!
+   * Reading the entry counts of remote files requires opening each of them. The index keeps, per file path,
+   * the file size and modification time together with the cluster boundaries of the tree, so that a later
+   * job can compute tree offsets and entry ranges with a stat call instead of opening the file. Records whose
+   * size or modification time do not match the current file are ignored.
+   * The index is a plain text file with one line per file and tree:
+   *   <path> <tree name> <size> <mtime> <boundary 0>,<boundary 1>,...,<number of entries>
+   * so that job splitters outside of MultiDraw can read it too. save() merges the records with the ones
+   * written in the meantime by other jobs and replaces the file atomically.
+   */
+  class InputIndex {
+  public:
+    //! Constructor. Reads the index file if it exists.
+    InputIndex(char const* path, char const* treeName);
+
+    //! Cluster boundaries of the file, the last element being the number of entries. Returns false if the record is missing or stale.
+    bool find(char const* fileName, std::vector<Long64_t>& boundaries) const;
+
+    //! Store the cluster boundaries of the file (last element = number of entries).
+    void update(char const* fileName, std::vector<Long64_t> const& boundaries);
+
+    //! Write the index if it was updated.
+    void save();
+
+    //! Read the cluster boundaries from the tree in the file. Returns false if the file or the tree cannot be read.
+    static bool scan(char const* fileName, char const* treeName, std::vector<Long64_t>& boundaries);
+
+  private:
+    struct Record {
+      Long64_t size{0};
+      Long_t mtime{0};
+      std::vector<Long64_t> boundaries{};
+    };
+
+    typedef std::map<std::string, Record> RecordMap;
+
+    void read_(RecordMap&) const;
+    static bool stat_(char const* fileName, Long64_t& size, Long_t& mtime);
+
+    TString path_;
+    TString treeName_;
+    RecordMap records_{};
+    bool updated_{false};
+  };
+
+}
+
+#endif
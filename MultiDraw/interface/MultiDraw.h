@@ -6,6 +6,9 @@
 #include "TreeFiller.h"
 #include "Cut.h"
 #include "Reweight.h"
+#include "Profiler.h"
+#include "CutCache.h"
+#include "AliasCache.h"
 
 #include "TChain.h"
 #include "TH1.h"
@@ -21,6 +24,8 @@
 #include <atomic>
 #include <tuple>
 #include <array>
+#include <memory>
+#include <functional>
 
 namespace multidraw {
 
@@ -52,7 +57,8 @@ namespace multidraw {
 
     //! Copy constructor.
     /*!
-     * All cut and weight expressions are copied, but no histograms / trees are.
+     * All cut and weight expressions and the systematic variations (with their own cut and weight expressions)
+     * are copied, but no histograms / trees are.
      */
     MultiDraw(MultiDraw const&);
     ~MultiDraw();
@@ -66,9 +72,21 @@ namespace multidraw {
     //! Add an input file.
     void addInputPath(char const* path) { inputPaths_.emplace_back(path); }
 
-    //! Add a friend tree (not tested)
+    //! Add a friend tree
+    /*!
+     * In multi-thread execution, each thread gets the friend files with the same indices as its input files,
+     * so the friend must consist of the same number of files with the same numbers of entries as the input.
+     * Friends with different file structures need an index (setFriendIndex).
+     */
     void addFriend(char const* treeName, TObjArray const* paths, char const* alias = "");
 
+    //! Align a friend tree through a TTreeIndex of the given major and minor expressions.
+    /*!
+     * alias is the alias given to addFriend (the tree name if no alias was given). The index is built on the
+     * friend chain of each thread, which reads the index values of all friend entries.
+     */
+    void setFriendIndex(char const* alias, char const* major, char const* minor = "0");
+
     //! Apply an entry list.
     void applyEntryList(TEntryList* elist) { entryList_ = elist; }
 
@@ -184,6 +202,22 @@ namespace multidraw {
 
     Plot2DFiller& addPlotList2D(TObjArray* histlist, TTreeFunction const& xexpr, TTreeFunction const& yexpr, char const* cutName, char const* reweight = "");
     
+    //! Add 1D histograms of weight variations.
+    /*!
+     * histlist holds one histogram per variation (per category and variation, category-major, if the cut is
+     * categorized). The variation weights are added with addVariation on the returned filler, in the order
+     * of the histograms. The expression, the category and the reweight are evaluated once per entry and the
+     * result is filled into all variations.
+     */
+    Plot1DFiller& addPlotVariations(TObjArray* histlist, char const* expr, char const* cutName = "", char const* reweight = "", Plot1DFiller::OverflowMode mode = Plot1DFiller::kDefault);
+
+    Plot1DFiller& addPlotVariations(TObjArray* histlist, TTreeFunction const& func, char const* cutName = "", char const* reweight = "", Plot1DFiller::OverflowMode mode = Plot1DFiller::kDefault);
+
+    //! Add 2D histograms of weight variations (see addPlotVariations).
+    Plot2DFiller& addPlotVariations2D(TObjArray* histlist, char const* xexpr, char const* yexpr, char const* cutName = "", char const* reweight = "");
+
+    Plot2DFiller& addPlotVariations2D(TObjArray* histlist, TTreeFunction const& xfunc, TTreeFunction const& yfunc, char const* cutName = "", char const* reweight = "");
+
     //! Add a tree to fill.
     TreeFiller& addTree(TTree* tree, char const* cutName = "", char const* reweight = "");
 
@@ -196,6 +230,18 @@ namespace multidraw {
     //! Reset the branch replacement
     void resetReplaceBranch(char const* original);
 
+    //! Add a systematic variation evaluated in the same event loop as this MultiDraw.
+    /*!
+     * Returns a MultiDraw object to be configured like a standalone drawer (filter, aliases, cuts,
+     * reweights, fillers), typically with replaceBranch calls that define the variation. The input paths,
+     * weight branch, prescale, and multiplexing of the variation are taken from this object; friend trees
+     * added to the variation are attached to the input chain of this object.
+     * Expressions of the variation that are not affected by its branch replacements share the cached values
+     * with the nominal expressions. Aliases of the variation must also be defined in this object; they are
+     * reevaluated only if they depend on a replaced branch.
+     */
+    MultiDraw& addVariation(char const* name);
+
     //! Run and fill the plots and trees.
     void execute(long nEntries = -1, unsigned long firstEntry = 0);
 
@@ -206,6 +252,33 @@ namespace multidraw {
      */
     void setInputMultiplexing(unsigned mux) { inputMultiplexing_ = mux; }
 
+    //! Set the number of worker processes.
+    /*
+     * If nproc > 1, execute() splits the entries into nproc contiguous ranges and forks nproc - 1 worker
+     * processes, each processing one range in its own address space (single-threaded; input multiplexing
+     * is ignored). The calling process processes the first range. Histogram contents are returned to the
+     * parent through a shared memory segment; trees and histograms that cannot be buffered (profiles,
+     * extendable axes) are returned through temporary ROOT files. Trees to fill must not be attached to a
+     * file. Cut and filler counts reflect the entries of the calling process only. Asynchronous prefetching
+     * and parallel unzipping (see setPrefetch) and the execution profile (see setProfileOutput) are disabled.
+     */
+    void setProcessMultiplexing(unsigned nproc) { processMultiplexing_ = nproc; }
+
+    enum SchedulingMode {
+      kStatic,
+      kDynamic
+    };
+
+    //! Set the scheduling mode for multi-thread execution.
+    /*
+     * kStatic: the input is split up front into one contiguous block of files or entries per thread.
+     * kDynamic: file metadata is read in parallel, and the cluster-sized entry ranges of all files are
+     *   distributed over per-thread work queues. A thread that runs out of work steals ranges from the
+     *   back of the queue with the most remaining entries. Not available when an entry list is applied,
+     *   in which case execute() falls back to kStatic.
+     */
+    void setSchedulingMode(SchedulingMode m) { schedulingMode_ = m; }
+
     //! Set the print level.
     /*
      * Level -1: silent
@@ -224,6 +297,92 @@ namespace multidraw {
      */
     void setDoTimeProfile(bool d) { doTimeProfile_ = d; }
 
+    //! Write the execution profile of all threads to a JSON file.
+    /*
+     * If path is not empty, execute() records in every thread the times and numbers of calls of the cuts,
+     * the fillers, the formula evaluations (with the cache hit rates), the reweighting, the input, and the
+     * file switches, as well as the compressed bytes of the baskets read per branch, and writes the sums and
+     * the per-thread records to path (see Profiler). Fillers and formulas are timed in one entry out of
+     * sampling. The profile is not recorded under process multiplexing (see setProcessMultiplexing).
+     */
+    void setProfileOutput(char const* path, unsigned sampling = 16) { profileOutput_ = path; profileSampling_ = sampling; }
+
+    //! Compile the expressions into native code.
+    /*
+     * If true, the formulas of cuts, plots, reweights, and aliases are translated into C++ and compiled with
+     * the system compiler before the event loop, where the expression is simple enough (see FormulaCompiler).
+     * Compiled libraries are cached in cacheDir (default: $MULTIDRAW_JIT_CACHE or a directory under the system
+     * temporary directory) and reused by later jobs with the same expressions.
+     */
+    void setCompileFormulas(bool c, char const* cacheDir = "") { doCompileFormulas_ = c; formulaCacheDir_ = cacheDir; }
+
+    //! Evaluate common subexpressions once per event.
+    /*
+     * If true, the formulas of each drawer are parsed into a graph of shared subexpressions before the event
+     * loop (see ExprGraph), so that leaves and subexpressions appearing in several cuts, plots, reweights, and
+     * aliases (e.g. "ptll>30" in "mll>12 && ptll>30" and in "mll*(ptll>30)") are evaluated only once per
+     * event. Formulas outside of the supported syntax and compiled formulas (setCompileFormulas) are not
+     * affected.
+     */
+    void setShareSubexpressions(bool s) { doShareSubexpressions_ = s; }
+
+    //! Disable the input branches that are not used.
+    /*
+     * If true (default false), execute() collects the branches read by all compiled expressions (including
+     * array indices, aliases, Alt$, MinIf$, MaxIf$, and TCutG subformulas), functions, and the weight and
+     * event number branches, and disables all other branches of the input chain and its friends. The read
+     * cache is then trained on exactly the used branches (see also setPrefetch).
+     * TTreeFunctions reading the tree through multidraw::currentTree must declare those branches with
+     * getExtraBranchNames(); other code reading it directly is not supported.
+     */
+    void setPruneBranches(bool p) { doPruneBranches_ = p; }
+
+    //! Prefetch the input baskets.
+    /*
+     * If cacheSize > 0 (bytes), the input chain of each thread gets a TTreeCache of cacheSize divided by the
+     * number of threads, holding only the branches read by the compiled expressions and the weight / event
+     * number branches, so the baskets of a cluster are read in one vectored request without a learning phase.
+     * If async = true, the next block is read by ROOT's prefetching thread (TFile.AsyncPrefetching) while the
+     * current one is processed. If parallelUnzip = true, baskets are decompressed in a TTreeCacheUnzip thread
+     * pool. Friend trees get a cache of the same size. cacheSize = 0 (default) keeps the ROOT defaults.
+     */
+    void setPrefetch(long long cacheSize, bool async = true, bool parallelUnzip = true) { prefetchCacheSize_ = cacheSize; doAsyncPrefetch_ = async; doParallelUnzip_ = parallelUnzip; }
+
+    //! Use a sidecar index of the input files.
+    /*
+     * The index (see InputIndex) records the numbers of entries and the cluster boundaries of the input files
+     * together with their sizes and modification times. When set, execute() builds the input chain with known
+     * numbers of entries and splits the input over threads and processes without opening the files. Files
+     * missing from the index or modified since are scanned once and added to the index.
+     */
+    void setInputIndex(char const* path) { inputIndexPath_ = path; }
+
+    //! Cache the filter and cut results of each input file in directory.
+    /*
+     * When set, execute() records for each input file the entries passing the filter and the category indices
+     * of the filter and the cuts (see CutCache). A later execute() with the same tree name, filter, cuts,
+     * categories, aliases, good run list, prescale, branch replacements, and friend trees skips the entries
+     * rejected by the filter before reading any branch, and takes the cut results from the record instead of
+     * evaluating the cut expressions. Plots and reweights can change freely between the runs. Files are
+     * recorded only if all of their entries are processed in the job. Aliases defined by TTreeFunctions are
+     * identified by the function name and TTreeFunction::getConfig(); the cache is not used if any of the
+     * functions returns no configuration. Not used with systematic variations.
+     */
+    void setCutCache(char const* directory) { cutCacheDir_ = directory; }
+
+    //! Store the values of the aliases per input file and entry in directory.
+    /*
+     * When set, execute() records the values of the aliases of the nominal drawer and of the variations in
+     * sidecar files (see AliasCache). A later execute() reads the values of the entries found there instead
+     * of evaluating the alias expressions. Values are looked up by the input file (path and UUID), the local
+     * entry number, and a hash of the alias definition. The hash covers the tree name, the friend trees, the
+     * branch replacements, and the definitions of the alias and of all aliases declared before it (and for
+     * variations, all nominal aliases). Aliases defined by TTreeFunctions are identified by the function name
+     * and TTreeFunction::getConfig(); if a function returns no configuration, its alias and all aliases
+     * declared after it are not cached.
+     */
+    void setAliasCache(char const* directory) { aliasCacheDir_ = directory; }
+
     //! Abort if there is a read error.
     /*
      * By default, TChain skips files that cannot be opened or data blocks that cannot be read. When this
@@ -241,32 +400,69 @@ namespace multidraw {
 
     Plot1DFiller& addPlot_(TH1* hist, CompiledExprSource const& source, char const* cutName, char const* reweight, Plot1DFiller::OverflowMode mode);
     Plot2DFiller& addPlot2D_(TH2* hist, CompiledExprSource const& xsource, CompiledExprSource const& ysource, char const* cutName, char const* reweight);
+    Plot1DFiller& addPlotVariations_(TObjArray* histlist, CompiledExprSource const& source, char const* cutName, char const* reweight, Plot1DFiller::OverflowMode mode);
+    Plot2DFiller& addPlotVariations2D_(TObjArray* histlist, CompiledExprSource const& xsource, CompiledExprSource const& ysource, char const* cutName, char const* reweight);
     Plot1DFiller& addPlotList_(TObjArray* histlist, CompiledExprSource const& source, char const* cutName, char const* reweight, Plot1DFiller::OverflowMode mode);
     Plot2DFiller& addPlotList2D_(TObjArray* histlist, CompiledExprSource const& xsource, CompiledExprSource const& ysource, char const* cutName, char const* reweight);
     
+    //! Work queues for dynamic scheduling (defined in MultiDraw.cc)
+    struct EntryRangeQueues;
+    //! Per-thread state of the nominal drawer or a variation in executeOne_ (defined in MultiDraw.cc)
+    struct ThreadDrawer;
+
     struct SynchTools {
       std::thread::id mainThread;
       std::mutex mutex;
       std::condition_variable condition;
       bool mainDone{false};
       std::atomic_ullong totalEvents{0};
+      EntryRangeQueues* rangeQueues{nullptr};
     };
 
+    //! Build the work queues from the cluster structure of the input files.
+    /*
+     * Returns nullptr if dynamic scheduling is not possible (e.g. a file could not be opened), in which case
+     * the caller should fall back to static scheduling.
+     */
+    std::unique_ptr<EntryRangeQueues> makeEntryRangeQueues_(std::vector<TString> const& fileNames, long nEntries, unsigned long firstEntry) const;
+
+    //! Read the cluster boundaries (last element = number of entries) of the files, from the input index if set.
+    /*
+     * Files not in the index are opened in parallel. Returns false if any of the files could not be read.
+     */
+    bool readClusterBoundaries_(std::vector<TString> const& fileNames, std::vector<std::vector<Long64_t>>& boundaries) const;
+
+    //! Cuts evaluated in the event loop, in the order of executeOne_ (the filter not included)
+    std::vector<Cut const*> activeCuts_() const;
+    //! String identifying the configuration determining the cut results; empty if not identified (see setCutCache)
+    TString cutCacheKey_() const;
+    //! Hashes identifying the definitions of the aliases, in the order of aliases_; empty if not identified (see setAliasCache)
+    std::vector<TString> aliasCacheKeys_(char const* parentKey = "") const;
+
+    //! Process the input in forked worker processes (see setProcessMultiplexing). Returns the number of events.
+    /*
+     * attachFriends is called on the input chain in each process after the fork.
+     */
+    long executeForked_(long nEntries, unsigned long firstEntry, TChain&, SynchTools&, std::function<void(TChain&)> const& attachFriends);
+
     //! Core of the execute function
     /*
       treeNumberOffset: The offset of the given tree with respect to the original
       byTree: If true, nEntries refers to file numbers in the given tree, not events
+      queueIndex: If non-negative, entry ranges are pulled from synchTools.rangeQueues with this index
+        once the initial range given by nEntries and firstEntry is exhausted
      */
 #if ROOT_VERSION_CODE < ROOT_VERSION(6,12,0)
-    long executeOne_(long nEntries, unsigned long firstEntry, TChain&, SynchTools&, unsigned treeNumberOffset = 0, Long64_t* treeOffsets = nullptr, bool byTree = false);
+    long executeOne_(long nEntries, unsigned long firstEntry, TChain&, SynchTools&, unsigned treeNumberOffset = 0, Long64_t* treeOffsets = nullptr, bool byTree = false, int queueIndex = -1);
 #else
-    long executeOne_(long nEntries, unsigned long firstEntry, TChain&, SynchTools&, unsigned treeNumberOffset = 0, bool byTree = false);
+    long executeOne_(long nEntries, unsigned long firstEntry, TChain&, SynchTools&, unsigned treeNumberOffset = 0, bool byTree = false, int queueIndex = -1);
 #endif
 
     TString treeName_{"events"};
     std::vector<TString> inputPaths_{};
 
     std::vector<std::tuple<TString, TObjArray, TString>> friendTrees_{};
+    std::map<TString, std::pair<TString, TString>> friendIndices_{};
 
     TEntryList* entryList_{nullptr};
 
@@ -277,6 +473,8 @@ namespace multidraw {
     TString evtNumBranchName_{""};
 
     unsigned inputMultiplexing_{1};
+    unsigned processMultiplexing_{1};
+    SchedulingMode schedulingMode_{kStatic};
     unsigned prescale_{1};
 
     CutPtr filter_{};
@@ -289,10 +487,27 @@ namespace multidraw {
     std::map<unsigned, std::pair<ReweightSourcePtr, bool>> treeReweightSources_{};
 
     std::list<std::pair<TString, TString>> branchReplacements_{};
+    std::vector<std::pair<TString, std::unique_ptr<MultiDraw>>> variations_{};
 
     int printLevel_{0};
     bool doTimeProfile_{false};
     bool doAbortOnReadError_{false};
+    bool doCompileFormulas_{false};
+    TString formulaCacheDir_{""};
+    bool doShareSubexpressions_{false};
+    bool doPruneBranches_{false};
+    long long prefetchCacheSize_{0};
+    bool doAsyncPrefetch_{false};
+    bool doParallelUnzip_{false};
+    TString inputIndexPath_{""};
+    TString cutCacheDir_{""};
+    TString aliasCacheDir_{""};
+    TString profileOutput_{""};
+    unsigned profileSampling_{16};
+
+    std::unique_ptr<Profiler> profiler_{};
+    std::unique_ptr<CutCache> cutCache_{};
+    std::unique_ptr<AliasCache> aliasCache_{};
 
     long long totalEvents_{0};
   };
@@ -44,8 +44,12 @@ namespace multidraw {
     void doFill_(unsigned, int icat = -1) override;
     ExprFiller* clone_() override;
     void mergeBack_() override;
+    void initialize_() override;
 
     OverflowMode overflowMode_{kDefault};
+    //! Per category: x above the threshold is replaced by the value (set in initialize_)
+    std::vector<double> overflowThresholds_{};
+    std::vector<double> overflowValues_{};
   };
 
 }
@@ -36,6 +36,7 @@ namespace multidraw {
     void doFill_(unsigned, int icat = -1) override;
     ExprFiller* clone_() override;
     void mergeBack_() override;
+    void initialize_() override;
   };
 
 }
@@ -0,0 +1,140 @@
+#ifndef multidraw_Profiler_h
+#define multidraw_Profiler_h
+
+#include "TTreeFormulaCached.h"
+
+#include "TString.h"
+
+#include <vector>
+#include <map>
+#include <set>
+#include <chrono>
+#include <mutex>
+
+class TBranch;
+
+namespace multidraw {
+
+  class FormulaLibrary;
+
+  //! Accumulated execution time and number of calls of a profiled section.
+  /*!
+   * For sections timed only in the sampled entries (see Profiler), timed is the number of timed calls and
+   * millisec() extrapolates their time to all calls. timed = 0 means that every call is timed.
+   */
+  struct ProfileCounter {
+    std::chrono::steady_clock::duration time{std::chrono::steady_clock::duration::zero()};
+    unsigned long long calls{0};
+    unsigned long long timed{0};
+
+    double millisec() const;
+    ProfileCounter& operator+=(ProfileCounter const&);
+  };
+
+  //! Execution profile of the event loop.
+  /*!
+   * Each thread of MultiDraw::executeOne_ fills a ThreadProfile and hands it to addThread() at the end of its
+   * event loop; writeJSON() writes the per-thread records together with the sums over the threads.
+   * Cut evaluation, reweighting, input and file opening are timed in every entry. Fillers and formula
+   * evaluations are counted in every entry but timed only in one entry out of sampling, to keep the clock
+   * reads out of the innermost loops. The thread-local sampling flag (setSampling) is switched by the event
+   * loop and read by Cut::fillExprs and TTreeFormulaCached::EvalInstance.
+   */
+  class Profiler {
+  public:
+    struct FillerProfile {
+      TString name{};
+      ProfileCounter counter{};
+    };
+
+    struct CutProfile {
+      TString variation{};
+      TString name{};
+      //! Time of evaluate() and fillExprs(); calls = number of evaluations
+      ProfileCounter counter{};
+      unsigned long long passed{0};
+      std::vector<FillerProfile> fillers{};
+    };
+
+    struct FormulaProfile {
+      //! Number of EvalInstance calls
+      unsigned long long calls{0};
+      //! Evaluations not served by the cache
+      ProfileCounter evaluations{};
+    };
+
+    struct ThreadProfile {
+      bool mainThread{false};
+      long long entries{0};
+      //! LoadTree calls that opened a new file
+      ProfileCounter open{};
+      //! Updates of the formulas and branch addresses after a new file was opened
+      ProfileCounter treeSwitch{};
+      ProfileCounter input{};
+      ProfileCounter aliases{};
+      ProfileCounter reweight{};
+      std::vector<CutProfile> cuts{};
+      std::map<TString, FormulaProfile> formulas{};
+      //! Compressed size of the baskets spanning the processed entries, per top-level branch
+      std::map<TString, Long64_t> branchBytes{};
+
+      //! Add the counters of the formula caches of the library
+      /*!
+       * Caches shared among libraries (variations share the caches of the unvaried expressions with the
+       * nominal library) are added only once per thread profile.
+       */
+      void addFormulas(FormulaLibrary const&);
+
+      //! Take the basket layout of the named branches (and their sub-branches) of a newly opened file
+      /*!
+       * The layout is copied because the file is closed by the time the next one is opened.
+       */
+      void openFile(std::vector<std::pair<TString, TBranch*>> const&);
+      //! Record a processed entry of the current file
+      void addEntry(Long64_t localEntry)
+      {
+        if (fileFirst_ < 0 || localEntry < fileFirst_)
+          fileFirst_ = localEntry;
+        if (localEntry > fileLast_)
+          fileLast_ = localEntry;
+      }
+      //! Add the bytes of the baskets overlapping the range of the recorded entries to branchBytes
+      void closeFile();
+
+    private:
+      struct Basket {
+        Long64_t first;
+        Long64_t last;
+        Long64_t bytes;
+      };
+
+      std::vector<std::pair<TString, std::vector<Basket>>> fileBaskets_{};
+      std::set<TTreeFormulaCached::Cache const*> addedCaches_{};
+      Long64_t fileFirst_{-1};
+      Long64_t fileLast_{-1};
+    };
+
+    Profiler(unsigned sampling) : sampling_(sampling == 0 ? 1 : sampling) {}
+
+    //! One entry out of sampling is timed in detail
+    unsigned getSampling() const { return sampling_; }
+
+    //! Add the profile of a thread. Thread safe.
+    void addThread(ThreadProfile&&);
+
+    //! Write the profile in JSON format. Formulas and branches are sorted by decreasing cost.
+    void writeJSON(char const* path) const;
+
+    //! Switch the detailed timing of the current entry in this thread
+    static void setSampling(bool);
+    static bool isSampling();
+
+  private:
+    unsigned sampling_;
+    std::mutex mutex_{};
+    std::vector<ThreadProfile> threads_{};
+  };
+
+}
+
+#endif
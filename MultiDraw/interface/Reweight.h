@@ -3,23 +3,31 @@
 
 #include "TTreeFormulaCached.h"
 #include "CompiledExpr.h"
+#include "HistogramLookup.h"
+#include "GraphInterpolator.h"
 
 #include "TH1.h"
 #include "TGraph.h"
 #include "TF1.h"
-#include "TSpline.h"
 
 #include <functional>
 
-class TSpline3;
-
 namespace multidraw {
 
+  //! Read-only representations of a reweight source, shared by the Reweights of all threads
+  struct ReweightSnapshot {
+    HistogramLookupPtr histogram{};
+    GraphInterpolatorPtr graph{};
+    //! Values outside the range of a histogram source take the edge bins
+    bool clampOverflow{false};
+  };
+
   class Reweight {
   public:
     Reweight() {}
-    Reweight(CompiledExprPtr&&, TObject const* = nullptr);
-    Reweight(CompiledExprPtr&&, CompiledExprPtr&&, TObject const*);
+    //! Missing parts of the snapshot are created from the source.
+    Reweight(CompiledExprPtr&&, TObject const* = nullptr, ReweightSnapshot const& = ReweightSnapshot());
+    Reweight(CompiledExprPtr&&, CompiledExprPtr&&, TObject const*, ReweightSnapshot const& = ReweightSnapshot());
     virtual ~Reweight() {}
 
     virtual unsigned getNdim() const { return exprs_.size(); }
@@ -40,7 +48,7 @@ namespace multidraw {
     //! One entry per source dimension
     std::vector<CompiledExprPtr> exprs_{};
     TObject const* source_{nullptr};
-    std::unique_ptr<TSpline3> spline_{};
+    ReweightSnapshot snapshot_{};
 
     std::function<double(unsigned)> evaluate_{};
   };
@@ -70,20 +78,30 @@ namespace multidraw {
   public:
     ReweightSource() {}
     ReweightSource(ReweightSource const&);
-    ReweightSource(char const* expr, TObject const* source = nullptr) : exprs_{{expr}}, source_(source) {}
-    ReweightSource(char const* xexpr, char const* yexpr, TObject const* source = nullptr) : exprs_{{xexpr, yexpr}}, source_(source) {}
-    ReweightSource(CompiledExprSource const& xexpr, TObject const* source = nullptr) : exprs_{{xexpr}}, source_(source) {}
-    ReweightSource(CompiledExprSource const& xexpr, CompiledExprSource const& yexpr, TObject const* source = nullptr) : exprs_{{xexpr, yexpr}}, source_(source) {}    
+    ReweightSource(char const* expr, TObject const* source = nullptr) : exprs_{{expr}}, source_(source) { makeSnapshot_(); }
+    ReweightSource(char const* xexpr, char const* yexpr, TObject const* source = nullptr) : exprs_{{xexpr, yexpr}}, source_(source) { makeSnapshot_(); }
+    ReweightSource(CompiledExprSource const& xexpr, TObject const* source = nullptr) : exprs_{{xexpr}}, source_(source) { makeSnapshot_(); }
+    ReweightSource(CompiledExprSource const& xexpr, CompiledExprSource const& yexpr, TObject const* source = nullptr) : exprs_{{xexpr, yexpr}}, source_(source) { makeSnapshot_(); }
     ReweightSource(ReweightSource const& r1, ReweightSource const& r2) {
       subReweights_[0] = std::make_unique<ReweightSource>(r1);
       subReweights_[1] = std::make_unique<ReweightSource>(r2);
     }
 
+    //! Use the first and last bins of a histogram source for values outside its range (default: under/overflow bin contents).
+    void setClampOverflow(bool c);
+    //! Interpolation of a graph source (default: GraphInterpolator::kCubic, equivalent to TSpline3).
+    void setInterpolation(GraphInterpolator::Mode);
+
     ReweightPtr compile(FormulaLibrary&, FunctionLibrary&) const;
 
   private:
+    //! Snapshot a histogram source; the source is not read after this point.
+    void makeSnapshot_();
+
     std::vector<CompiledExprSource> exprs_{};
     TObject const* source_{nullptr};
+    GraphInterpolator::Mode interpolation_{GraphInterpolator::kCubic};
+    ReweightSnapshot snapshot_{};
 
     std::array<std::unique_ptr<ReweightSource>, 2> subReweights_;
   };
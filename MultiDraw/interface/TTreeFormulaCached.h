@@ -7,6 +7,12 @@
 #include <utility>
 #include <memory>
 
+class TLeaf;
+
+namespace multidraw {
+  class ExprGraph;
+}
+
 //! Cached version of TTreeFormula.
 /*!
  * Only the expression values are cached. GetNdata() must be called before calls to EvalInstance.
@@ -17,10 +23,29 @@ class TTreeFormulaCached : public TTreeFormula {
 public:
   struct Cache {
     std::vector<std::pair<Bool_t, Double_t>> fValues{};
+
+    // Profile counters (see multidraw::Profiler), updated only if fProfile is true
+    Bool_t fProfile{kFALSE};
+    ULong64_t fNCalls{0}; // EvalInstance calls
+    ULong64_t fNEvaluations{0}; // calls not served by the cached values
+    ULong64_t fNTimed{0}; // evaluations in the sampled entries
+    Long64_t fTimedNanosec{0};
   };
 
   typedef std::shared_ptr<Cache> CachePtr;
 
+  //! Signature of natively compiled expressions (see multidraw::FormulaCompiler).
+  /*!
+   * Arguments are the value pointers and the current lengths of the leaves listed in the CompiledLeaf vector.
+   */
+  typedef Double_t (*CompiledFunction)(void const* const*, UInt_t const*);
+
+  struct CompiledLeaf {
+    Int_t fCode{-1}; // index in fLeaves
+    TString fType{}; // C type name of the leaf, as returned by GetLeafCType
+    Bool_t fScalar{kFALSE}; // leaf is referenced without an index and must stay a scalar
+  };
+
   TTreeFormulaCached(char const* name, char const* formula, TTree* tree, CachePtr const&);
   TTreeFormulaCached(char const* name, char const* formula, TTree* tree);
   TTreeFormulaCached(TTreeFormulaCached const&);
@@ -32,16 +57,55 @@ public:
   Double_t EvalInstance(Int_t, char const* [] = nullptr)/* override*/;
 
   CachePtr const& GetCache() const { return fCache; }
+  void SetCache(CachePtr const& cache) { fCache = cache; }
 
   TObjArray const* GetListOfLeaves() const { return &fLeaves; }
 
   bool ReplaceLeaf(TString const& from, TString const& to);
 
+  //! Append the leaves read by the formula and its subformulas (indices, aliases, Alt$, MinIf$, MaxIf$, TCutG).
+  void CollectLeaves(std::vector<TLeaf*>&) const;
+
+  void UpdateFormulaLeaves()/* override*/;
+
+  //! Evaluate the formula with a compiled function instead of the TTreeFormula interpreter.
+  /*!
+   * GetNdata() still goes through TTreeFormula, which therefore continues to determine the multiplicity.
+   * The function is dropped (and the formula is interpreted again) if any of the leaves is replaced by one
+   * with a different type, e.g. after ReplaceLeaf or when the tree changes.
+   */
+  void SetCompiledFunction(CompiledFunction, std::vector<CompiledLeaf> const&);
+  Bool_t IsCompiled() const { return fCompiled != nullptr; }
+
+  //! Evaluate the formula as a node of a graph of shared subexpressions instead of the TTreeFormula interpreter.
+  /*!
+   * As with compiled functions, GetNdata() still goes through TTreeFormula. A compiled function takes
+   * precedence. Pass nullptr to go back to interpretation.
+   */
+  void SetGraphNode(multidraw::ExprGraph* graph, UInt_t node = 0) { fGraph = graph; fGraphNode = node; }
+  Bool_t IsInGraph() const { return fGraph != nullptr; }
+
+  //! C type name used by the compiled functions to read the leaf; nullptr if the leaf type is not supported.
+  static char const* GetLeafCType(TLeaf const*);
+
 private:
   void ConvertSubformulas();
+  void CheckCompiledLeaves();
+  Double_t EvalCompiled();
+  Double_t EvalProfiled(Int_t, char const* []);
+  //! Uncached evaluation with the compiled function, the graph, or the interpreter
+  Double_t EvalUncached(Int_t, char const* []);
 
   CachePtr fCache{};
 
+  CompiledFunction fCompiled{nullptr}; //!
+  std::vector<CompiledLeaf> fCompiledLeaves{}; //!
+  std::vector<void const*> fCompiledValues{}; //!
+  std::vector<UInt_t> fCompiledLengths{}; //!
+
+  multidraw::ExprGraph* fGraph{nullptr}; //!
+  UInt_t fGraphNode{0}; //!
+
   ClassDef(TTreeFormulaCached, 1)
 };
 
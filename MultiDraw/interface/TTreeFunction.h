@@ -1,7 +1,10 @@
 #ifndef multidraw_TTreeFunction_h
 #define multidraw_TTreeFunction_h
 
+#include "TString.h"
+
 #include <memory>
+#include <vector>
 
 namespace multidraw {
 
@@ -14,6 +17,14 @@ namespace multidraw {
 
     virtual char const* getName() const = 0;
     virtual TTreeFunction* clone() const = 0;
+
+    //! String identifying the computation together with the name (e.g. a version and the parameter values).
+    /*!
+     * Part of the keys of the alias and cut caches (MultiDraw::setAliasCache, setCutCache); change it
+     * whenever the results change. The default nullptr means the results cannot be identified, and aliases
+     * defined by the function are not cached.
+     */
+    virtual char const* getConfig() const { return nullptr; }
     
     std::unique_ptr<TTreeFunction> linkedCopy(FunctionLibrary&) const;
 
@@ -24,11 +35,34 @@ namespace multidraw {
     virtual unsigned getNdata() = 0;
     virtual double evaluate(unsigned) = 0;
 
+    //! Batch interface: write the values of all getNdata() instances to out.
+    /*!
+     * Functions computing all instances in a single loop (e.g. over the jets of the event) should override
+     * this method and hasEvaluateAll(). CompiledExpr then calls evaluateAll() once per event and serves
+     * evaluate(i) from the stored values. The default implementation calls evaluate() for each instance.
+     */
+    virtual void evaluateAll(double* out);
+    virtual bool hasEvaluateAll() const { return false; }
+
+    //! Branches read other than through bindBranch and the column views (e.g. through multidraw::currentTree).
+    /*!
+     * Functions reading the tree directly must list the branches here, or they are disabled when
+     * MultiDraw::setPruneBranches is on.
+     */
+    virtual std::vector<TString> getExtraBranchNames() const { return {}; }
+
+    //! Values of all instances in the current event, computed with evaluateAll() on the first call in the event.
+    std::vector<double> const& getValues();
+    //! Forget the values of the previous event. Called by FunctionLibrary::setEntry.
+    void resetValues() { valuesValid_ = false; }
+
   protected:
     virtual void bindTree_(FunctionLibrary&) = 0;
 
   private:
     bool linked_{false};
+    std::vector<double> values_{};
+    bool valuesValid_{false};
   };
 
   typedef std::unique_ptr<TTreeFunction> TTreeFunctionPtr;
@@ -4,6 +4,10 @@
 #include "ExprFiller.h"
 
 #include "TTree.h"
+#include "TFile.h"
+
+#include <deque>
+#include <memory>
 
 namespace multidraw {
 
@@ -14,33 +18,133 @@ namespace multidraw {
    *  tree      The actual tree object (the user is responsible to create it)
    *  library   FormulaLibrary to draw formula objects from
    *  reweight  If provided, evalutaed and used as weight for filling the histogram
+   *
+   * Scalar branches (addBranch) hold the value of the expression at the filled instance. Array branches
+   * (addArrayBranch) hold all instances of the expression in the event, with the size written to a count
+   * branch; the values are evaluated directly into the branch buffer. There is no limit on the number of
+   * branches.
+   *
+   * In the default fill mode kInstance, one tree entry is written per instance passing the cut. In mode
+   * kEvent, one entry is written per event passing the cut, with the scalar branches, the weight, and the
+   * category taken from the first passing instance.
    */
   class TreeFiller : public ExprFiller {
   public:
+    enum BranchType {
+      kDouble,
+      kFloat,
+      kInt,
+      kBool,
+      nBranchTypes
+    };
+
+    enum FillMode {
+      kInstance,
+      kEvent
+    };
+
     TreeFiller(TTree& tree, char const* reweight = "");
     TreeFiller(TObjArray& treelist, char const* reweight = "");
     TreeFiller(TreeFiller const&);
     ~TreeFiller();
 
+    //! Add a scalar branch of type double.
+    /*!
+     * If the tree already has a branch with the name, it is filled by this filler if rebind is true.
+     * Otherwise an exception is thrown.
+     */
     void addBranch(char const* bname, char const* expr, bool rebind = false);
+    //! Add a scalar branch of the given type. Values are converted from double.
+    void addBranch(char const* bname, char const* expr, BranchType type, bool rebind = false);
+    void addBranch(char const* bname, TTreeFunction const& func, BranchType type = kDouble, bool rebind = false);
+
+    //! Add a variable-length array branch holding all instances of the expression in the event.
+    /*!
+     * The array size is written to the Int_t branch countName, which is created with the first array branch
+     * using it. Array branches sharing a count branch must have the same number of instances in every event.
+     */
+    void addArrayBranch(char const* bname, char const* expr, char const* countName, BranchType type = kDouble, bool rebind = false);
+    void addArrayBranch(char const* bname, TTreeFunction const& func, char const* countName, BranchType type = kDouble, bool rebind = false);
+
+    void setFillMode(FillMode m) { firstPassOnly_ = (m == kEvent); }
+    FillMode getFillMode() const { return firstPassOnly_ ? kEvent : kInstance; }
+
+    //! Stream the trees of the thread clones to temporary files in dir.
+    /*!
+     * By default, each thread fills an in-memory tree, which is merged into the tree at the end of the event
+     * loop. With a streaming directory, each thread clone writes its trees to its own temporary file instead.
+     * Baskets are compressed and written by the filling thread whenever the tree auto-flushes, so memory use
+     * stays bounded and compression runs in parallel. At the end of execute(), the temporary trees are appended
+     * basket by basket without decompression if the tree is attached to a file (entry by entry otherwise), and
+     * the temporary files are deleted. Empty string (default) disables streaming.
+     */
+    void setStreamingDirectory(char const* dir) { streamingDirectory_ = dir; }
+    TString const& getStreamingDirectory() const { return streamingDirectory_; }
 
     TTree const& getTree(int icat = -1) const { return static_cast<TTree const&>(getObj(icat)); }
     TTree& getTree(int icat = -1) { return static_cast<TTree&>(getObj(icat)); }
 
-    unsigned getNdim() const override { return bvalues_.size(); }
-
-    static unsigned const NBRANCHMAX = 128;
+    unsigned getNdim() const override { return sources_.size(); }
+    unsigned getNArrays() const { return arraySources_.size(); }
 
   private:
+    //! Output buffer of a branch. Addresses of Branch and Count objects are stable (held in deques).
+    struct Branch {
+      TString name{};
+      BranchType type{kDouble};
+      //! Index in counts_ for array branches, -1 for scalars
+      int count{-1};
+      //! Values in the branch type; array branches grow this buffer and rebind the address as needed
+      std::vector<Double_t> buffer{};
+    };
+
+    struct Count {
+      TString name{};
+      Int_t n{0};
+      //! Set by the first array branch filled in the current entry
+      bool filled{false};
+    };
+
     TreeFiller(TTree& tree, TreeFiller const&);
     TreeFiller(TObjArray& treelist, TreeFiller const&);
 
+    void addBranch_(char const* bname, CompiledExprSource const&, BranchType, char const* countName, bool rebind);
+    //! Create (if missing) or rebind the weight, count, and value branches of a tree
+    void setupTree_(TTree&);
+    //! Create or rebind one branch; throws if the branch exists and rebind is false
+    void setupBranch_(TTree&, TString const& name, void* address, TString const& leaflist, bool rebind);
+    //! Leaf list of the branch (name/T or name[count]/T)
+    TString leaflist_(Branch const&) const;
+    //! Evaluate an array branch into its buffer; rebinds the branch address if the buffer was reallocated
+    void fillArray_(Branch&, CompiledExpr&);
+    //! Grow the array buffers to hold the largest arrays of the tree (before copying its entries through them)
+    void reserveArrays_(TTree&);
+    //! Rebind the address of a branch in all trees
+    void setAddress_(Branch&);
+    //! Append the entries of a tree read from a streaming file
+    void appendStreamed_(TTree& target, TTree& source);
+
     void doFill_(unsigned, int icat = -1) override;
     ExprFiller* clone_() override;
     void mergeBack_() override;
+    void bindTree_(FormulaLibrary&, FunctionLibrary&) override;
+    void finalize_() override;
+
+    std::deque<Branch> branches_{};
+    std::deque<Count> counts_{};
+    //! Indices in branches_ of the scalar branches (in the order of sources_) and of the array branches
+    std::vector<unsigned> scalarBranches_{};
+    std::vector<unsigned> arrayBranches_{};
+    std::vector<CompiledExprSource> arraySources_{};
+    std::vector<CompiledExprPtr> arrayExprs_{};
+    //! Conversion buffer for arrays of types other than double
+    std::vector<double> arrayValues_{};
 
-    std::vector<double> bvalues_{};
-    std::vector<TString> bnames_{};
+    TString streamingDirectory_{};
+    //! Temporary file of a thread clone
+    std::unique_ptr<TFile> streamingFile_{};
+    //! Temporary files written by the thread clones (main-thread filler)
+    std::vector<TString> streamedFiles_{};
   };
 
 }
@@ -0,0 +1,221 @@
+#include "../interface/AliasCache.h"
+
+#include "TSystem.h"
+#include "TFile.h"
+#include "TKey.h"
+#include "TNamed.h"
+#include "TMD5.h"
+
+#include <algorithm>
+#include <cstring>
+#include <tuple>
+
+double const*
+multidraw::AliasCache::Column::find(Long64_t _entry, unsigned& _n) const
+{
+  auto eItr(std::lower_bound(entries.begin(), entries.end(), _entry));
+  if (eItr == entries.end() || *eItr != _entry)
+    return nullptr;
+
+  unsigned iE(eItr - entries.begin());
+  _n = offsets[iE + 1] - offsets[iE];
+  return values.data() + offsets[iE];
+}
+
+void
+multidraw::AliasCache::Column::add(Long64_t _entry, double const* _values, unsigned _n)
+{
+  entries.push_back(_entry);
+  values.insert(values.end(), _values, _values + _n);
+  offsets.push_back(values.size());
+}
+
+multidraw::AliasCache::Column const*
+multidraw::AliasCache::FileRecord::getColumn(TString const& _key) const
+{
+  auto cItr(columns.find(_key));
+  if (cItr == columns.end() || cItr->second.empty())
+    return nullptr;
+
+  return &cItr->second;
+}
+
+multidraw::AliasCache::AliasCache(char const* _directory) :
+  directory_(_directory)
+{
+  gSystem->mkdir(directory_, true);
+}
+
+multidraw::AliasCache::FileRecord const*
+multidraw::AliasCache::find(char const* _path, TString const& _uuid)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  auto lItr(loaded_.find(_path));
+  if (lItr == loaded_.end())
+    lItr = loaded_.emplace(_path, load_(_path)).first;
+
+  if (lItr->second && lItr->second->uuid != _uuid)
+    return nullptr;
+
+  return lItr->second.get();
+}
+
+void
+multidraw::AliasCache::add(char const* _path, FileRecord&& _record)
+{
+  bool empty(true);
+  for (auto& keycol : _record.columns) {
+    if (!keycol.second.empty())
+      empty = false;
+  }
+  if (empty)
+    return;
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  recorded_[_path].push_back(std::move(_record));
+}
+
+unsigned
+multidraw::AliasCache::save()
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  unsigned nSaved(0);
+
+  for (auto& pr : recorded_) {
+    auto& parts(pr.second);
+    TString const& uuid(parts.front().uuid);
+
+    // Columns of the existing sidecar file are kept unless the input file changed
+    std::vector<FileRecord const*> sources;
+    auto lItr(loaded_.find(pr.first));
+    if (lItr != loaded_.end() && lItr->second && lItr->second->uuid == uuid)
+      sources.push_back(lItr->second.get());
+    for (auto& part : parts) {
+      if (part.uuid == uuid)
+        sources.push_back(&part);
+    }
+
+    std::map<TString, std::vector<Column const*>> columnSources;
+    for (auto* source : sources) {
+      for (auto& keycol : source->columns) {
+        if (!keycol.second.empty())
+          columnSources[keycol.first].push_back(&keycol.second);
+      }
+    }
+
+    TString path(cachePath_(pr.first));
+    TString tmpPath(path + TString::Format(".tmp%d", gSystem->GetPid()));
+
+    {
+      TFile file(tmpPath, "recreate");
+      if (file.IsZombie())
+        continue;
+
+      TNamed uuidObj("uuid", uuid.Data());
+      TNamed input("input", pr.first.Data());
+      file.WriteTObject(&uuidObj);
+      file.WriteTObject(&input);
+
+      for (auto& kc : columnSources) {
+        // Merge the entries of the sources in order; the first source of an entry wins
+        std::vector<std::tuple<Long64_t, unsigned, unsigned>> order;
+        for (unsigned iS(0); iS != kc.second.size(); ++iS) {
+          auto& entries(kc.second[iS]->entries);
+          for (unsigned iE(0); iE != entries.size(); ++iE)
+            order.emplace_back(entries[iE], iS, iE);
+        }
+        std::sort(order.begin(), order.end());
+
+        Column merged;
+        merged.entries.reserve(order.size());
+        merged.offsets.reserve(order.size() + 1);
+        for (auto& o : order) {
+          if (!merged.entries.empty() && merged.entries.back() == std::get<0>(o))
+            continue;
+
+          auto& source(*kc.second[std::get<1>(o)]);
+          unsigned iE(std::get<2>(o));
+          merged.add(std::get<0>(o), source.values.data() + source.offsets[iE], source.offsets[iE + 1] - source.offsets[iE]);
+        }
+
+        file.WriteObject(&merged.entries, "entries_" + kc.first);
+        file.WriteObject(&merged.offsets, "offsets_" + kc.first);
+        file.WriteObject(&merged.values, "values_" + kc.first);
+      }
+
+      file.Close();
+    }
+
+    if (gSystem->Rename(tmpPath, path) == 0)
+      ++nSaved;
+    else
+      gSystem->Unlink(tmpPath);
+  }
+
+  recorded_.clear();
+  loaded_.clear();
+
+  return nSaved;
+}
+
+TString
+multidraw::AliasCache::cachePath_(char const* _path) const
+{
+  TMD5 md5;
+  md5.Update(reinterpret_cast<UChar_t const*>(_path), std::strlen(_path));
+  md5.Final();
+
+  return directory_ + "/aliases_" + md5.AsString() + ".root";
+}
+
+std::unique_ptr<multidraw::AliasCache::FileRecord>
+multidraw::AliasCache::load_(char const* _path) const
+{
+  TString path(cachePath_(_path));
+  if (gSystem->AccessPathName(path))
+    return nullptr;
+
+  std::unique_ptr<TFile> file(TFile::Open(path));
+  if (!file || file->IsZombie())
+    return nullptr;
+
+  auto* uuid(dynamic_cast<TNamed*>(file->Get("uuid")));
+  if (uuid == nullptr)
+    return nullptr;
+
+  std::unique_ptr<FileRecord> record(new FileRecord());
+  record->uuid = uuid->GetTitle();
+
+  for (auto* obj : *file->GetListOfKeys()) {
+    TString name(obj->GetName());
+    if (!name.BeginsWith("entries_"))
+      continue;
+
+    TString key(name(8, name.Length()));
+
+    std::vector<Long64_t>* entries(nullptr);
+    std::vector<unsigned>* offsets(nullptr);
+    std::vector<double>* values(nullptr);
+    file->GetObject("entries_" + key, entries);
+    file->GetObject("offsets_" + key, offsets);
+    file->GetObject("values_" + key, values);
+    std::unique_ptr<std::vector<Long64_t>> entriesPtr(entries);
+    std::unique_ptr<std::vector<unsigned>> offsetsPtr(offsets);
+    std::unique_ptr<std::vector<double>> valuesPtr(values);
+
+    // skip inconsistent columns
+    if (entries == nullptr || offsets == nullptr || values == nullptr)
+      continue;
+    if (offsets->size() != entries->size() + 1 || offsets->back() != values->size())
+      continue;
+
+    auto& column(record->columns[key]);
+    column.entries = std::move(*entries);
+    column.offsets = std::move(*offsets);
+    column.values = std::move(*values);
+  }
+
+  return record;
+}
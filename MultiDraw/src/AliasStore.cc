@@ -0,0 +1,96 @@
+#include "../interface/AliasStore.h"
+
+#include "TTree.h"
+#include "TBranch.h"
+#include "TDirectory.h"
+#include "TObjArray.h"
+
+namespace {
+
+  //! Branch that never reads from baskets
+  /*
+   * The leaves are bound to the buffers of the store at construction (and at reallocation), so TLeaf::GetValue
+   * returns the current value without any I/O.
+   */
+  class AliasBranch : public TBranch {
+  public:
+    AliasBranch(TTree* _tree, char const* _name, void* _address, char const* _leaflist) :
+      TBranch(_tree, _name, _address, _leaflist, 1024)
+    {
+    }
+
+    Int_t GetEntry(Long64_t _entry = 0, Int_t = 0) override
+    {
+      fReadEntry = _entry;
+      return 1;
+    }
+  };
+
+}
+
+multidraw::AliasStore::AliasStore(char const* _treeName/* = "_aliases"*/)
+{
+  TDirectory::TContext context(nullptr);
+  tree_ = std::make_unique<TTree>(_treeName, "");
+  // Any entry number requested through the friend relation is valid
+  tree_->SetEntries(TTree::kMaxEntries);
+}
+
+multidraw::AliasStore::~AliasStore()
+{
+}
+
+unsigned
+multidraw::AliasStore::book(char const* _name, bool _isArray)
+{
+  entries_.emplace_back();
+  auto& entry(entries_.back());
+  entry.name = _name;
+
+  TString name(_name);
+
+  auto addBranch([this](TBranch* _branch)->TBranch* {
+      tree_->GetListOfBranches()->Add(_branch);
+      return _branch;
+    });
+
+  if (_isArray) {
+    entry.nD = 0;
+    // give some reasonable initial size
+    entry.values.resize(64);
+    entry.nbranch = addBranch(new AliasBranch(tree_.get(), "size__" + name, &entry.nD, "size__" + name + "/i"));
+    entry.vbranch = addBranch(new AliasBranch(tree_.get(), name, entry.values.data(), name + "[size__" + name + "]/D"));
+  }
+  else {
+    entry.values.resize(1);
+    entry.vbranch = addBranch(new AliasBranch(tree_.get(), name, entry.values.data(), name + "/D"));
+  }
+
+  return entries_.size() - 1;
+}
+
+int
+multidraw::AliasStore::find(char const* _name) const
+{
+  for (unsigned i(0); i != entries_.size(); ++i) {
+    if (entries_[i].name == _name)
+      return i;
+  }
+  return -1;
+}
+
+double*
+multidraw::AliasStore::resize(unsigned _i, unsigned _n)
+{
+  auto& entry(entries_[_i]);
+
+  entry.nD = _n;
+
+  if (_n > entry.values.size()) {
+    // never shrink; the buffer only grows to the largest size seen
+    entry.values.resize(_n);
+    entry.vbranch->SetAddress(entry.values.data());
+  }
+
+  return entry.values.data();
+}
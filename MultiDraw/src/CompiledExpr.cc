@@ -2,6 +2,8 @@
 #include "../interface/FormulaLibrary.h"
 #include "../interface/FunctionLibrary.h"
 
+#include <algorithm>
+
 std::unique_ptr<multidraw::CompiledExpr>
 multidraw::CompiledExprSource::compile(FormulaLibrary& _formulaLibrary, FunctionLibrary& _functionLibrary) const
 {
@@ -16,6 +18,8 @@ multidraw::CompiledExpr::CompiledExpr(TTreeFunction& _function) :
 {
   if (!function_->isLinked())
     throw std::runtime_error("Unlinked TTreeFunction used to construct CompiledExpr");
+
+  batch_ = function_->hasEvaluateAll();
 }
 
 unsigned
@@ -23,6 +27,8 @@ multidraw::CompiledExpr::getNdata()
 {
   if (formula_ != nullptr)
     return formula_->GetNdata();
+  else if (batch_)
+    return function_->getValues().size();
   else
     return function_->getNdata();
 }
@@ -32,6 +38,24 @@ multidraw::CompiledExpr::evaluate(unsigned _iD)
 {
   if (formula_ != nullptr)
     return formula_->EvalInstance(_iD);
+  else if (batch_)
+    return function_->getValues()[_iD];
   else
     return function_->evaluate(_iD);
 }
+
+void
+multidraw::CompiledExpr::evaluateAll(double* _out)
+{
+  if (formula_ != nullptr) {
+    unsigned nD(formula_->GetNdata());
+    for (unsigned iD(0); iD != nD; ++iD)
+      _out[iD] = formula_->EvalInstance(iD);
+  }
+  else if (batch_) {
+    auto& values(function_->getValues());
+    std::copy(values.begin(), values.end(), _out);
+  }
+  else
+    function_->evaluateAll(_out);
+}
@@ -77,11 +77,29 @@ multidraw::Cut::bindTree(FormulaLibrary& _formulaLibrary, FunctionLibrary& _func
     filler->bindTree(_formulaLibrary, _functionLibrary);
 }
 
+void
+multidraw::Cut::bindAtoms(CutAtomLibrary& _atoms)
+{
+  if (compiledCut_ == nullptr)
+    return;
+
+  atoms_ = &_atoms;
+  atomMask_ = _atoms.addExpression(cutExpr_, atomsComplete_);
+
+  // Categories share the formula manager with the cut; the cut formula determines the number of iterations
+  if (compiledCategorization_ != nullptr || !compiledCategories_.empty())
+    atomsComplete_ = false;
+}
+
 void
 multidraw::Cut::unlinkTree()
 {
   compiledCut_ = nullptr;
 
+  atoms_ = nullptr;
+  atomMask_ = CutAtomLibrary::Mask();
+  atomsComplete_ = false;
+
   compiledCategorization_ = nullptr;
   compiledCategories_.clear();
 
@@ -146,20 +164,19 @@ multidraw::Cut::dependsOn(TTree const& _tree) const
 void
 multidraw::Cut::initialize()
 {
-  if (compiledCut_ == nullptr)
-    return;
+  if (compiledCut_ != nullptr) {
+    // Each formula object has a default manager
+    auto* formulaManager(compiledCut_->GetManager());
+    if (compiledCategorization_ != nullptr)
+      formulaManager->Add(compiledCategorization_);
+    else {
+      for (auto* cat : compiledCategories_)
+        formulaManager->Add(cat);
+    }
 
-  // Each formula object has a default manager
-  auto* formulaManager(compiledCut_->GetManager());
-  if (compiledCategorization_ != nullptr)
-    formulaManager->Add(compiledCategorization_);
-  else {
-    for (auto* cat : compiledCategories_)
-      formulaManager->Add(cat);
+    formulaManager->Sync();
   }
 
-  formulaManager->Sync();
-
   // It's probably more correct to pass the manager to filler here and synchronize all at the same time
   // Currently Cut and ExprFiller use independent formula managers
   for (auto& filler : fillers_)
@@ -169,6 +186,24 @@ multidraw::Cut::initialize()
 bool
 multidraw::Cut::evaluate()
 {
+  if (atoms_ != nullptr) {
+    if (!atoms_->test(atomMask_)) {
+      if (printLevel_ > 2)
+        std::cout << "        " << getName() << " rejected by atom mask" << std::endl;
+
+      return false;
+    }
+
+    if (atomsComplete_) {
+      categoryIndex_.assign(1, 0);
+
+      if (printLevel_ > 2)
+        std::cout << "        " << getName() << " pass (atom mask)" << std::endl;
+
+      return true;
+    }
+  }
+
   unsigned nD(1);
   
   if (compiledCut_ != nullptr)
@@ -223,6 +258,47 @@ multidraw::Cut::fillExprs(std::vector<double> const& _eventWeights)
 {
   ++counter_;
 
+  if (!profileFillers_) {
+    for (auto& filler : fillers_)
+      filler->fill(_eventWeights, categoryIndex_);
+
+    return;
+  }
+
+  bool timed(Profiler::isSampling());
+
+  for (unsigned iF(0); iF != fillers_.size(); ++iF) {
+    auto& counter(fillerProfiles_[iF]);
+    ++counter.calls;
+
+    if (timed) {
+      auto start(std::chrono::steady_clock::now());
+      fillers_[iF]->fill(_eventWeights, categoryIndex_);
+      counter.time += std::chrono::steady_clock::now() - start;
+      ++counter.timed;
+    }
+    else
+      fillers_[iF]->fill(_eventWeights, categoryIndex_);
+  }
+}
+
+void
+multidraw::Cut::setProfileFillers(bool _p)
+{
+  profileFillers_ = _p;
+  fillerProfiles_.assign(fillers_.size(), ProfileCounter());
+}
+
+void
+multidraw::Cut::reduceExprs()
+{
+  for (auto& filler : fillers_)
+    filler->reduce();
+}
+
+void
+multidraw::Cut::finalizeExprs()
+{
   for (auto& filler : fillers_)
-    filler->fill(_eventWeights, categoryIndex_);
+    filler->finalize();
 }
@@ -0,0 +1,186 @@
+#include "../interface/CutAtomLibrary.h"
+#include "../interface/FormulaLibrary.h"
+#include "../interface/TTreeFormulaCached.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+  //! Strip whitespace and the parentheses enclosing the entire expression
+  TString
+  normalize(TString const& _expr)
+  {
+    TString expr(_expr.Strip(TString::kBoth));
+
+    while (expr.Length() >= 2 && expr[0] == '(' && expr[expr.Length() - 1] == ')') {
+      // check that the first parenthesis closes at the end
+      int depth(0);
+      int iC(0);
+      for (; iC != expr.Length(); ++iC) {
+        if (expr[iC] == '(')
+          ++depth;
+        else if (expr[iC] == ')')
+          --depth;
+
+        if (depth == 0)
+          break;
+      }
+      if (iC != expr.Length() - 1)
+        break;
+
+      expr = TString(expr(1, expr.Length() - 2)).Strip(TString::kBoth);
+    }
+
+    return expr;
+  }
+
+}
+
+/*static*/
+std::vector<TString>
+multidraw::CutAtomLibrary::split(char const* _expr)
+{
+  TString expr(normalize(_expr));
+
+  std::vector<TString> clauses;
+  if (expr.Length() == 0)
+    return clauses;
+
+  int depth(0);
+  bool inString(false);
+  int begin(0);
+  for (int iC(0); iC != expr.Length(); ++iC) {
+    char c(expr[iC]);
+    if (c == '"') {
+      inString = !inString;
+      continue;
+    }
+    if (inString)
+      continue;
+
+    if (c == '(' || c == '[')
+      ++depth;
+    else if (c == ')' || c == ']')
+      --depth;
+
+    if (depth != 0)
+      continue;
+
+    if (c == '&' && iC + 1 != expr.Length() && expr[iC + 1] == '&') {
+      clauses.emplace_back(expr(begin, iC - begin));
+      begin = iC + 2;
+      ++iC;
+    }
+    else if (c == '|' || c == '&') {
+      // Top-level || or bitwise operator: TFormula precedence between these and && is not the same as in C
+      clauses.assign(1, expr);
+      return clauses;
+    }
+    else if (c == '?' || (c == ':' && !(iC + 1 != expr.Length() && expr[iC + 1] == ':') && !(iC != 0 && expr[iC - 1] == ':'))) {
+      // Top-level ternary: the && operands belong to its branches (:: as in TMath::Abs is a scope)
+      clauses.assign(1, expr);
+      return clauses;
+    }
+  }
+
+  clauses.emplace_back(expr(begin, expr.Length() - begin));
+
+  for (auto& clause : clauses)
+    clause = normalize(clause);
+
+  return clauses;
+}
+
+multidraw::CutAtomLibrary::Mask
+multidraw::CutAtomLibrary::addExpression(char const* _expr, bool& _complete)
+{
+  Mask mask;
+  _complete = true;
+
+  for (auto& clause : split(_expr)) {
+    auto aItr(indices_.find(clause.Data()));
+    if (aItr == indices_.end()) {
+      unsigned iA(formulas_.size());
+      aItr = indices_.emplace(clause.Data(), iA).first;
+
+      auto& formula(library_.getFormula(clause));
+      formulas_.push_back(&formula);
+      scalar_.push_back(formula.GetMultiplicity() == 0);
+
+      if (evaluated_.size() * 64 < formulas_.size()) {
+        evaluated_.push_back(0);
+        values_.push_back(0);
+      }
+    }
+
+    unsigned iA(aItr->second);
+
+    if (!scalar_[iA]) {
+      _complete = false;
+      continue;
+    }
+
+    if (std::find(mask.atoms.begin(), mask.atoms.end(), iA) != mask.atoms.end())
+      continue;
+
+    mask.atoms.push_back(iA);
+
+    std::uint64_t bit(std::uint64_t(1) << (iA % 64));
+    auto wItr(std::find_if(mask.words.begin(), mask.words.end(), [iA](std::pair<unsigned, std::uint64_t> const& w) { return w.first == iA / 64; }));
+    if (wItr == mask.words.end())
+      mask.words.emplace_back(iA / 64, bit);
+    else
+      wItr->second |= bit;
+  }
+
+  if (mask.atoms.empty())
+    _complete = false;
+
+  return mask;
+}
+
+void
+multidraw::CutAtomLibrary::resetEvent()
+{
+  std::fill(evaluated_.begin(), evaluated_.end(), 0);
+}
+
+bool
+multidraw::CutAtomLibrary::test(Mask const& _mask)
+{
+  // Reject with the atoms already evaluated in this event
+  for (auto& word : _mask.words) {
+    std::uint64_t known(evaluated_[word.first] & word.second);
+    if ((values_[word.first] & known) != known)
+      return false;
+  }
+
+  for (unsigned iA : _mask.atoms) {
+    if (!evaluate_(iA))
+      return false;
+  }
+
+  return true;
+}
+
+bool
+multidraw::CutAtomLibrary::evaluate_(unsigned _iA)
+{
+  unsigned iW(_iA / 64);
+  std::uint64_t bit(std::uint64_t(1) << (_iA % 64));
+
+  if ((evaluated_[iW] & bit) != 0)
+    return (values_[iW] & bit) != 0;
+
+  auto* formula(formulas_[_iA]);
+  bool value(formula->GetNdata() != 0 && formula->EvalInstance(0) != 0.);
+
+  evaluated_[iW] |= bit;
+  if (value)
+    values_[iW] |= bit;
+  else
+    values_[iW] &= ~bit;
+
+  return value;
+}
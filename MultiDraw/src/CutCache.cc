@@ -0,0 +1,204 @@
+#include "../interface/CutCache.h"
+
+#include "TSystem.h"
+#include "TFile.h"
+#include "TNamed.h"
+#include "TMD5.h"
+
+#include <algorithm>
+#include <tuple>
+
+int const*
+multidraw::CutCache::FileRecord::find(Long64_t _entry) const
+{
+  auto eItr(std::lower_bound(entries.begin(), entries.end(), _entry));
+  if (eItr == entries.end() || *eItr != _entry)
+    return nullptr;
+
+  return data.data() + offsets[eItr - entries.begin()];
+}
+
+void
+multidraw::CutCache::FileRecord::cover(Long64_t _entry)
+{
+  if (ranges.empty() || ranges.back().second != _entry)
+    ranges.emplace_back(_entry, _entry + 1);
+  else
+    ++ranges.back().second;
+}
+
+void
+multidraw::CutCache::FileRecord::add(Long64_t _entry, std::vector<int> const& _blocks)
+{
+  entries.push_back(_entry);
+  offsets.push_back(data.size());
+  data.insert(data.end(), _blocks.begin(), _blocks.end());
+}
+
+multidraw::CutCache::CutCache(char const* _directory, char const* _key, unsigned _nBlocks) :
+  directory_(_directory),
+  key_(_key),
+  nBlocks_(_nBlocks)
+{
+  gSystem->mkdir(directory_, true);
+}
+
+multidraw::CutCache::FileRecord const*
+multidraw::CutCache::find(char const* _path, TString const& _uuid)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  auto lItr(loaded_.find(_path));
+  if (lItr == loaded_.end())
+    lItr = loaded_.emplace(_path, load_(_path, _uuid)).first;
+
+  if (lItr->second && lItr->second->uuid != _uuid)
+    return nullptr;
+
+  return lItr->second.get();
+}
+
+void
+multidraw::CutCache::add(char const* _path, FileRecord&& _record)
+{
+  if (_record.ranges.empty())
+    return;
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  recorded_[_path].push_back(std::move(_record));
+}
+
+unsigned
+multidraw::CutCache::save()
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  unsigned nSaved(0);
+
+  for (auto& pr : recorded_) {
+    auto& parts(pr.second);
+
+    // The processed ranges must cover the whole file
+    std::vector<std::pair<Long64_t, Long64_t>> ranges;
+    for (auto& part : parts)
+      ranges.insert(ranges.end(), part.ranges.begin(), part.ranges.end());
+    std::sort(ranges.begin(), ranges.end());
+
+    Long64_t covered(0);
+    for (auto& range : ranges) {
+      if (range.first > covered)
+        break;
+      covered = std::max(covered, range.second);
+    }
+    if (covered < parts.front().nEntries)
+      continue;
+
+    // Merge the entries of the parts in order
+    std::vector<std::tuple<Long64_t, unsigned, unsigned>> order;
+    for (unsigned iP(0); iP != parts.size(); ++iP) {
+      for (unsigned iE(0); iE != parts[iP].entries.size(); ++iE)
+        order.emplace_back(parts[iP].entries[iE], iP, iE);
+    }
+    std::sort(order.begin(), order.end());
+
+    std::vector<Long64_t> entries;
+    std::vector<int> data;
+    entries.reserve(order.size());
+    for (auto& o : order) {
+      auto& part(parts[std::get<1>(o)]);
+      unsigned iE(std::get<2>(o));
+      entries.push_back(std::get<0>(o));
+      unsigned end(iE + 1 == part.offsets.size() ? part.data.size() : part.offsets[iE + 1]);
+      data.insert(data.end(), part.data.begin() + part.offsets[iE], part.data.begin() + end);
+    }
+
+    TString path(cachePath_(pr.first));
+    TString tmpPath(path + TString::Format(".tmp%d", gSystem->GetPid()));
+
+    {
+      TFile file(tmpPath, "recreate");
+      if (file.IsZombie())
+        continue;
+
+      TNamed key("key", key_.Data());
+      TNamed uuid("uuid", parts.front().uuid.Data());
+      TNamed input("input", pr.first.Data());
+      file.WriteTObject(&key);
+      file.WriteTObject(&uuid);
+      file.WriteTObject(&input);
+      file.WriteObject(&entries, "entries");
+      file.WriteObject(&data, "data");
+      file.Close();
+    }
+
+    if (gSystem->Rename(tmpPath, path) == 0)
+      ++nSaved;
+    else
+      gSystem->Unlink(tmpPath);
+  }
+
+  recorded_.clear();
+
+  return nSaved;
+}
+
+TString
+multidraw::CutCache::cachePath_(char const* _path) const
+{
+  TString id(key_ + "\n" + _path);
+
+  TMD5 md5;
+  md5.Update(reinterpret_cast<UChar_t const*>(id.Data()), id.Length());
+  md5.Final();
+
+  return directory_ + "/cuts_" + md5.AsString() + ".root";
+}
+
+std::unique_ptr<multidraw::CutCache::FileRecord>
+multidraw::CutCache::load_(char const* _path, TString const& _uuid) const
+{
+  TString path(cachePath_(_path));
+  if (gSystem->AccessPathName(path))
+    return nullptr;
+
+  std::unique_ptr<TFile> file(TFile::Open(path));
+  if (!file || file->IsZombie())
+    return nullptr;
+
+  auto* key(dynamic_cast<TNamed*>(file->Get("key")));
+  auto* uuid(dynamic_cast<TNamed*>(file->Get("uuid")));
+  if (key == nullptr || uuid == nullptr || key_ != key->GetTitle() || _uuid != uuid->GetTitle())
+    return nullptr;
+
+  std::vector<Long64_t>* entries(nullptr);
+  std::vector<int>* data(nullptr);
+  file->GetObject("entries", entries);
+  file->GetObject("data", data);
+  std::unique_ptr<std::vector<Long64_t>> entriesPtr(entries);
+  std::unique_ptr<std::vector<int>> dataPtr(data);
+  if (entries == nullptr || data == nullptr)
+    return nullptr;
+
+  std::unique_ptr<FileRecord> record(new FileRecord());
+  record->uuid = _uuid;
+  record->entries = std::move(*entries);
+  record->data = std::move(*data);
+
+  // Locate the blocks of each entry
+  record->offsets.reserve(record->entries.size());
+  unsigned pos(0);
+  for (unsigned iE(0); iE != record->entries.size(); ++iE) {
+    record->offsets.push_back(pos);
+    for (unsigned iB(0); iB != nBlocks_; ++iB) {
+      if (pos >= record->data.size())
+        return nullptr;
+      int size(record->data[pos]);
+      // block = 0 or n + 1 followed by n category indices
+      pos += (size <= 0 ? 1 : size);
+    }
+  }
+  if (pos != record->data.size())
+    return nullptr;
+
+  return record;
+}
@@ -2,9 +2,12 @@
 
 #include "TTree.h"
 #include "TTreeFormulaManager.h"
+#include "TDirectory.h"
 
 #include <iostream>
 #include <cstring>
+#include <algorithm>
+#include <stdexcept>
 
 multidraw::ExprFiller::ExprFiller(TObject& _tobj, char const* _reweight/* = ""*/) :
   tobj_(_tobj)
@@ -20,7 +23,9 @@ multidraw::ExprFiller::ExprFiller(ExprFiller const& _orig) :
   tobj_(_orig.tobj_),
   sources_(_orig.sources_),
   printLevel_(_orig.printLevel_),
-  categorized_(_orig.categorized_)
+  categorized_(_orig.categorized_),
+  firstPassOnly_(_orig.firstPassOnly_),
+  variationSources_(_orig.variationSources_)
 {
   if (_orig.reweightSource_)
     reweightSource_ = std::make_unique<ReweightSource>(*_orig.reweightSource_);
@@ -30,7 +35,9 @@ multidraw::ExprFiller::ExprFiller(TObject& _tobj, ExprFiller const& _orig) :
   tobj_(_tobj),
   sources_(_orig.sources_),
   printLevel_(_orig.printLevel_),
-  categorized_(_orig.categorized_)
+  categorized_(_orig.categorized_),
+  firstPassOnly_(_orig.firstPassOnly_),
+  variationSources_(_orig.variationSources_)
 {
   if (_orig.reweightSource_)
     reweightSource_ = std::make_unique<ReweightSource>(*_orig.reweightSource_);
@@ -40,7 +47,7 @@ multidraw::ExprFiller::~ExprFiller()
 {
   unlinkTree();
 
-  if (cloneSource_ != nullptr)
+  if (cloneSource_ != nullptr && !sharedObj_)
     delete &tobj_;
 }
 
@@ -70,6 +77,15 @@ multidraw::ExprFiller::getObj(int _icat/* = -1*/)
     return tobj_;
 }
 
+void
+multidraw::ExprFiller::addVariation(ReweightSource const& _source)
+{
+  if (!categorized_)
+    throw std::runtime_error(TString::Format("%s: weight variations require a list of objects", tobj_.GetName()).Data());
+
+  variationSources_.push_back(_source);
+}
+
 void
 multidraw::ExprFiller::bindTree(FormulaLibrary& _formulaLibrary, FunctionLibrary& _functionLibrary)
 {
@@ -81,6 +97,12 @@ multidraw::ExprFiller::bindTree(FormulaLibrary& _formulaLibrary, FunctionLibrary
   if (reweightSource_)
     compiledReweight_ = reweightSource_->compile(_formulaLibrary, _functionLibrary);
 
+  for (auto& source : variationSources_)
+    variationReweights_.emplace_back(source.compile(_formulaLibrary, _functionLibrary));
+  variationFactors_.assign(variationReweights_.size(), 1.);
+
+  bindTree_(_formulaLibrary, _functionLibrary);
+
   counter_ = 0;
 }
 
@@ -89,6 +111,7 @@ multidraw::ExprFiller::unlinkTree()
 {
   compiledExprs_.clear();
   compiledReweight_ = nullptr;
+  variationReweights_.clear();
 }
 
 multidraw::ExprFillerPtr
@@ -104,6 +127,10 @@ multidraw::ExprFiller::threadClone(FormulaLibrary& _formulaLibrary, FunctionLibr
 void
 multidraw::ExprFiller::initialize()
 {
+  if (!variationSources_.empty() && static_cast<TObjArray&>(tobj_).GetEntriesFast() % variationSources_.size() != 0)
+    throw std::runtime_error(TString::Format("%s: number of objects is not a multiple of the number of weight variations", getObj(0).GetName()).Data());
+
+
   // Manage all dimensions with a single manager
   // manager instance will be owned collectively by the managed formulas (will be deleted when the last formula is deleted)
   auto* manager{new TTreeFormulaManager()};
@@ -115,13 +142,16 @@ multidraw::ExprFiller::initialize()
   }
 
   manager->Sync();
+
+  initialize_();
 }
 
 void
 multidraw::ExprFiller::fill(std::vector<double> const& _eventWeights, std::vector<int> const& _categories)
 {
   // All exprs and reweight exprs share the same manager
-  unsigned nD(compiledExprs_.at(0)->getNdata());
+  // A filler without exprs (e.g. a tree with array branches only) iterates over the cut instances
+  unsigned nD(compiledExprs_.empty() ? _categories.size() : compiledExprs_[0]->getNdata());
 
   if (printLevel_ > 3)
     std::cout << "          " << getObj().GetName() << "::fill() => " << nD << " iterations" << std::endl;
@@ -156,14 +186,146 @@ multidraw::ExprFiller::fill(std::vector<double> const& _eventWeights, std::vecto
       entryWeight_ *= compiledReweight_->evaluate(iD);
 
     doFill_(iD, _categories[iD]);
+
+    if (firstPassOnly_)
+      break;
   }
 }
 
+multidraw::HistogramBufferPtr
+multidraw::ExprFiller::makeHistBuffer_() const
+{
+  return std::make_unique<HistogramBuffer>(tobj_, categorized_, std::max(1u, unsigned(variationSources_.size())));
+}
+
+double const*
+multidraw::ExprFiller::evaluateVariations_(unsigned _iD)
+{
+  for (unsigned iV(0); iV != variationReweights_.size(); ++iV)
+    variationFactors_[iV] = variationReweights_[iV]->evaluate(_iD);
+
+  return variationFactors_.data();
+}
+
 void
 multidraw::ExprFiller::mergeBack()
 {
   if (cloneSource_ == nullptr)
     return;
 
-  mergeBack_();
+  if (sharedObj_)
+    reduce();
+  else
+    mergeBack_();
+}
+
+void
+multidraw::ExprFiller::reduce()
+{
+  if (!histBuffer_)
+    return;
+
+  if (cloneSource_ == nullptr)
+    histReducer_.reduce(std::move(histBuffer_));
+  else
+    cloneSource_->histReducer_.reduce(std::move(histBuffer_));
+}
+
+void
+multidraw::ExprFiller::finalize()
+{
+  finalize_();
+
+  auto buffer(histReducer_.release());
+  if (buffer)
+    buffer->writeTo(tobj_, categorized_);
+}
+
+unsigned
+multidraw::ExprFiller::getSharedBufferSize() const
+{
+  if (!HistogramBuffer::canBuffer(tobj_, categorized_))
+    return 0;
+
+  return makeHistBuffer_()->serializedSize();
+}
+
+void
+multidraw::ExprFiller::exportBuffer(double* _dest)
+{
+  unsigned size(getSharedBufferSize());
+  std::fill(_dest, _dest + size, 0.);
+
+  auto buffer(histReducer_.release());
+  if (buffer)
+    buffer->serialize(_dest);
+}
+
+void
+multidraw::ExprFiller::importBuffer(double const* _src)
+{
+  auto buffer(makeHistBuffer_());
+  buffer->addSerialized(_src);
+  histReducer_.reduce(std::move(buffer));
+}
+
+void
+multidraw::ExprFiller::writeObj(TDirectory& _dir, char const* _key) const
+{
+  if (categorized_) {
+    auto& array(static_cast<TObjArray const&>(tobj_));
+    for (int icat(0); icat < array.GetEntriesFast(); ++icat)
+      _dir.WriteTObject(array.UncheckedAt(icat), TString::Format("%s_%d", _key, icat));
+  }
+  else
+    _dir.WriteTObject(&tobj_, _key);
+}
+
+void
+multidraw::ExprFiller::mergeObj(TDirectory& _dir, char const* _key)
+{
+  auto merge([&_dir](TObject& _target, TString const& _key) {
+      auto* source(_dir.Get(_key));
+      if (source == nullptr)
+        throw std::runtime_error(("Object " + _key + " not found in " + _dir.GetPath()).Data());
+
+      if (_target.InheritsFrom(TH1::Class()))
+        static_cast<TH1&>(_target).Add(static_cast<TH1*>(source));
+      else if (_target.InheritsFrom(TTree::Class())) {
+        TObjArray arr;
+        arr.Add(source);
+        static_cast<TTree&>(_target).Merge(&arr);
+      }
+      else
+        throw std::runtime_error(("Do not know how to merge " + _key).Data());
+    });
+
+  if (categorized_) {
+    auto& array(static_cast<TObjArray&>(tobj_));
+    for (int icat(0); icat < array.GetEntriesFast(); ++icat)
+      merge(*array.UncheckedAt(icat), TString::Format("%s_%d", _key, icat));
+  }
+  else
+    merge(tobj_, _key);
+}
+
+void
+multidraw::ExprFiller::resetObj()
+{
+  auto reset([](TObject& _target) {
+      if (_target.InheritsFrom(TH1::Class()))
+        static_cast<TH1&>(_target).Reset();
+      else if (_target.InheritsFrom(TTree::Class()))
+        static_cast<TTree&>(_target).Reset();
+      else
+        throw std::runtime_error(("Do not know how to reset " + TString(_target.GetName())).Data());
+    });
+
+  if (categorized_) {
+    auto& array(static_cast<TObjArray&>(tobj_));
+    for (int icat(0); icat < array.GetEntriesFast(); ++icat)
+      reset(*array.UncheckedAt(icat));
+  }
+  else
+    reset(tobj_);
 }
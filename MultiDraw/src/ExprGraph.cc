@@ -0,0 +1,342 @@
+#include "../interface/ExprGraph.h"
+#include "../interface/TTreeFormulaCached.h"
+
+#include "TTree.h"
+#include "TBranch.h"
+#include "TLeaf.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <map>
+#include <sstream>
+#include <algorithm>
+
+namespace {
+
+  // TTreeFormula semantics, as in the functions generated by FormulaCompiler
+  double exprSqrt(double x) { return std::sqrt(std::abs(x)); }
+  double exprLog(double x) { return x > 0. ? std::log(x) : 0.; }
+  double exprLog10(double x) { return x > 0. ? std::log10(x) : 0.; }
+  double exprExp(double x) { return x < -700. ? 0. : std::exp(x > 709. ? 709. : x); }
+  double exprSq(double x) { return x * x; }
+  double exprAbs(double x) { return std::abs(x); }
+  double exprSin(double x) { return std::sin(x); }
+  double exprCos(double x) { return std::cos(x); }
+  double exprTan(double x) { return std::tan(x); }
+  double exprAtan(double x) { return std::atan(x); }
+  double exprSinh(double x) { return std::sinh(x); }
+  double exprCosh(double x) { return std::cosh(x); }
+  double exprTanh(double x) { return std::tanh(x); }
+  double exprRawSqrt(double x) { return std::sqrt(x); }
+  double exprRawExp(double x) { return std::exp(x); }
+  double exprRawLog(double x) { return std::log(x); }
+  double exprRawLog10(double x) { return std::log10(x); }
+  double exprAtan2(double y, double x) { return std::atan2(y, x); }
+  double exprPow(double x, double y) { return std::pow(x, y); }
+  double exprMin(double a, double b) { return a <= b ? a : b; }
+  double exprMax(double a, double b) { return a >= b ? a : b; }
+
+  std::map<std::string, double (*)(double)> const functions1{
+    {"sqrt", exprSqrt},
+    {"log", exprLog},
+    {"log10", exprLog10},
+    {"exp", exprExp},
+    {"sq", exprSq},
+    {"abs", exprAbs},
+    {"fabs", exprAbs},
+    {"sin", exprSin},
+    {"cos", exprCos},
+    {"tan", exprTan},
+    {"atan", exprAtan},
+    {"sinh", exprSinh},
+    {"cosh", exprCosh},
+    {"tanh", exprTanh},
+    {"TMath::Abs", exprAbs},
+    {"TMath::Sqrt", exprRawSqrt},
+    {"TMath::Exp", exprRawExp},
+    {"TMath::Log", exprRawLog},
+    {"TMath::Log10", exprRawLog10},
+    {"TMath::Sin", exprSin},
+    {"TMath::Cos", exprCos},
+    {"TMath::Tan", exprTan},
+    {"TMath::ATan", exprAtan}
+  };
+
+  std::map<std::string, double (*)(double, double)> const functions2{
+    {"atan2", exprAtan2},
+    {"pow", exprPow},
+    {"min", exprMin},
+    {"max", exprMax},
+    {"TMath::ATan2", exprAtan2},
+    {"TMath::Power", exprPow},
+    {"TMath::Min", exprMin},
+    {"TMath::Max", exprMax}
+  };
+
+}
+
+int
+multidraw::ExprGraph::add(TTreeFormulaCached const& _formula)
+{
+  ExprParser::Node root;
+  if (!ExprParser::parse(_formula.GetTitle(), root))
+    return -1;
+
+  unsigned node(0);
+  if (!build_(_formula, root, node))
+    return -1;
+
+  return node;
+}
+
+bool
+multidraw::ExprGraph::build_(TTreeFormulaCached const& _formula, ExprParser::Node const& _pnode, unsigned& _result)
+{
+  static std::map<std::string, Operation> const binaryOperations{
+    {"+", kAdd}, {"-", kSubtract}, {"*", kMultiply}, {"/", kDivide}, {"%", kModulo},
+    {"==", kEqual}, {"!=", kNotEqual}, {"<", kLess}, {"<=", kLessEqual}, {">", kGreater}, {">=", kGreaterEqual},
+    {"&&", kAnd}, {"||", kOr}
+  };
+
+  Node node;
+
+  switch (_pnode.type) {
+  case ExprParser::Node::kNumber:
+    node.op = kConstant;
+    node.value = std::strtod(_pnode.text.c_str(), nullptr);
+    break;
+
+  case ExprParser::Node::kLeaf:
+    {
+      int code(-1);
+      TLeaf* leaf(ExprParser::findLeaf(_formula, _pnode, code));
+      if (leaf == nullptr)
+        return false;
+
+      // Formulas resolving to the same leaf object share the leaf
+      std::stringstream ss;
+      ss << static_cast<void const*>(leaf);
+
+      auto lItr(leafIndices_.find(ss.str()));
+      if (lItr == leafIndices_.end()) {
+        lItr = leafIndices_.emplace(ss.str(), leaves_.size()).first;
+        leaves_.emplace_back();
+        leaves_.back().formula = &_formula;
+        leaves_.back().code = code;
+      }
+
+      node.op = kLeaf;
+      node.leaf = lItr->second;
+      node.index = _pnode.index;
+    }
+    break;
+
+  case ExprParser::Node::kUnary:
+    node.op = (_pnode.text == "-" ? kNegate : kNot);
+    break;
+
+  case ExprParser::Node::kBinary:
+    {
+      auto oItr(binaryOperations.find(_pnode.text));
+      if (oItr == binaryOperations.end())
+        return false;
+      node.op = oItr->second;
+    }
+    break;
+
+  case ExprParser::Node::kFunction:
+    {
+      auto f1Itr(functions1.find(_pnode.text));
+      auto f2Itr(functions2.find(_pnode.text));
+      if (f1Itr != functions1.end() && _pnode.operands.size() == 1) {
+        node.op = kFunction1;
+        node.function1 = f1Itr->second;
+      }
+      else if (f2Itr != functions2.end() && _pnode.operands.size() == 2) {
+        node.op = kFunction2;
+        node.function2 = f2Itr->second;
+      }
+      else
+        return false;
+    }
+    break;
+
+  default:
+    return false;
+  }
+
+  for (unsigned iO(0); iO != _pnode.operands.size(); ++iO) {
+    if (!build_(_formula, _pnode.operands[iO], node.operands[iO]))
+      return false;
+  }
+
+  _result = intern_(node);
+  return true;
+}
+
+unsigned
+multidraw::ExprGraph::intern_(Node const& _node)
+{
+  unsigned lhs(_node.operands[0]);
+  unsigned rhs(_node.operands[1]);
+
+  switch (_node.op) {
+  case kAdd:
+  case kMultiply:
+  case kEqual:
+  case kNotEqual:
+  case kAnd:
+  case kOr:
+    // commutative
+    if (lhs > rhs)
+      std::swap(lhs, rhs);
+    break;
+  default:
+    break;
+  }
+
+  std::stringstream key;
+  key << _node.op << ":";
+  switch (_node.op) {
+  case kConstant:
+    {
+      // exact bit pattern of the value
+      std::uint64_t bits(0);
+      std::memcpy(&bits, &_node.value, sizeof(bits));
+      key << bits;
+    }
+    break;
+  case kLeaf:
+    key << _node.leaf << "[" << _node.index << "]";
+    break;
+  case kNegate:
+  case kNot:
+    key << lhs;
+    break;
+  case kFunction1:
+    key << reinterpret_cast<void const*>(_node.function1) << "(" << lhs << ")";
+    break;
+  case kFunction2:
+    key << reinterpret_cast<void const*>(_node.function2) << "(" << lhs << "," << rhs << ")";
+    break;
+  default:
+    key << lhs << "," << rhs;
+    break;
+  }
+
+  auto nItr(nodeIndices_.find(key.str()));
+  if (nItr != nodeIndices_.end())
+    return nItr->second;
+
+  unsigned iN(nodes_.size());
+  nodeIndices_.emplace(key.str(), iN);
+
+  nodes_.push_back(_node);
+  nodes_.back().operands[0] = lhs;
+  nodes_.back().operands[1] = rhs;
+  values_.push_back(0.);
+  epochs_.push_back(0);
+
+  return iN;
+}
+
+void
+multidraw::ExprGraph::resetEvent()
+{
+  if (++epoch_ == 0) {
+    // wrapped around
+    std::fill(epochs_.begin(), epochs_.end(), 0);
+    epoch_ = 1;
+  }
+}
+
+double
+multidraw::ExprGraph::evaluate(unsigned _iN)
+{
+  if (epochs_[_iN] != epoch_) {
+    values_[_iN] = compute_(nodes_[_iN]);
+    epochs_[_iN] = epoch_;
+  }
+
+  return values_[_iN];
+}
+
+double
+multidraw::ExprGraph::compute_(Node const& _node)
+{
+  unsigned lhs(_node.operands[0]);
+  unsigned rhs(_node.operands[1]);
+
+  switch (_node.op) {
+  case kConstant:
+    return _node.value;
+  case kLeaf:
+    return readLeaf_(_node);
+  case kNegate:
+    return -evaluate(lhs);
+  case kNot:
+    return double(evaluate(lhs) == 0.);
+  case kAdd:
+    return evaluate(lhs) + evaluate(rhs);
+  case kSubtract:
+    return evaluate(lhs) - evaluate(rhs);
+  case kMultiply:
+    return evaluate(lhs) * evaluate(rhs);
+  case kDivide:
+    {
+      double denom(evaluate(rhs));
+      return denom == 0. ? 0. : evaluate(lhs) / denom;
+    }
+  case kModulo:
+    {
+      long long denom(evaluate(rhs));
+      return denom == 0 ? 0. : double((long long)(evaluate(lhs)) % denom);
+    }
+  case kEqual:
+    return double(evaluate(lhs) == evaluate(rhs));
+  case kNotEqual:
+    return double(evaluate(lhs) != evaluate(rhs));
+  case kLess:
+    return double(evaluate(lhs) < evaluate(rhs));
+  case kLessEqual:
+    return double(evaluate(lhs) <= evaluate(rhs));
+  case kGreater:
+    return double(evaluate(lhs) > evaluate(rhs));
+  case kGreaterEqual:
+    return double(evaluate(lhs) >= evaluate(rhs));
+  case kAnd:
+    return double(evaluate(lhs) != 0. && evaluate(rhs) != 0.);
+  case kOr:
+    return double(evaluate(lhs) != 0. || evaluate(rhs) != 0.);
+  case kFunction1:
+    return _node.function1(evaluate(lhs));
+  case kFunction2:
+    return _node.function2(evaluate(lhs), evaluate(rhs));
+  default:
+    return 0.;
+  }
+}
+
+double
+multidraw::ExprGraph::readLeaf_(Node const& _node) const
+{
+  auto& ref(leaves_[_node.leaf]);
+  auto* leaf(ref.formula->GetLeaf(ref.code));
+  if (leaf == nullptr)
+    return 0.;
+
+  // branch loading normally done in TTreeFormula::EvalInstance
+  auto* branch(leaf->GetBranch());
+  Long64_t entry(branch->GetTree()->GetReadEntry());
+  if (branch->GetReadEntry() != entry)
+    branch->GetEntry(entry);
+
+  if (_node.index < 0)
+    return leaf->GetValue(0);
+  else if (_node.index < leaf->GetLen())
+    return leaf->GetValue(_node.index);
+  else
+    return 0.;
+}
@@ -0,0 +1,439 @@
+#include "../interface/ExprParser.h"
+#include "../interface/TTreeFormulaCached.h"
+
+#include "TLeaf.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <cctype>
+#include <map>
+#include <utility>
+
+namespace {
+
+  typedef multidraw::ExprParser::Node Node;
+
+  // Function name -> number of arguments
+  std::map<std::string, unsigned> const functions{
+    {"sqrt", 1},
+    {"log", 1},
+    {"log10", 1},
+    {"exp", 1},
+    {"sq", 1},
+    {"abs", 1},
+    {"fabs", 1},
+    {"sin", 1},
+    {"cos", 1},
+    {"tan", 1},
+    {"atan", 1},
+    {"sinh", 1},
+    {"cosh", 1},
+    {"tanh", 1},
+    {"atan2", 2},
+    {"pow", 2},
+    {"min", 2},
+    {"max", 2},
+    {"TMath::Abs", 1},
+    {"TMath::Sqrt", 1},
+    {"TMath::Exp", 1},
+    {"TMath::Log", 1},
+    {"TMath::Log10", 1},
+    {"TMath::Sin", 1},
+    {"TMath::Cos", 1},
+    {"TMath::Tan", 1},
+    {"TMath::ATan", 1},
+    {"TMath::ATan2", 2},
+    {"TMath::Power", 2},
+    {"TMath::Min", 2},
+    {"TMath::Max", 2}
+  };
+
+  // Functions without arguments, replaced by their values
+  std::map<std::string, std::string> const constants{
+    {"TMath::Pi", "3.14159265358979323846"}
+  };
+
+  //! Recursive-descent parser
+  class Parser {
+  public:
+    Parser() {}
+
+    bool parse(char const* expr, Node& root);
+
+  private:
+    enum TokenType {
+      kEnd,
+      kNumber,
+      kName,
+      kOperator
+    };
+
+    struct Token {
+      TokenType type;
+      std::string text;
+    };
+
+    bool tokenize(char const*);
+    Token const& peek() const { return tokens_[pos_]; }
+    Token const& next() { return tokens_[pos_++]; }
+    bool accept(char const* op);
+    bool peekOperator(char const* op) const { return peek().type == kOperator && peek().text == op; }
+
+    //! Replace lhs with the binary operation of lhs and rhs
+    void binary(std::string const& op, Node& lhs, Node&& rhs);
+
+    bool parseLogical(Node&);
+    bool parseComparison(Node&);
+    bool parseAdditive(Node&);
+    bool parseMultiplicative(Node&);
+    bool parseUnary(Node&);
+    bool parsePrimary(Node&);
+    bool parseFunction(std::string const& name, Node&);
+
+    std::vector<Token> tokens_{};
+    unsigned pos_{0};
+  };
+
+  bool
+  Parser::parse(char const* _expr, Node& _root)
+  {
+    tokens_.clear();
+    if (!tokenize(_expr))
+      return false;
+
+    pos_ = 0;
+    if (!parseLogical(_root))
+      return false;
+
+    return peek().type == kEnd;
+  }
+
+  bool
+  Parser::tokenize(char const* _expr)
+  {
+    auto isNameStart([](char c)->bool { return std::isalpha(c) || c == '_'; });
+    auto isNameChar([](char c)->bool { return std::isalnum(c) || c == '_'; });
+
+    char const* c(_expr);
+    while (*c != '\0') {
+      if (std::isspace(*c)) {
+        ++c;
+        continue;
+      }
+
+      if (std::isdigit(*c) || (*c == '.' && std::isdigit(c[1]))) {
+        char* end(nullptr);
+        std::strtod(c, &end);
+        // reject hexadecimals and numbers directly followed by a name
+        if (end == c || isNameChar(*end) || (c[0] == '0' && (c[1] == 'x' || c[1] == 'X')))
+          return false;
+        tokens_.push_back({kNumber, std::string(c, end - c)});
+        c = end;
+      }
+      else if (isNameStart(*c)) {
+        char const* start(c);
+        while (true) {
+          while (isNameChar(*c))
+            ++c;
+          // friend trees: <alias>.<leaf>; namespaces: TMath::Func
+          if (c[0] == '.' && isNameStart(c[1]))
+            c += 1;
+          else if (c[0] == ':' && c[1] == ':' && isNameStart(c[2]))
+            c += 2;
+          else
+            break;
+        }
+        tokens_.push_back({kName, std::string(start, c)});
+      }
+      else {
+        static char const* twoChar[] = {"&&", "||", "==", "!=", "<=", ">="};
+        bool found(false);
+        for (char const* op : twoChar) {
+          if (std::strncmp(c, op, 2) == 0) {
+            tokens_.push_back({kOperator, op});
+            c += 2;
+            found = true;
+            break;
+          }
+        }
+        if (found)
+          continue;
+
+        if (std::strchr("+-*/%<>!()[],", *c) == nullptr)
+          return false;
+
+        // ** is power in TFormula
+        if (*c == '*' && c[1] == '*')
+          return false;
+
+        tokens_.push_back({kOperator, std::string(1, *c)});
+        ++c;
+      }
+    }
+
+    tokens_.push_back({kEnd, ""});
+    return true;
+  }
+
+  bool
+  Parser::accept(char const* _op)
+  {
+    if (peekOperator(_op)) {
+      ++pos_;
+      return true;
+    }
+    return false;
+  }
+
+  void
+  Parser::binary(std::string const& _op, Node& _lhs, Node&& _rhs)
+  {
+    Node node;
+    node.type = Node::kBinary;
+    node.text = _op;
+    node.operands.push_back(std::move(_lhs));
+    node.operands.push_back(std::move(_rhs));
+    _lhs = std::move(node);
+  }
+
+  bool
+  Parser::parseLogical(Node& _result)
+  {
+    if (!parseComparison(_result))
+      return false;
+
+    std::string op;
+    while (peekOperator("&&") || peekOperator("||")) {
+      // TFormula precedence between && and || is not the same as in C
+      if (op.empty())
+        op = peek().text;
+      else if (op != peek().text)
+        return false;
+
+      ++pos_;
+
+      Node rhs;
+      if (!parseComparison(rhs))
+        return false;
+
+      binary(op, _result, std::move(rhs));
+    }
+
+    return true;
+  }
+
+  bool
+  Parser::parseComparison(Node& _result)
+  {
+    if (!parseAdditive(_result))
+      return false;
+
+    static char const* comparisons[] = {"==", "!=", "<=", ">=", "<", ">"};
+    for (char const* op : comparisons) {
+      if (!accept(op))
+        continue;
+
+      Node rhs;
+      if (!parseAdditive(rhs))
+        return false;
+
+      binary(op, _result, std::move(rhs));
+
+      // no chained comparisons
+      for (char const* op2 : comparisons) {
+        if (peekOperator(op2))
+          return false;
+      }
+      break;
+    }
+
+    return true;
+  }
+
+  bool
+  Parser::parseAdditive(Node& _result)
+  {
+    if (!parseMultiplicative(_result))
+      return false;
+
+    while (peekOperator("+") || peekOperator("-")) {
+      std::string op(next().text);
+
+      Node rhs;
+      if (!parseMultiplicative(rhs))
+        return false;
+
+      binary(op, _result, std::move(rhs));
+    }
+
+    return true;
+  }
+
+  bool
+  Parser::parseMultiplicative(Node& _result)
+  {
+    if (!parseUnary(_result))
+      return false;
+
+    while (peekOperator("*") || peekOperator("/") || peekOperator("%")) {
+      std::string op(next().text);
+
+      Node rhs;
+      if (!parseUnary(rhs))
+        return false;
+
+      binary(op, _result, std::move(rhs));
+    }
+
+    return true;
+  }
+
+  bool
+  Parser::parseUnary(Node& _result)
+  {
+    if (accept("-") || accept("!")) {
+      Node node;
+      node.type = Node::kUnary;
+      node.text = tokens_[pos_ - 1].text;
+      node.operands.emplace_back();
+      if (!parseUnary(node.operands.back()))
+        return false;
+
+      _result = std::move(node);
+      return true;
+    }
+    else if (accept("+")) {
+      return parseUnary(_result);
+    }
+
+    return parsePrimary(_result);
+  }
+
+  bool
+  Parser::parsePrimary(Node& _result)
+  {
+    Token const& token(next());
+
+    switch (token.type) {
+    case kNumber:
+      _result.type = Node::kNumber;
+      _result.text = token.text;
+      return true;
+
+    case kName:
+      {
+        std::string name(token.text);
+
+        if (accept("("))
+          return parseFunction(name, _result);
+
+        long index(-1);
+        if (accept("[")) {
+          Token const& idx(next());
+          if (idx.type != kNumber || idx.text.find_first_not_of("0123456789") != std::string::npos)
+            return false;
+          index = std::atol(idx.text.c_str());
+
+          if (!accept("]"))
+            return false;
+          // multi-dimensional indexing is not supported
+          if (peekOperator("["))
+            return false;
+        }
+
+        _result.type = Node::kLeaf;
+        _result.text = name;
+        _result.index = index;
+        return true;
+      }
+
+    case kOperator:
+      if (token.text == "(") {
+        if (!parseLogical(_result))
+          return false;
+        return accept(")");
+      }
+      return false;
+
+    default:
+      return false;
+    }
+  }
+
+  bool
+  Parser::parseFunction(std::string const& _name, Node& _result)
+  {
+    auto cItr(constants.find(_name));
+    if (cItr != constants.end()) {
+      if (!accept(")"))
+        return false;
+      _result.type = Node::kNumber;
+      _result.text = cItr->second;
+      return true;
+    }
+
+    auto fItr(functions.find(_name));
+    if (fItr == functions.end())
+      return false;
+
+    _result.type = Node::kFunction;
+    _result.text = _name;
+    _result.operands.resize(fItr->second);
+
+    for (unsigned iA(0); iA != fItr->second; ++iA) {
+      if (iA != 0 && !accept(","))
+        return false;
+
+      if (!parseLogical(_result.operands[iA]))
+        return false;
+    }
+
+    return accept(")");
+  }
+
+}
+
+/*static*/
+bool
+multidraw::ExprParser::parse(char const* _expr, Node& _root)
+{
+  Parser parser;
+  _root = Node();
+  return parser.parse(_expr, _root);
+}
+
+/*static*/
+TLeaf*
+multidraw::ExprParser::findLeaf(TTreeFormulaCached const& _formula, Node const& _node, int& _code)
+{
+  _code = -1;
+
+  // Identify the leaf among the ones that TTreeFormula resolved. Names of leaves in friend trees carry the
+  // friend alias as a prefix.
+  std::string bareName(_node.text.substr(_node.text.rfind('.') + 1));
+
+  TLeaf* leaf(nullptr);
+  for (int iC(0); iC != _formula.GetNcodes(); ++iC) {
+    auto* candidate(_formula.GetLeaf(iC));
+    if (candidate == nullptr || bareName != candidate->GetName())
+      continue;
+
+    if (leaf == nullptr) {
+      _code = iC;
+      leaf = candidate;
+    }
+    else if (candidate != leaf) {
+      // ambiguous
+      return nullptr;
+    }
+  }
+
+  // not a leaf (TTree alias, constant, etc.)
+  if (leaf == nullptr || TTreeFormulaCached::GetLeafCType(leaf) == nullptr)
+    return nullptr;
+
+  if (_node.index < 0 && (leaf->GetLeafCount() != nullptr || leaf->GetLenStatic() != 1))
+    return nullptr;
+
+  return leaf;
+}
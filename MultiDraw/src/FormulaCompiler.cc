@@ -0,0 +1,395 @@
+#include "../interface/FormulaCompiler.h"
+#include "../interface/ExprParser.h"
+
+#include "TSystem.h"
+#include "TLeaf.h"
+#include "TMD5.h"
+
+#include <cstring>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <map>
+#include <unordered_map>
+#include <unordered_set>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+#include <dlfcn.h>
+
+namespace {
+
+  // Helper functions reproducing the TTreeFormula semantics
+  char const* preamble = R"CODE(// Generated by multidraw::FormulaCompiler
+#include <cmath>
+
+namespace {
+  template<class T> inline double mdjit_val(void const* v) { return double(*static_cast<T const*>(v)); }
+  template<class T> inline double mdjit_elem(void const* v, unsigned n, unsigned i) { return i < n ? double(static_cast<T const*>(v)[i]) : 0.; }
+  inline double mdjit_div(double a, double b) { return b == 0. ? 0. : a / b; }
+  inline double mdjit_mod(double a, double b) { long long ib(b); return ib == 0 ? 0. : double((long long)(a) % ib); }
+  inline double mdjit_sqrt(double x) { return std::sqrt(std::abs(x)); }
+  inline double mdjit_log(double x) { return x > 0. ? std::log(x) : 0.; }
+  inline double mdjit_log10(double x) { return x > 0. ? std::log10(x) : 0.; }
+  inline double mdjit_exp(double x) { return x < -700. ? 0. : std::exp(x > 709. ? 709. : x); }
+  inline double mdjit_sq(double x) { return x * x; }
+  inline double mdjit_min(double a, double b) { return a <= b ? a : b; }
+  inline double mdjit_max(double a, double b) { return a >= b ? a : b; }
+}
+)CODE";
+
+  // Function name -> C++ function (the functions supported by ExprParser)
+  std::map<std::string, std::string> const functions{
+    {"sqrt", "mdjit_sqrt"},
+    {"log", "mdjit_log"},
+    {"log10", "mdjit_log10"},
+    {"exp", "mdjit_exp"},
+    {"sq", "mdjit_sq"},
+    {"abs", "std::abs"},
+    {"fabs", "std::abs"},
+    {"sin", "std::sin"},
+    {"cos", "std::cos"},
+    {"tan", "std::tan"},
+    {"atan", "std::atan"},
+    {"sinh", "std::sinh"},
+    {"cosh", "std::cosh"},
+    {"tanh", "std::tanh"},
+    {"atan2", "std::atan2"},
+    {"pow", "std::pow"},
+    {"min", "mdjit_min"},
+    {"max", "mdjit_max"},
+    {"TMath::Abs", "std::abs"},
+    {"TMath::Sqrt", "std::sqrt"},
+    {"TMath::Exp", "std::exp"},
+    {"TMath::Log", "std::log"},
+    {"TMath::Log10", "std::log10"},
+    {"TMath::Sin", "std::sin"},
+    {"TMath::Cos", "std::cos"},
+    {"TMath::Tan", "std::tan"},
+    {"TMath::ATan", "std::atan"},
+    {"TMath::ATan2", "std::atan2"},
+    {"TMath::Power", "std::pow"},
+    {"TMath::Min", "mdjit_min"},
+    {"TMath::Max", "mdjit_max"}
+  };
+
+  //! Translator of the ExprParser syntax tree into C++.
+  /*!
+   * Every node is translated into a self-contained C++ expression (a literal, a function call, or a
+   * parenthesized expression) of type double.
+   */
+  class ExprTranslator {
+  public:
+    ExprTranslator(TTreeFormulaCached const& _formula, std::vector<TTreeFormulaCached::CompiledLeaf>& _leaves) : formula_(_formula), leaves_(_leaves) {}
+
+    bool translate(std::string& result);
+
+  private:
+    bool emit(multidraw::ExprParser::Node const&, std::string&);
+    bool leafAccess(multidraw::ExprParser::Node const&, std::string&);
+
+    TTreeFormulaCached const& formula_;
+    std::vector<TTreeFormulaCached::CompiledLeaf>& leaves_;
+  };
+
+  bool
+  ExprTranslator::translate(std::string& _result)
+  {
+    leaves_.clear();
+
+    multidraw::ExprParser::Node root;
+    if (!multidraw::ExprParser::parse(formula_.GetTitle(), root))
+      return false;
+
+    return emit(root, _result);
+  }
+
+  bool
+  ExprTranslator::emit(multidraw::ExprParser::Node const& _node, std::string& _result)
+  {
+    typedef multidraw::ExprParser::Node Node;
+
+    std::vector<std::string> operands(_node.operands.size());
+    for (unsigned iO(0); iO != operands.size(); ++iO) {
+      if (!emit(_node.operands[iO], operands[iO]))
+        return false;
+    }
+
+    std::string const& op(_node.text);
+
+    switch (_node.type) {
+    case Node::kNumber:
+      _result = _node.text;
+      if (_result.find_first_of(".eE") == std::string::npos)
+        _result += ".";
+      return true;
+
+    case Node::kLeaf:
+      return leafAccess(_node, _result);
+
+    case Node::kUnary:
+      if (op == "-")
+        _result = "(-" + operands[0] + ")";
+      else
+        _result = "double(" + operands[0] + " == 0.)";
+      return true;
+
+    case Node::kBinary:
+      if (op == "&&" || op == "||")
+        _result = "double(" + operands[0] + " != 0. " + op + " " + operands[1] + " != 0.)";
+      else if (op == "/")
+        _result = "mdjit_div(" + operands[0] + ", " + operands[1] + ")";
+      else if (op == "%")
+        _result = "mdjit_mod(" + operands[0] + ", " + operands[1] + ")";
+      else if (op == "+" || op == "-" || op == "*")
+        _result = "(" + operands[0] + " " + op + " " + operands[1] + ")";
+      else
+        _result = "double(" + operands[0] + " " + op + " " + operands[1] + ")";
+      return true;
+
+    case Node::kFunction:
+      {
+        auto fItr(functions.find(_node.text));
+        if (fItr == functions.end())
+          return false;
+
+        _result = fItr->second + "(";
+        for (unsigned iO(0); iO != operands.size(); ++iO) {
+          if (iO != 0)
+            _result += ", ";
+          _result += operands[iO];
+        }
+        _result += ")";
+      }
+      return true;
+
+    default:
+      return false;
+    }
+  }
+
+  bool
+  ExprTranslator::leafAccess(multidraw::ExprParser::Node const& _node, std::string& _result)
+  {
+    int code(-1);
+    TLeaf* leaf(multidraw::ExprParser::findLeaf(formula_, _node, code));
+    if (leaf == nullptr)
+      return false;
+
+    char const* ctype(TTreeFormulaCached::GetLeafCType(leaf));
+
+    bool scalar(_node.index < 0);
+
+    unsigned slot(0);
+    for (; slot != leaves_.size(); ++slot) {
+      if (leaves_[slot].fCode == code)
+        break;
+    }
+    if (slot == leaves_.size()) {
+      leaves_.emplace_back();
+      leaves_.back().fCode = code;
+      leaves_.back().fType = ctype;
+    }
+    if (scalar)
+      leaves_[slot].fScalar = kTRUE;
+
+    std::stringstream ss;
+    if (scalar)
+      ss << "mdjit_val<" << ctype << ">(_v[" << slot << "])";
+    else
+      ss << "mdjit_elem<" << ctype << ">(_v[" << slot << "], _n[" << slot << "], " << _node.index << ")";
+
+    _result = ss.str();
+    return true;
+  }
+
+  // Shared libraries loaded in this process (nullptr if the compilation failed)
+  std::mutex libraryMutex;
+  std::unordered_map<std::string, void*> libraries;
+  // Libraries being built by a thread of this process; other threads wait for libraryBuilt
+  std::unordered_set<std::string> building;
+  std::condition_variable libraryBuilt;
+  // Distinguishes the temporary files of concurrent builds within the process
+  std::atomic<unsigned> tmpCounter{0};
+
+  //! Quote a path for the shell
+  TString
+  shellQuote(TString const& _path)
+  {
+    TString quoted(_path);
+    quoted.ReplaceAll("'", "'\\''");
+    return "'" + quoted + "'";
+  }
+
+}
+
+multidraw::FormulaCompiler::FormulaCompiler(char const* _cacheDir/* = ""*/) :
+  cacheDir_(_cacheDir)
+{
+  if (cacheDir_.Length() == 0) {
+    char const* env(gSystem->Getenv("MULTIDRAW_JIT_CACHE"));
+    if (env != nullptr && std::strlen(env) != 0)
+      cacheDir_ = env;
+    else
+      cacheDir_ = TString::Format("%s/multidraw_jit_%d", gSystem->TempDirectory(), gSystem->GetEffectiveUid());
+  }
+}
+
+/*static*/
+TString
+multidraw::FormulaCompiler::translate(TTreeFormulaCached const& _formula, std::vector<TTreeFormulaCached::CompiledLeaf>& _leaves)
+{
+  ExprTranslator translator(_formula, _leaves);
+
+  std::string result;
+  if (!translator.translate(result)) {
+    _leaves.clear();
+    return "";
+  }
+
+  return result.c_str();
+}
+
+unsigned
+multidraw::FormulaCompiler::compile(std::vector<TTreeFormulaCached*> const& _formulas)
+{
+  struct Target {
+    TTreeFormulaCached* formula;
+    std::vector<TTreeFormulaCached::CompiledLeaf> leaves;
+    unsigned iF;
+  };
+
+  std::vector<Target> targets;
+  // identical expressions share the function
+  std::unordered_map<std::string, unsigned> functionIndices;
+  std::stringstream source;
+  source << preamble;
+
+  for (auto* formula : _formulas) {
+    if (formula->IsCompiled())
+      continue;
+
+    std::vector<TTreeFormulaCached::CompiledLeaf> leaves;
+    TString expr(translate(*formula, leaves));
+    if (expr.Length() == 0)
+      continue;
+
+    auto fItr(functionIndices.find(expr.Data()));
+    if (fItr == functionIndices.end()) {
+      unsigned iF(functionIndices.size());
+      fItr = functionIndices.emplace(expr.Data(), iF).first;
+
+      TString comment(formula->GetTitle());
+      comment.ReplaceAll("\n", " ");
+      source << std::endl << "// " << comment << std::endl;
+      source << "extern \"C\" double mdjit_" << iF << "(void const* const* _v, unsigned const* _n)" << std::endl;
+      source << "{" << std::endl;
+      source << "  return " << expr << ";" << std::endl;
+      source << "}" << std::endl;
+    }
+
+    targets.push_back({formula, std::move(leaves), fItr->second});
+  }
+
+  if (targets.empty())
+    return 0;
+
+  std::string sourceText(source.str());
+
+  TMD5 md5;
+  md5.Update(reinterpret_cast<UChar_t const*>(sourceText.c_str()), sourceText.size());
+  md5.Final();
+  TString hash(md5.AsString());
+
+  TString libPath(cacheDir_ + "/libmultidrawjit_" + hash + ".so");
+
+  void* library(nullptr);
+
+  // The lock is held only for the lookup and the insertion, so that threads can build different libraries in
+  // parallel. A library is built once per process; later callers wait for the build in flight.
+  bool found(false);
+  {
+    std::unique_lock<std::mutex> lock(libraryMutex);
+    libraryBuilt.wait(lock, [&libPath]()->bool { return building.count(libPath.Data()) == 0; });
+
+    auto lItr(libraries.find(libPath.Data()));
+    if (lItr != libraries.end()) {
+      library = lItr->second;
+      found = true;
+    }
+    else
+      building.insert(libPath.Data());
+  }
+
+  if (!found) {
+    bool built(true);
+
+    // AccessPathName returns true if the file does NOT exist
+    if (gSystem->AccessPathName(libPath)) {
+      gSystem->mkdir(cacheDir_, true);
+
+      // write and compile under temporary names unique to the process and the call, then rename, in case
+      // other jobs build the same library
+      TString tmpSuffix(TString::Format(".%d.%u", gSystem->GetPid(), tmpCounter++));
+      TString srcPath(cacheDir_ + "/multidrawjit_" + hash + ".cc");
+      TString tmpSrcPath(cacheDir_ + "/multidrawjit_" + hash + tmpSuffix + ".cc");
+      TString tmpPath(libPath + tmpSuffix);
+
+      std::ofstream srcFile(tmpSrcPath.Data());
+      srcFile << sourceText;
+      srcFile.close();
+
+      char const* cxx(gSystem->Getenv("CXX"));
+      if (cxx == nullptr || std::strlen(cxx) == 0)
+        cxx = "g++";
+
+      TString command(TString::Format("%s -std=c++11 -O2 -fPIC -shared -o %s %s", cxx, shellQuote(tmpPath).Data(), shellQuote(tmpSrcPath).Data()));
+
+      if (!srcFile || gSystem->Exec(command) != 0 || gSystem->Rename(tmpPath, libPath) != 0) {
+        std::cerr << "FormulaCompiler: failed to build " << libPath << " from " << tmpSrcPath << "; formulas will be interpreted" << std::endl;
+        gSystem->Unlink(tmpPath);
+        built = false;
+      }
+      else
+        gSystem->Rename(tmpSrcPath, srcPath);
+    }
+
+    if (built) {
+      library = dlopen(libPath.Data(), RTLD_NOW | RTLD_LOCAL);
+      if (library == nullptr)
+        std::cerr << "FormulaCompiler: failed to load " << libPath << ": " << dlerror() << std::endl;
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(libraryMutex);
+      libraries.emplace(libPath.Data(), library);
+      building.erase(libPath.Data());
+    }
+    libraryBuilt.notify_all();
+  }
+
+  if (library == nullptr)
+    return 0;
+
+  unsigned nCompiled(0);
+
+  std::vector<TTreeFormulaCached::CompiledFunction> compiledFunctions(functionIndices.size(), nullptr);
+  for (unsigned iF(0); iF != compiledFunctions.size(); ++iF) {
+    TString symbol(TString::Format("mdjit_%u", iF));
+    compiledFunctions[iF] = reinterpret_cast<TTreeFormulaCached::CompiledFunction>(dlsym(library, symbol.Data()));
+  }
+
+  for (auto& target : targets) {
+    auto* function(compiledFunctions[target.iF]);
+    if (function == nullptr)
+      continue;
+
+    target.formula->SetCompiledFunction(function, target.leaves);
+    if (target.formula->IsCompiled())
+      ++nCompiled;
+  }
+
+  return nCompiled;
+}
@@ -1,8 +1,14 @@
 #include "../interface/FormulaLibrary.h"
+#include "../interface/FormulaCompiler.h"
+
+#include "TTree.h"
+#include "TBranch.h"
+#include "TLeaf.h"
 
 #include <cstring>
 #include <iostream>
 #include <sstream>
+#include <set>
 
 multidraw::FormulaLibrary::FormulaLibrary(TTree& _tree) :
   tree_(_tree)
@@ -50,17 +56,115 @@ multidraw::FormulaLibrary::resetCache()
 {
   for (auto& ec : caches_)
     ec.second->fValues.clear();
+
+  if (graph_)
+    graph_->resetEvent();
 }
 
 void
+multidraw::FormulaLibrary::setProfiling(bool _p)
+{
+  for (auto& ec : caches_)
+    ec.second->fProfile = _p;
+}
+
+bool
 multidraw::FormulaLibrary::replaceAll(char const* _from, char const* _to)
 {
+  if (graph_) {
+    // the graph refers to the leaves resolved before the replacement
+    for (auto& formula : formulas_)
+      formula->SetGraphNode(nullptr);
+    graph_.reset();
+  }
+
   bool replaced{false};
   for (auto& formula : formulas_) {
-    if (formula->ReplaceLeaf(_from, _to))
+    if (formula->ReplaceLeaf(_from, _to)) {
       replaced = true;
+      variedFormulas_.insert(formula.get());
+    }
   }
 
   if (replaced)
     resetCache();
+
+  return replaced;
+}
+
+void
+multidraw::FormulaLibrary::shareCaches(FormulaLibrary const& _nominal)
+{
+  for (auto& formula : formulas_) {
+    if (isVaried(*formula))
+      continue;
+
+    auto nItr(_nominal.caches_.find(formula->GetTitle()));
+    if (nItr == _nominal.caches_.end())
+      continue;
+
+    formula->SetCache(nItr->second);
+    caches_[formula->GetTitle()] = nItr->second;
+  }
+}
+
+unsigned
+multidraw::FormulaLibrary::compileFormulas(char const* _cacheDir/* = ""*/)
+{
+  std::vector<TTreeFormulaCached*> formulas;
+  for (auto& formula : formulas_)
+    formulas.push_back(formula.get());
+
+  FormulaCompiler compiler(_cacheDir);
+  return compiler.compile(formulas);
+}
+
+unsigned
+multidraw::FormulaLibrary::shareSubexpressions()
+{
+  if (!graph_)
+    graph_ = std::make_unique<ExprGraph>();
+
+  unsigned nShared(0);
+  for (auto& formula : formulas_) {
+    if (formula->IsInGraph()) {
+      ++nShared;
+      continue;
+    }
+    if (formula->IsCompiled())
+      continue;
+
+    int node(graph_->add(*formula));
+    if (node < 0)
+      continue;
+
+    formula->SetGraphNode(graph_.get(), node);
+    ++nShared;
+  }
+
+  return nShared;
+}
+
+std::vector<TString>
+multidraw::FormulaLibrary::getBranchNames(TTree const& _tree) const
+{
+  std::set<TString> names;
+  std::vector<TLeaf*> leaves;
+  for (auto& formula : formulas_) {
+    leaves.clear();
+    formula->CollectLeaves(leaves);
+
+    for (auto* leaf : leaves) {
+      if (leaf->GetBranch()->GetTree() != &_tree)
+        continue;
+
+      names.insert(leaf->GetBranch()->GetMother()->GetName());
+
+      // counter of a variable-size array
+      if (leaf->GetLeafCount() != nullptr)
+        names.insert(leaf->GetLeafCount()->GetBranch()->GetMother()->GetName());
+    }
+  }
+
+  return std::vector<TString>(names.begin(), names.end());
 }
@@ -10,8 +10,12 @@ void
 multidraw::FunctionLibrary::setEntry(long long _iEntry)
 {
   reader_->SetEntry(_iEntry);
-  for (auto& fct : functions_)
+  for (auto& column : columns_)
+    column->update();
+  for (auto& fct : functions_) {
+    fct.second->resetValues();
     fct.second->beginEvent(_iEntry);
+  }
 }
 
 multidraw::TTreeFunction&
@@ -24,12 +28,38 @@ multidraw::FunctionLibrary::getFunction(TTreeFunction const& _source)
   return *fItr->second.get();
 }
 
-void
+bool
 multidraw::FunctionLibrary::replaceAll(char const* _from, char const* _to)
 {
+  bool replaced(false);
+
+  // Column views hold a pointer to the reader; rebinding the slot is enough
+  for (auto& column : columns_) {
+    if (column->getBranchName() == _from) {
+      column->rebind(*this, _to);
+      replaced = true;
+    }
+  }
+
   auto fItr(branchReaders_.find(_from));
   if (fItr == branchReaders_.end())
-    return;
+    return replaced;
 
   fItr->second->replace(*reader_, _to);
+  return true;
+}
+
+std::vector<TString>
+multidraw::FunctionLibrary::getBranchNames() const
+{
+  std::vector<TString> names;
+  for (auto& br : branchReaders_)
+    names.emplace_back(br.first.c_str());
+
+  for (auto& ff : functions_) {
+    for (auto& name : ff.second->getExtraBranchNames())
+      names.push_back(name);
+  }
+
+  return names;
 }
@@ -0,0 +1,143 @@
+#include "../interface/GraphInterpolator.h"
+
+#include "TSpline.h"
+
+#include <stdexcept>
+#include <algorithm>
+#include <numeric>
+#include <cmath>
+
+multidraw::GraphInterpolator::GraphInterpolator(TGraph const& _graph, Mode _mode/* = kCubic*/) :
+  mode_(_mode)
+{
+  unsigned nP(_graph.GetN());
+  if (nP < 2)
+    throw std::runtime_error(TString::Format("Graph %s has fewer than two points and cannot be interpolated", _graph.GetName()).Data());
+
+  x_.resize(nP);
+  y_.resize(nP);
+  b_.assign(nP, 0.);
+  c_.assign(nP, 0.);
+  d_.assign(nP, 0.);
+
+  if (mode_ == kCubic) {
+    // Same coefficients as the TSpline3 that Reweight used to evaluate
+    TSpline3 spline("interpolation", &_graph);
+    for (unsigned iP(0); iP != nP; ++iP)
+      spline.GetCoeff(iP, x_[iP], y_[iP], b_[iP], c_[iP], d_[iP]);
+  }
+  else {
+    std::vector<unsigned> order(nP);
+    std::iota(order.begin(), order.end(), 0);
+    double const* gx(_graph.GetX());
+    double const* gy(_graph.GetY());
+    std::stable_sort(order.begin(), order.end(), [gx](unsigned i, unsigned j) { return gx[i] < gx[j]; });
+
+    for (unsigned iP(0); iP != nP; ++iP) {
+      x_[iP] = gx[order[iP]];
+      y_[iP] = gy[order[iP]];
+    }
+
+    std::vector<double> slopes(nP - 1);
+    for (unsigned iP(0); iP != nP - 1; ++iP) {
+      double h(x_[iP + 1] - x_[iP]);
+      slopes[iP] = h == 0. ? 0. : (y_[iP + 1] - y_[iP]) / h;
+    }
+
+    if (mode_ == kLinear) {
+      for (unsigned iP(0); iP != nP - 1; ++iP)
+        b_[iP] = slopes[iP];
+      // extrapolate the last segment
+      b_[nP - 1] = slopes[nP - 2];
+    }
+    else {
+      // Fritsch-Carlson tangents
+      std::vector<double> tangents(nP);
+      tangents[0] = slopes[0];
+      tangents[nP - 1] = slopes[nP - 2];
+      for (unsigned iP(1); iP != nP - 1; ++iP) {
+        if (slopes[iP - 1] * slopes[iP] <= 0.)
+          tangents[iP] = 0.;
+        else
+          tangents[iP] = (slopes[iP - 1] + slopes[iP]) / 2.;
+      }
+
+      for (unsigned iP(0); iP != nP - 1; ++iP) {
+        if (slopes[iP] == 0.) {
+          tangents[iP] = 0.;
+          tangents[iP + 1] = 0.;
+          continue;
+        }
+
+        double alpha(tangents[iP] / slopes[iP]);
+        double beta(tangents[iP + 1] / slopes[iP]);
+        double norm(alpha * alpha + beta * beta);
+        if (norm > 9.) {
+          double tau(3. / std::sqrt(norm));
+          tangents[iP] = tau * alpha * slopes[iP];
+          tangents[iP + 1] = tau * beta * slopes[iP];
+        }
+      }
+
+      for (unsigned iP(0); iP != nP - 1; ++iP) {
+        double h(x_[iP + 1] - x_[iP]);
+        b_[iP] = tangents[iP];
+        if (h == 0.)
+          continue;
+        c_[iP] = (3. * slopes[iP] - 2. * tangents[iP] - tangents[iP + 1]) / h;
+        d_[iP] = (tangents[iP] + tangents[iP + 1] - 2. * slopes[iP]) / (h * h);
+      }
+      b_[nP - 1] = tangents[nP - 1];
+    }
+  }
+
+  // Equidistant knots allow a direct interval computation
+  double step((x_[nP - 1] - x_[0]) / (nP - 1));
+  bool uniform(step > 0.);
+  for (unsigned iP(1); uniform && iP != nP; ++iP) {
+    if (std::abs(x_[iP] - (x_[0] + iP * step)) > 1.e-9 * step)
+      uniform = false;
+  }
+  if (uniform)
+    invStep_ = 1. / step;
+}
+
+double
+multidraw::GraphInterpolator::eval(double _x) const
+{
+  unsigned iP(findKnot_(_x));
+  double dx(_x - x_[iP]);
+  return y_[iP] + dx * (b_[iP] + dx * (c_[iP] + dx * d_[iP]));
+}
+
+unsigned
+multidraw::GraphInterpolator::findKnot_(double _x) const
+{
+  unsigned nP(x_.size());
+
+  if (!(_x > x_[0])) // also catches NaN
+    return 0;
+  if (_x >= x_[nP - 1])
+    return nP - 1;
+
+  if (invStep_ != 0.) {
+    unsigned iP((_x - x_[0]) * invStep_);
+    // guard against rounding at the knots
+    if (iP > nP - 2)
+      iP = nP - 2;
+    else if (_x < x_[iP])
+      --iP;
+    return iP;
+  }
+
+  // Largest knot index with x_[i] <= x; the loop compiles to conditional moves
+  double const* base(x_.data());
+  unsigned len(nP);
+  while (len > 1) {
+    unsigned half(len / 2);
+    base = (base[half] <= _x) ? base + half : base;
+    len -= half;
+  }
+
+  return base - x_.data();
+}
@@ -0,0 +1,311 @@
+#include "../interface/HistogramBuffer.h"
+
+#include <stdexcept>
+#include <algorithm>
+
+multidraw::HistogramBuffer::HistogramBuffer(TObject const& _obj, bool _categorized, unsigned _interleave/* = 1*/) :
+  interleave_(_interleave),
+  statOverflows_(TH1::GetStatOverflows())
+{
+  auto addCategory([this](TH1 const& _hist) {
+      categories_.emplace_back();
+      categories_.back().xaxis = AxisLookup(*_hist.GetXaxis());
+      if (_hist.GetDimension() > 1)
+        categories_.back().yaxis = AxisLookup(*_hist.GetYaxis());
+      categories_.back().nCells = _hist.GetNcells();
+    });
+
+  if (_categorized) {
+    for (auto* obj : static_cast<TObjArray const&>(_obj))
+      addCategory(static_cast<TH1 const&>(*obj));
+  }
+  else
+    addCategory(static_cast<TH1 const&>(_obj));
+
+  if (interleave_ == 0 || categories_.size() % interleave_ != 0)
+    throw std::runtime_error(TString::Format("HistogramBuffer: %d histograms cannot be interleaved in groups of %d", int(categories_.size()), interleave_).Data());
+
+  unsigned offset(0);
+  for (unsigned first(0); first < categories_.size(); first += interleave_) {
+    unsigned nCells(categories_[first].nCells);
+    for (unsigned iV(0); iV != interleave_; ++iV) {
+      auto& cat(categories_[first + iV]);
+      if (cat.nCells != nCells)
+        throw std::runtime_error("HistogramBuffer: interleaved histograms must have the same binning");
+
+      cat.offset = offset + iV;
+      cat.stride = interleave_;
+    }
+    offset += nCells * interleave_;
+  }
+
+  bins_.assign(2 * offset, 0.);
+}
+
+/*static*/
+bool
+multidraw::HistogramBuffer::canBuffer(TObject const& _obj, bool _categorized)
+{
+  auto check([](TObject const* _o)->bool {
+      if (_o == nullptr || !_o->InheritsFrom(TH1::Class()))
+        return false;
+
+      auto& hist(static_cast<TH1 const&>(*_o));
+      // profiles have different Fill semantics
+      if (hist.GetDimension() > 2 || hist.InheritsFrom("TProfile") || hist.InheritsFrom("TProfile2D"))
+        return false;
+      // FindFixBin does not work for extendable axes
+      if (hist.CanExtendAllAxes() || hist.GetXaxis()->CanExtend() || hist.GetYaxis()->CanExtend())
+        return false;
+      // automatic binning (xmin >= xmax) is set by TH1::BufferEmpty from the first filled values
+      if (hist.GetXaxis()->GetXmin() >= hist.GetXaxis()->GetXmax())
+        return false;
+      if (hist.GetDimension() > 1 && hist.GetYaxis()->GetXmin() >= hist.GetYaxis()->GetXmax())
+        return false;
+
+      return true;
+    });
+
+  if (_categorized) {
+    for (auto* obj : static_cast<TObjArray const&>(_obj)) {
+      if (!check(obj))
+        return false;
+    }
+    return true;
+  }
+  else
+    return check(&_obj);
+}
+
+void
+multidraw::HistogramBuffer::fill(unsigned _icat, double _x, double _w)
+{
+  auto& cat(categories_.at(_icat));
+
+  int bin(cat.xaxis.findBin(_x));
+
+  double* cell(&bins_[2 * (cat.offset + bin * cat.stride)]);
+  cell[0] += _w;
+  cell[1] += _w * _w;
+
+  addStats_(cat, bin, _x, _w);
+}
+
+void
+multidraw::HistogramBuffer::fill(unsigned _icat, double _x, double _y, double _w)
+{
+  auto& cat(categories_.at(_icat));
+
+  int binx(cat.xaxis.findBin(_x));
+  int biny(cat.yaxis.findBin(_y));
+  // TH1::GetBin for 2D
+  int bin(binx + (cat.xaxis.nbins + 2) * biny);
+
+  double* cell(&bins_[2 * (cat.offset + bin * cat.stride)]);
+  cell[0] += _w;
+  cell[1] += _w * _w;
+
+  addStats_(cat, binx, biny, _x, _y, _w);
+}
+
+void
+multidraw::HistogramBuffer::fillVariations(unsigned _firstCat, double _x, double _w, double const* _factors)
+{
+  auto& first(categories_.at(_firstCat));
+
+  int bin(first.xaxis.findBin(_x));
+
+  // cells of the group are adjacent
+  double* cells(&bins_[2 * (first.offset + bin * first.stride)]);
+  for (unsigned iV(0); iV != interleave_; ++iV) {
+    double w(_w * _factors[iV]);
+    cells[2 * iV] += w;
+    cells[2 * iV + 1] += w * w;
+  }
+
+  for (unsigned iV(0); iV != interleave_; ++iV)
+    addStats_(categories_[_firstCat + iV], bin, _x, _w * _factors[iV]);
+}
+
+void
+multidraw::HistogramBuffer::fillVariations(unsigned _firstCat, double _x, double _y, double _w, double const* _factors)
+{
+  auto& first(categories_.at(_firstCat));
+
+  int binx(first.xaxis.findBin(_x));
+  int biny(first.yaxis.findBin(_y));
+  int bin(binx + (first.xaxis.nbins + 2) * biny);
+
+  double* cells(&bins_[2 * (first.offset + bin * first.stride)]);
+  for (unsigned iV(0); iV != interleave_; ++iV) {
+    double w(_w * _factors[iV]);
+    cells[2 * iV] += w;
+    cells[2 * iV + 1] += w * w;
+  }
+
+  for (unsigned iV(0); iV != interleave_; ++iV)
+    addStats_(categories_[_firstCat + iV], binx, biny, _x, _y, _w * _factors[iV]);
+}
+
+void
+multidraw::HistogramBuffer::addStats_(Category& _cat, int _bin, double _x, double _w)
+{
+  _cat.entries += 1.;
+  if (_w != 1.)
+    _cat.weighted = true;
+
+  if ((_bin == 0 || _bin > _cat.xaxis.nbins) && !statOverflows_)
+    return;
+
+  _cat.stats[0] += _w;
+  _cat.stats[1] += _w * _w;
+  _cat.stats[2] += _w * _x;
+  _cat.stats[3] += _w * _x * _x;
+}
+
+void
+multidraw::HistogramBuffer::addStats_(Category& _cat, int _binx, int _biny, double _x, double _y, double _w)
+{
+  _cat.entries += 1.;
+  if (_w != 1.)
+    _cat.weighted = true;
+
+  if (!statOverflows_) {
+    if (_binx == 0 || _binx > _cat.xaxis.nbins || _biny == 0 || _biny > _cat.yaxis.nbins)
+      return;
+  }
+
+  _cat.stats[0] += _w;
+  _cat.stats[1] += _w * _w;
+  _cat.stats[2] += _w * _x;
+  _cat.stats[3] += _w * _x * _x;
+  _cat.stats[4] += _w * _y;
+  _cat.stats[5] += _w * _y * _y;
+  _cat.stats[6] += _w * _x * _y;
+}
+
+void
+multidraw::HistogramBuffer::add(HistogramBuffer const& _other)
+{
+  if (_other.bins_.size() != bins_.size() || _other.categories_.size() != categories_.size())
+    throw std::runtime_error("HistogramBuffer::add: incompatible buffers");
+
+  double* dest(bins_.data());
+  double const* src(_other.bins_.data());
+  unsigned n(bins_.size());
+  for (unsigned i(0); i != n; ++i)
+    dest[i] += src[i];
+
+  for (unsigned icat(0); icat != categories_.size(); ++icat) {
+    auto& cat(categories_[icat]);
+    auto& ocat(_other.categories_[icat]);
+
+    cat.entries += ocat.entries;
+    cat.weighted = cat.weighted || ocat.weighted;
+    for (unsigned iS(0); iS != kNStats; ++iS)
+      cat.stats[iS] += ocat.stats[iS];
+  }
+}
+
+void
+multidraw::HistogramBuffer::serialize(double* _dest) const
+{
+  for (auto& cat : categories_) {
+    *(_dest++) = cat.entries;
+    *(_dest++) = cat.weighted ? 1. : 0.;
+    for (unsigned iS(0); iS != kNStats; ++iS)
+      *(_dest++) = cat.stats[iS];
+  }
+
+  std::copy(bins_.begin(), bins_.end(), _dest);
+}
+
+void
+multidraw::HistogramBuffer::addSerialized(double const* _src)
+{
+  for (auto& cat : categories_) {
+    cat.entries += *(_src++);
+    cat.weighted = cat.weighted || *(_src++) != 0.;
+    for (unsigned iS(0); iS != kNStats; ++iS)
+      cat.stats[iS] += *(_src++);
+  }
+
+  double* dest(bins_.data());
+  unsigned n(bins_.size());
+  for (unsigned i(0); i != n; ++i)
+    dest[i] += _src[i];
+}
+
+void
+multidraw::HistogramBuffer::writeTo(TObject& _obj, bool _categorized) const
+{
+  if (_categorized) {
+    auto& array(static_cast<TObjArray&>(_obj));
+    for (unsigned icat(0); icat != categories_.size(); ++icat)
+      writeTo_(static_cast<TH1&>(*array.UncheckedAt(icat)), categories_[icat]);
+  }
+  else
+    writeTo_(static_cast<TH1&>(_obj), categories_[0]);
+}
+
+void
+multidraw::HistogramBuffer::writeTo_(TH1& _hist, Category const& _cat) const
+{
+  if (_cat.entries == 0.)
+    return;
+
+  // Take the current statistics before touching the bin contents (GetStats may compute them from the bins)
+  double stats[13]{};
+  _hist.GetStats(stats);
+  double entries(_hist.GetEntries());
+
+  // TH1::Fill with w != 1 switches on Sumw2
+  if (_cat.weighted && _hist.GetSumw2N() == 0)
+    _hist.Sumw2();
+
+  double* sumw2(_hist.GetSumw2N() == 0 ? nullptr : _hist.GetSumw2()->fArray);
+
+  for (unsigned iC(0); iC != _cat.nCells; ++iC) {
+    double const* cell(&bins_[2 * (_cat.offset + iC * _cat.stride)]);
+    if (cell[0] == 0. && cell[1] == 0.)
+      continue;
+
+    _hist.AddBinContent(iC, cell[0]);
+    if (sumw2 != nullptr)
+      sumw2[iC] += cell[1];
+  }
+
+  for (unsigned iS(0); iS != kNStats; ++iS)
+    stats[iS] += _cat.stats[iS];
+
+  _hist.PutStats(stats);
+  _hist.SetEntries(entries + _cat.entries);
+}
+
+void
+multidraw::HistogramBufferReducer::reduce(HistogramBufferPtr&& _buffer)
+{
+  HistogramBufferPtr buffer(std::move(_buffer));
+
+  while (buffer) {
+    HistogramBufferPtr other;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (!pending_) {
+        pending_ = std::move(buffer);
+        return;
+      }
+      other = std::move(pending_);
+    }
+
+    // merge outside the lock; other threads can pair up meanwhile
+    buffer->add(*other);
+  }
+}
+
+multidraw::HistogramBufferPtr
+multidraw::HistogramBufferReducer::release()
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return std::move(pending_);
+}
@@ -0,0 +1,96 @@
+#include "../interface/HistogramLookup.h"
+
+#include "TArrayD.h"
+
+#include <stdexcept>
+#include <cmath>
+
+multidraw::AxisLookup::AxisLookup(TAxis const& _axis) :
+  nbins(_axis.GetNbins()),
+  xmin(_axis.GetXmin()),
+  xmax(_axis.GetXmax())
+{
+  if (_axis.IsVariableBinSize()) {
+    auto* xbins(_axis.GetXbins());
+    edges.assign(xbins->GetArray(), xbins->GetArray() + nbins + 1);
+    return;
+  }
+
+  // Index arithmetic and TAxis can disagree right at the bin edges, depending on rounding and on the ROOT
+  // version (newer versions correct the bin against GetBinLowEdge). Probe the edges and fall back to the
+  // binary search over the edges as TAxis reports them if there is any difference.
+  for (int iB(1); iB <= nbins + 1; ++iB) {
+    double edge(_axis.GetBinLowEdge(iB));
+    for (double x : {std::nextafter(edge, -HUGE_VAL), edge, std::nextafter(edge, HUGE_VAL)}) {
+      if (findBin(x) == _axis.FindFixBin(x))
+        continue;
+
+      edges.resize(nbins + 1);
+      for (int iE(0); iE != nbins; ++iE)
+        edges[iE] = _axis.GetBinLowEdge(iE + 1);
+      edges[nbins] = xmax;
+      return;
+    }
+  }
+}
+
+int
+multidraw::AxisLookup::findBin(double _x) const
+{
+  if (_x < xmin)
+    return 0;
+  if (!(_x < xmax)) // also catches NaN, as TAxis does
+    return nbins + 1;
+
+  if (edges.empty())
+    return 1 + int(nbins * (_x - xmin) / (xmax - xmin));
+
+  // Largest edge index with edges[i] <= x; the loop compiles to conditional moves
+  double const* base(edges.data());
+  unsigned len(nbins + 1);
+  while (len > 1) {
+    unsigned half(len / 2);
+    base = (base[half] <= _x) ? base + half : base;
+    len -= half;
+  }
+
+  return int(base - edges.data()) + 1;
+}
+
+int
+multidraw::AxisLookup::findBinClamped(double _x) const
+{
+  int bin(findBin(_x));
+  if (bin < 1)
+    return 1;
+  if (bin > nbins)
+    return nbins;
+  return bin;
+}
+
+multidraw::HistogramLookup::HistogramLookup(TH1 const& _hist) :
+  ndim_(_hist.GetDimension()),
+  xaxis_(*_hist.GetXaxis())
+{
+  if (ndim_ > 2)
+    throw std::runtime_error(TString::Format("Histogram %s with dimension %d cannot be used for lookup", _hist.GetName(), ndim_).Data());
+
+  if (ndim_ == 2)
+    yaxis_ = AxisLookup(*_hist.GetYaxis());
+
+  contents_.resize(_hist.GetNcells());
+  for (unsigned iC(0); iC != contents_.size(); ++iC)
+    contents_[iC] = _hist.GetBinContent(iC);
+}
+
+double
+multidraw::HistogramLookup::getValue(double _x, double _y, bool _clamp) const
+{
+  int binx(_clamp ? xaxis_.findBinClamped(_x) : xaxis_.findBin(_x));
+  if (ndim_ == 1)
+    return contents_[binx];
+
+  int biny(_clamp ? yaxis_.findBinClamped(_y) : yaxis_.findBin(_y));
+  // TH1::GetBin for 2D
+  return contents_[binx + (xaxis_.nbins + 2) * biny];
+}
@@ -0,0 +1,158 @@
+#include "../interface/InputIndex.h"
+
+#include "TSystem.h"
+#include "TFile.h"
+#include "TTree.h"
+
+#include <fstream>
+#include <sstream>
+#include <memory>
+
+multidraw::InputIndex::InputIndex(char const* _path, char const* _treeName) :
+  path_(_path),
+  treeName_(_treeName)
+{
+  read_(records_);
+}
+
+bool
+multidraw::InputIndex::find(char const* _fileName, std::vector<Long64_t>& _boundaries) const
+{
+  auto rItr(records_.find(_fileName));
+  if (rItr == records_.end())
+    return false;
+
+  Long64_t size(0);
+  Long_t mtime(0);
+  if (!stat_(_fileName, size, mtime))
+    return false;
+
+  if (size != rItr->second.size || mtime != rItr->second.mtime)
+    return false;
+
+  _boundaries = rItr->second.boundaries;
+  return true;
+}
+
+void
+multidraw::InputIndex::update(char const* _fileName, std::vector<Long64_t> const& _boundaries)
+{
+  Record record;
+  if (!stat_(_fileName, record.size, record.mtime))
+    return;
+
+  record.boundaries = _boundaries;
+  records_[_fileName] = record;
+  updated_ = true;
+}
+
+void
+multidraw::InputIndex::save()
+{
+  if (!updated_)
+    return;
+
+  // Keep the records of other trees and of files added by other jobs
+  RecordMap records;
+  read_(records);
+  for (auto& rec : records_)
+    records[rec.first] = rec.second;
+
+  TString tmpPath(path_ + TString::Format(".tmp%d", gSystem->GetPid()));
+
+  std::ofstream out(tmpPath.Data());
+  if (!out)
+    return;
+
+  // Lines of other trees are copied verbatim
+  std::ifstream in(path_.Data());
+  std::string line;
+  while (std::getline(in, line)) {
+    std::istringstream ss(line);
+    std::string fileName, treeName;
+    ss >> fileName >> treeName;
+    if (treeName != treeName_.Data())
+      out << line << std::endl;
+  }
+
+  for (auto& rec : records) {
+    out << rec.first << " " << treeName_ << " " << rec.second.size << " " << rec.second.mtime << " ";
+    for (unsigned iB(0); iB != rec.second.boundaries.size(); ++iB) {
+      if (iB != 0)
+        out << ",";
+      out << rec.second.boundaries[iB];
+    }
+    out << std::endl;
+  }
+
+  out.close();
+
+  if (!out || gSystem->Rename(tmpPath, path_) != 0)
+    gSystem->Unlink(tmpPath);
+  else
+    updated_ = false;
+}
+
+/*static*/
+bool
+multidraw::InputIndex::scan(char const* _fileName, char const* _treeName, std::vector<Long64_t>& _boundaries)
+{
+  std::unique_ptr<TFile> source(TFile::Open(_fileName));
+  if (!source || source->IsZombie())
+    return false;
+
+  auto* tree(dynamic_cast<TTree*>(source->Get(_treeName)));
+  if (tree == nullptr)
+    return false;
+
+  _boundaries.clear();
+
+  Long64_t nEntries(tree->GetEntries());
+  auto clusterItr(tree->GetClusterIterator(0));
+  Long64_t start;
+  while ((start = clusterItr()) < nEntries)
+    _boundaries.push_back(start);
+  _boundaries.push_back(nEntries);
+
+  return true;
+}
+
+void
+multidraw::InputIndex::read_(RecordMap& _records) const
+{
+  std::ifstream in(path_.Data());
+  std::string line;
+  while (std::getline(in, line)) {
+    std::istringstream ss(line);
+    std::string fileName, treeName, boundaries;
+    Record record;
+    if (!(ss >> fileName >> treeName >> record.size >> record.mtime >> boundaries))
+      continue;
+
+    if (treeName != treeName_.Data())
+      continue;
+
+    std::istringstream bs(boundaries);
+    std::string value;
+    while (std::getline(bs, value, ','))
+      record.boundaries.push_back(std::stoll(value));
+
+    if (record.boundaries.empty())
+      continue;
+
+    _records[fileName] = record;
+  }
+}
+
+/*static*/
+bool
+multidraw::InputIndex::stat_(char const* _fileName, Long64_t& _size, Long_t& _mtime)
+{
+  FileStat_t st;
+  if (gSystem->GetPathInfo(_fileName, st) != 0)
+    return false;
+
+  _size = st.fSize;
+  _mtime = st.fMtime;
+  return true;
+}
@@ -1,11 +1,23 @@
+#include "LatinoAnalysis/MultiDraw/interface/AliasCache.h"
+#include "LatinoAnalysis/MultiDraw/interface/AliasStore.h"
 #include "LatinoAnalysis/MultiDraw/interface/CompiledExpr.h"
 #include "LatinoAnalysis/MultiDraw/interface/Cut.h"
+#include "LatinoAnalysis/MultiDraw/interface/CutAtomLibrary.h"
+#include "LatinoAnalysis/MultiDraw/interface/CutCache.h"
 #include "LatinoAnalysis/MultiDraw/interface/ExprFiller.h"
+#include "LatinoAnalysis/MultiDraw/interface/ExprGraph.h"
+#include "LatinoAnalysis/MultiDraw/interface/ExprParser.h"
+#include "LatinoAnalysis/MultiDraw/interface/FormulaCompiler.h"
 #include "LatinoAnalysis/MultiDraw/interface/FormulaLibrary.h"
 #include "LatinoAnalysis/MultiDraw/interface/FunctionLibrary.h"
+#include "LatinoAnalysis/MultiDraw/interface/GraphInterpolator.h"
+#include "LatinoAnalysis/MultiDraw/interface/HistogramBuffer.h"
+#include "LatinoAnalysis/MultiDraw/interface/HistogramLookup.h"
+#include "LatinoAnalysis/MultiDraw/interface/InputIndex.h"
 #include "LatinoAnalysis/MultiDraw/interface/MultiDraw.h"
 #include "LatinoAnalysis/MultiDraw/interface/Plot1DFiller.h"
 #include "LatinoAnalysis/MultiDraw/interface/Plot2DFiller.h"
+#include "LatinoAnalysis/MultiDraw/interface/Profiler.h"
 #include "LatinoAnalysis/MultiDraw/interface/Reweight.h"
 #include "LatinoAnalysis/MultiDraw/interface/TTreeFormulaCached.h"
 #include "LatinoAnalysis/MultiDraw/interface/TTreeFunction.h"
@@ -19,18 +31,36 @@
 #pragma link C++ nestedtypedef;
 
 #pragma link C++ namespace multidraw;
+#pragma link C++ class multidraw::AliasCache-;
+#pragma link C++ class multidraw::AliasStore-;
 #pragma link C++ class multidraw::CompiledExprSource-;
 #pragma link C++ class multidraw::CompiledExpr-;
 #pragma link C++ class multidraw::Cut-;
+#pragma link C++ class multidraw::CutAtomLibrary-;
+#pragma link C++ class multidraw::CutCache-;
 #pragma link C++ class multidraw::ExprFiller-;
+#pragma link C++ class multidraw::ExprGraph-;
+#pragma link C++ class multidraw::ExprParser-;
+#pragma link C++ class multidraw::FormulaCompiler-;
 #pragma link C++ class multidraw::FormulaLibrary-;
 #pragma link C++ class multidraw::TTreeReaderObjectWrapper-;
 #pragma link C++ class multidraw::TTreeReaderArrayWrapper-;
 #pragma link C++ class multidraw::TTreeReaderValueWrapper-;
+#pragma link C++ class multidraw::ColumnView-;
+#pragma link C++ class multidraw::ColumnSlot-;
+#pragma link C++ class multidraw::ArrayColumnSlot-;
+#pragma link C++ class multidraw::ValueColumnSlot-;
 #pragma link C++ class multidraw::FunctionLibrary-;
+#pragma link C++ class multidraw::GraphInterpolator-;
+#pragma link C++ class multidraw::HistogramBuffer-;
+#pragma link C++ class multidraw::HistogramBufferReducer-;
+#pragma link C++ class multidraw::AxisLookup-;
+#pragma link C++ class multidraw::HistogramLookup-;
+#pragma link C++ class multidraw::InputIndex-;
 #pragma link C++ class multidraw::MultiDraw-;
 #pragma link C++ class multidraw::Plot1DFiller-;
 #pragma link C++ class multidraw::Plot2DFiller-;
+#pragma link C++ class multidraw::Profiler-;
 #pragma link C++ class multidraw::Reweight-;
 #pragma link C++ class multidraw::FactorizedReweight-;
 #pragma link C++ class multidraw::ReweightSource-;
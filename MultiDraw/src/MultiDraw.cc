@@ -1,6 +1,11 @@
 #include "../interface/MultiDraw.h"
 #include "../interface/FormulaLibrary.h"
 #include "../interface/FunctionLibrary.h"
+#include "../interface/AliasStore.h"
+#include "../interface/CutAtomLibrary.h"
+#include "../interface/InputIndex.h"
+#include "../interface/CutCache.h"
+#include "../interface/AliasCache.h"
 
 #include "TFile.h"
 #include "TBranch.h"
@@ -14,6 +19,12 @@
 #include "TEntryList.h"
 #include "TTreeFormulaManager.h"
 #include "TChainElement.h"
+#include "TSystem.h"
+#include "TFriendElement.h"
+#include "TTreeCache.h"
+#include "TTreeCacheUnzip.h"
+#include "TEnv.h"
+#include "TMD5.h"
 
 #include <stdexcept>
 #include <cstring>
@@ -24,6 +35,13 @@
 #include <numeric>
 #include <memory>
 #include <unordered_map>
+#include <deque>
+#include <set>
+
+#include <csignal>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
 multidraw::MultiDraw::MultiDraw(char const* _treeName/* = "events"*/) :
   treeName_{_treeName},
@@ -40,6 +58,8 @@ multidraw::MultiDraw::MultiDraw(MultiDraw const& _orig) :
   weightBranchName_{_orig.weightBranchName_},
   evtNumBranchName_{_orig.evtNumBranchName_},
   inputMultiplexing_{_orig.inputMultiplexing_},
+  processMultiplexing_{_orig.processMultiplexing_},
+  schedulingMode_{_orig.schedulingMode_},
   prescale_{_orig.prescale_},
   filter_(new Cut("", _orig.filter_->getCutExpr())),
   aliases_{_orig.aliases_},
@@ -49,11 +69,25 @@ multidraw::MultiDraw::MultiDraw(MultiDraw const& _orig) :
   printLevel_{_orig.printLevel_},
   doTimeProfile_{_orig.doTimeProfile_},
   doAbortOnReadError_{_orig.doAbortOnReadError_},
+  doCompileFormulas_{_orig.doCompileFormulas_},
+  formulaCacheDir_{_orig.formulaCacheDir_},
+  doShareSubexpressions_{_orig.doShareSubexpressions_},
+  doPruneBranches_{_orig.doPruneBranches_},
+  prefetchCacheSize_{_orig.prefetchCacheSize_},
+  doAsyncPrefetch_{_orig.doAsyncPrefetch_},
+  doParallelUnzip_{_orig.doParallelUnzip_},
+  inputIndexPath_{_orig.inputIndexPath_},
+  cutCacheDir_{_orig.cutCacheDir_},
+  aliasCacheDir_{_orig.aliasCacheDir_},
+  profileOutput_{_orig.profileOutput_},
+  profileSampling_{_orig.profileSampling_},
   totalEvents_{_orig.totalEvents_}
 {
   for (auto const& ft : _orig.friendTrees_)
     addFriend(std::get<0>(ft), &std::get<1>(ft), std::get<2>(ft));
 
+  friendIndices_ = _orig.friendIndices_;
+
   for (auto const& cut : _orig.cuts_)
     addCut(cut.first, cut.second->getCutExpr());
 
@@ -62,6 +96,9 @@ multidraw::MultiDraw::MultiDraw(MultiDraw const& _orig) :
 
   for (auto const& source : _orig.treeReweightSources_)
     setTreeReweight(source.first, source.second.second, *source.second.first);
+
+  for (auto const& v : _orig.variations_)
+    variations_.emplace_back(v.first, std::make_unique<MultiDraw>(*v.second));
 }
 
 multidraw::MultiDraw::~MultiDraw()
@@ -78,6 +115,12 @@ multidraw::MultiDraw::addFriend(char const* _treeName, TObjArray const* _paths,
     std::get<1>(ft).Add(path->Clone());
 }
 
+void
+multidraw::MultiDraw::setFriendIndex(char const* _alias, char const* _major, char const* _minor/* = "0"*/)
+{
+  friendIndices_[_alias] = std::make_pair(TString(_major), TString(_minor));
+}
+
 void
 multidraw::MultiDraw::setGoodRunBranches(char const* bname1, char const* bname2/* = ""*/)
 {
@@ -252,6 +295,30 @@ multidraw::MultiDraw::addPlotList2D(TObjArray* _histlist, TTreeFunction const& _
   return addPlotList2D_(_histlist, CompiledExprSource(_xfunc), CompiledExprSource(_yfunc), _cutName, _reweight);
 }
 
+multidraw::Plot1DFiller&
+multidraw::MultiDraw::addPlotVariations(TObjArray* _histlist, char const* _expr, char const* _cutName/* = ""*/, char const* _reweight/* = ""*/, Plot1DFiller::OverflowMode _overflowMode/* = kDefault*/)
+{
+  return addPlotVariations_(_histlist, CompiledExprSource(_expr), _cutName, _reweight, _overflowMode);
+}
+
+multidraw::Plot1DFiller&
+multidraw::MultiDraw::addPlotVariations(TObjArray* _histlist, TTreeFunction const& _func, char const* _cutName/* = ""*/, char const* _reweight/* = ""*/, Plot1DFiller::OverflowMode _overflowMode/* = kDefault*/)
+{
+  return addPlotVariations_(_histlist, CompiledExprSource(_func), _cutName, _reweight, _overflowMode);
+}
+
+multidraw::Plot2DFiller&
+multidraw::MultiDraw::addPlotVariations2D(TObjArray* _histlist, char const* _xexpr, char const* _yexpr, char const* _cutName/* = ""*/, char const* _reweight/* = ""*/)
+{
+  return addPlotVariations2D_(_histlist, CompiledExprSource(_xexpr), CompiledExprSource(_yexpr), _cutName, _reweight);
+}
+
+multidraw::Plot2DFiller&
+multidraw::MultiDraw::addPlotVariations2D(TObjArray* _histlist, TTreeFunction const& _xfunc, TTreeFunction const& _yfunc, char const* _cutName/* = ""*/, char const* _reweight/* = ""*/)
+{
+  return addPlotVariations2D_(_histlist, CompiledExprSource(_xfunc), CompiledExprSource(_yfunc), _cutName, _reweight);
+}
+
 multidraw::TreeFiller&
 multidraw::MultiDraw::addTree(TTree* _tree, char const* _cutName/* = ""*/, char const* _reweight/* = ""*/)
 {
@@ -306,6 +373,27 @@ multidraw::MultiDraw::resetReplaceBranch(char const* original)
     branchReplacements_.erase(itr);
 }
 
+multidraw::MultiDraw&
+multidraw::MultiDraw::addVariation(char const* _name)
+{
+  if (_name == nullptr || std::strlen(_name) == 0)
+    throw std::invalid_argument("Cannot add a variation with no name");
+
+  for (auto& v : variations_) {
+    if (v.first == _name) {
+      std::stringstream ss;
+      ss << "Variation named " << _name << " already exists";
+      std::cerr << ss.str() << std::endl;
+      throw std::invalid_argument(ss.str());
+    }
+  }
+
+  variations_.emplace_back(_name, std::make_unique<MultiDraw>(treeName_));
+  variations_.back().second->setPrintLevel(printLevel_);
+
+  return *variations_.back().second;
+}
+
 multidraw::Cut&
 multidraw::MultiDraw::findCut_(char const* _cutName) const
 {
@@ -428,28 +516,471 @@ multidraw::MultiDraw::addPlotList2D_(TObjArray* _histlist, CompiledExprSource co
   return *filler;
 }
 
+multidraw::Plot1DFiller&
+multidraw::MultiDraw::addPlotVariations_(TObjArray* _histlist, CompiledExprSource const& _source, char const* _cutName/* = ""*/, char const* _reweight/* = ""*/, Plot1DFiller::OverflowMode _overflowMode/* = kDefault*/)
+{
+  if (printLevel_ > 1) {
+    std::cout << "\nAdding plot variations with ";
+    if (_source.getFormula().Length() != 0)
+      std::cout << "expression " << _source.getFormula() << std::endl;
+    else
+      std::cout << "function " << _source.getFunction()->getName() << std::endl;
+    if (_cutName != nullptr && std::strlen(_cutName) != 0)
+      std::cout << " Cut: " << _cutName << std::endl;
+    if (_reweight != nullptr && std::strlen(_reweight) != 0)
+      std::cout << " Reweight: " << _reweight << std::endl;
+  }
+
+  auto& cut(findCut_(_cutName));
+
+  int ncat(cut.getNCategories());
+  if (ncat > 0 && _histlist->GetEntries() % ncat != 0)
+    throw std::runtime_error("Size of histogram list is not a multiple of the number of categories");
+
+  auto* filler(new Plot1DFiller(*_histlist, _source, _reweight, _overflowMode));
+
+  cut.addFiller(std::unique_ptr<ExprFiller>(filler));
+
+  return *filler;
+}
+
+multidraw::Plot2DFiller&
+multidraw::MultiDraw::addPlotVariations2D_(TObjArray* _histlist, CompiledExprSource const& _xsource, CompiledExprSource const& _ysource, char const* _cutName/* = ""*/, char const* _reweight/* = ""*/)
+{
+  if (printLevel_ > 1) {
+    std::cout << "\nAdding plot variations with";
+    if (_xsource.getFormula().Length() != 0)
+      std::cout << " expression " << _ysource.getFormula() << ":" << _xsource.getFormula() << std::endl;
+    else
+      std::cout << " function " << _ysource.getFunction()->getName() << ":" << _xsource.getFunction()->getName() << std::endl;
+    if (_cutName != nullptr && std::strlen(_cutName) != 0)
+      std::cout << " Cut: " << _cutName << std::endl;
+    if (_reweight != nullptr && std::strlen(_reweight) != 0)
+      std::cout << " Reweight: " << _reweight << std::endl;
+  }
+
+  auto& cut(findCut_(_cutName));
+
+  int ncat(cut.getNCategories());
+  if (ncat > 0 && _histlist->GetEntries() % ncat != 0)
+    throw std::runtime_error("Size of histogram list is not a multiple of the number of categories");
+
+  auto* filler(new Plot2DFiller(*_histlist, _xsource, _ysource, _reweight));
+
+  cut.addFiller(std::unique_ptr<ExprFiller>(filler));
+
+  return *filler;
+}
+
 unsigned
 multidraw::MultiDraw::numObjs() const
 {
   unsigned n(filter_->getNFillers());
   for (auto& namecut : cuts_)
     n += namecut.second->getNFillers();
+  for (auto& v : variations_)
+    n += v.second->numObjs();
   return n;
 }
 
+//! Per-thread double-ended queues of entry ranges
+/*
+ * Each thread pops ranges from the front of its own queue. A thread whose queue is empty steals from the back
+ * of the queue with the most remaining entries, i.e. from the part of the input its owner would reach last.
+ * The remaining-entries counters are only modified under the lock of the corresponding queue.
+ */
+struct multidraw::MultiDraw::EntryRangeQueues {
+  EntryRangeQueues(unsigned nQueues) : queues(nQueues), mutexes(nQueues), remaining(nQueues) {
+    for (auto& r : remaining)
+      r.store(0);
+  }
+
+  void push(unsigned iQ, long long first, long long last) {
+    queues[iQ].emplace_back(first, last);
+    remaining[iQ] += last - first;
+  }
+
+  bool pop(unsigned iQ, long long& first, long long& last) {
+    {
+      std::lock_guard<std::mutex> lock(mutexes[iQ]);
+      if (!queues[iQ].empty()) {
+        std::tie(first, last) = queues[iQ].front();
+        queues[iQ].pop_front();
+        remaining[iQ] -= last - first;
+        return true;
+      }
+    }
+
+    while (true) {
+      unsigned victim(queues.size());
+      long long maxRemaining(0);
+      for (unsigned jQ(0); jQ != queues.size(); ++jQ) {
+        long long r(remaining[jQ].load());
+        if (r > maxRemaining) {
+          victim = jQ;
+          maxRemaining = r;
+        }
+      }
+
+      if (victim == queues.size())
+        return false;
+
+      std::lock_guard<std::mutex> lock(mutexes[victim]);
+      // The owner may have emptied the queue in the meantime
+      if (queues[victim].empty())
+        continue;
+
+      std::tie(first, last) = queues[victim].back();
+      queues[victim].pop_back();
+      remaining[victim] -= last - first;
+      return true;
+    }
+  }
+
+  std::vector<std::deque<std::pair<long long, long long>>> queues;
+  std::vector<std::mutex> mutexes;
+  std::vector<std::atomic_llong> remaining;
+  //! Number of entries in each file, used to create TChains with known tree offsets
+  std::vector<Long64_t> fileEntries{};
+};
+
+std::unique_ptr<multidraw::MultiDraw::EntryRangeQueues>
+multidraw::MultiDraw::makeEntryRangeQueues_(std::vector<TString> const& _fileNames, long _nEntries, unsigned long _firstEntry) const
+{
+  unsigned nFiles(_fileNames.size());
+
+  // Cluster boundaries of each file. The last element of each vector is the number of entries.
+  std::vector<std::vector<Long64_t>> clusterBoundaries;
+  if (!readClusterBoundaries_(_fileNames, clusterBoundaries)) {
+    // TChain would skip the file and shift the tree numbers; let the static scheduler deal with it
+    if (printLevel_ >= 0)
+      std::cerr << "Could not read the cluster structure of all input files. Falling back to static scheduling." << std::endl;
+    return nullptr;
+  }
+
+  std::unique_ptr<EntryRangeQueues> rangeQueues(new EntryRangeQueues(inputMultiplexing_));
+
+  Long64_t firstEntry(_firstEntry);
+  Long64_t lastEntry(0);
+  for (auto& boundaries : clusterBoundaries) {
+    rangeQueues->fileEntries.push_back(boundaries.back());
+    lastEntry += boundaries.back();
+  }
+
+  if (_nEntries >= 0 && firstEntry + _nEntries < lastEntry)
+    lastEntry = firstEntry + _nEntries;
+
+  if (lastEntry <= firstEntry)
+    return rangeQueues;
+
+  // Seed the queues with contiguous blocks of clusters so that each thread reads its own set of files
+  unsigned long long nTotal(lastEntry - firstEntry);
+  unsigned nRanges(0);
+  Long64_t offset(0);
+  for (auto& boundaries : clusterBoundaries) {
+    for (unsigned iC(0); iC < boundaries.size() - 1; ++iC) {
+      Long64_t first(std::max(offset + boundaries[iC], firstEntry));
+      Long64_t last(std::min(offset + boundaries[iC + 1], lastEntry));
+      if (first >= last)
+        continue;
+
+      unsigned iQ((first - firstEntry) * inputMultiplexing_ / nTotal);
+      rangeQueues->push(iQ, first, last);
+      ++nRanges;
+    }
+    offset += boundaries.back();
+  }
+
+  if (printLevel_ > 0) {
+    std::cout << "Scheduling " << nTotal << " events in " << nRanges << " clusters from " << nFiles;
+    std::cout << " files over " << inputMultiplexing_ << " threads" << std::endl;
+  }
+
+  return rangeQueues;
+}
+
+bool
+multidraw::MultiDraw::readClusterBoundaries_(std::vector<TString> const& _fileNames, std::vector<std::vector<Long64_t>>& _boundaries) const
+{
+  unsigned nFiles(_fileNames.size());
+
+  _boundaries.assign(nFiles, std::vector<Long64_t>());
+
+  std::unique_ptr<InputIndex> index{};
+  std::vector<unsigned> toScan;
+  if (inputIndexPath_.Length() != 0) {
+    index.reset(new InputIndex(inputIndexPath_, treeName_));
+    for (unsigned iF(0); iF != nFiles; ++iF) {
+      if (!index->find(_fileNames[iF], _boundaries[iF]))
+        toScan.push_back(iF);
+    }
+  }
+  else {
+    toScan.resize(nFiles);
+    std::iota(toScan.begin(), toScan.end(), 0);
+  }
+
+  if (index && printLevel_ > 0)
+    std::cout << "Input index " << inputIndexPath_ << ": " << (nFiles - toScan.size()) << "/" << nFiles << " files found" << std::endl;
+
+  std::atomic_bool allOpened(true);
+  std::atomic_uint nextFile(0);
+
+  // Opening the files is the slow part - distribute it over the threads
+  auto scanTask([this, &_fileNames, &toScan, &_boundaries, &allOpened, &nextFile]() {
+      unsigned iS;
+      while ((iS = nextFile++) < toScan.size()) {
+        unsigned iF(toScan[iS]);
+        if (!InputIndex::scan(_fileNames[iF], this->treeName_, _boundaries[iF]))
+          allOpened = false;
+      }
+    });
+
+  unsigned nThreads(std::max(inputMultiplexing_, processMultiplexing_));
+  std::vector<std::thread> scanThreads;
+  for (unsigned iT(1); iT < nThreads && iT < toScan.size(); ++iT)
+    scanThreads.emplace_back(scanTask);
+  scanTask();
+  for (auto& thread : scanThreads)
+    thread.join();
+
+  if (index && !toScan.empty()) {
+    for (unsigned iF : toScan) {
+      if (!_boundaries[iF].empty())
+        index->update(_fileNames[iF], _boundaries[iF]);
+    }
+    index->save();
+  }
+
+  return allOpened;
+}
+
+std::vector<multidraw::Cut const*>
+multidraw::MultiDraw::activeCuts_() const
+{
+  std::vector<Cut const*> cuts;
+  for (auto& namecut : cuts_) {
+    if (namecut.first.Length() != 0 && namecut.second->getNFillers() == 0)
+      continue;
+    cuts.push_back(namecut.second.get());
+  }
+  return cuts;
+}
+
+TString
+multidraw::MultiDraw::cutCacheKey_() const
+{
+  std::stringstream ss;
+
+  auto writeCut([&ss](Cut const& _cut) {
+      ss << "cut " << _cut.getName() << ": " << _cut.getCutExpr() << std::endl;
+      for (auto& expr : _cut.getCategoryExprs())
+        ss << " category " << expr << std::endl;
+      if (_cut.getCategorizationExpr().Length() != 0)
+        ss << " categorization " << _cut.getCategorizationExpr() << std::endl;
+    });
+
+  ss << "tree " << treeName_ << std::endl;
+
+  writeCut(*filter_);
+  for (auto* cut : activeCuts_())
+    writeCut(*cut);
+
+  for (auto& alias : aliases_) {
+    ss << "alias " << alias.first << ": ";
+    if (alias.second.getFunction() != nullptr) {
+      auto* function(alias.second.getFunction());
+      // cuts may depend on the alias; the results cannot be identified
+      if (function->getConfig() == nullptr)
+        return "";
+      ss << "function " << function->getName() << " " << function->getConfig() << std::endl;
+    }
+    else
+      ss << alias.second.getFormula() << std::endl;
+  }
+
+  if (goodRunBranch_[0].Length() != 0) {
+    ss << "goodruns " << goodRunBranch_[0] << " " << goodRunBranch_[1] << std::endl;
+    for (auto& rl : goodRuns_) {
+      ss << " " << rl.first << ":";
+      for (unsigned lumi : rl.second)
+        ss << " " << lumi;
+      ss << std::endl;
+    }
+  }
+
+  if (prescale_ > 1)
+    ss << "prescale " << prescale_ << " " << evtNumBranchName_ << std::endl;
+
+  for (auto& rep : branchReplacements_)
+    ss << "replace " << rep.first << " " << rep.second << std::endl;
+
+  for (auto& ft : friendTrees_) {
+    ss << "friend " << std::get<0>(ft) << " " << std::get<2>(ft);
+    for (auto* path : std::get<1>(ft))
+      ss << " " << path->GetTitle();
+    ss << std::endl;
+  }
+
+  for (auto& fi : friendIndices_)
+    ss << "friendindex " << fi.first << " " << fi.second.first << " " << fi.second.second << std::endl;
+
+  return ss.str().c_str();
+}
+
+std::vector<TString>
+multidraw::MultiDraw::aliasCacheKeys_(char const* _parentKey/* = ""*/) const
+{
+  std::stringstream ss;
+
+  ss << "parent " << _parentKey << std::endl;
+  ss << "tree " << treeName_ << std::endl;
+
+  for (auto& ft : friendTrees_) {
+    ss << "friend " << std::get<0>(ft) << " " << std::get<2>(ft);
+    for (auto* path : std::get<1>(ft))
+      ss << " " << path->GetTitle();
+    ss << std::endl;
+  }
+
+  for (auto& fi : friendIndices_)
+    ss << "friendindex " << fi.first << " " << fi.second.first << " " << fi.second.second << std::endl;
+
+  for (auto& rep : branchReplacements_)
+    ss << "replace " << rep.first << " " << rep.second << std::endl;
+
+  // Each alias may depend on the ones declared before it; an alias that cannot be identified leaves the
+  // keys of the following aliases empty as well
+  std::vector<TString> keys;
+  bool identified(true);
+  for (auto& alias : aliases_) {
+    ss << "alias " << alias.first << ": ";
+    if (alias.second.getFunction() != nullptr) {
+      auto* function(alias.second.getFunction());
+      if (function->getConfig() == nullptr)
+        identified = false;
+      else
+        ss << "function " << function->getName() << " " << function->getConfig() << std::endl;
+    }
+    else
+      ss << alias.second.getFormula() << std::endl;
+
+    if (!identified) {
+      keys.emplace_back("");
+      continue;
+    }
+
+    std::string definition(ss.str());
+
+    TMD5 md5;
+    md5.Update(reinterpret_cast<UChar_t const*>(definition.c_str()), definition.size());
+    md5.Final();
+
+    keys.emplace_back(md5.AsString());
+  }
+
+  return keys;
+}
+
 void
 multidraw::MultiDraw::execute(long _nEntries/* = -1*/, unsigned long _firstEntry/* = 0*/)
 {
   totalEvents_ = 0;
 
-  int abortLevel(gErrorAbortLevel);
+  profiler_.reset();
+  if (profileOutput_.Length() != 0) {
+    // The worker processes do not return their counters; a profile of the calling process alone would be misleading
+    if (processMultiplexing_ > 1) {
+      if (printLevel_ >= 0)
+        std::cerr << "Execution profile is not recorded with process multiplexing." << std::endl;
+    }
+    else
+      profiler_ = std::make_unique<Profiler>(profileSampling_);
+  }
+
+  cutCache_.reset();
+  if (cutCacheDir_.Length() != 0) {
+    if (!variations_.empty()) {
+      if (printLevel_ >= 0)
+        std::cerr << "Cut cache is not used with systematic variations." << std::endl;
+    }
+    else {
+      TString key(cutCacheKey_());
+      if (key.Length() != 0)
+        cutCache_ = std::make_unique<CutCache>(cutCacheDir_, key, 1 + activeCuts_().size());
+      else if (printLevel_ >= 0)
+        std::cerr << "Cut cache is not used with aliases of TTreeFunctions without a configuration string (TTreeFunction::getConfig)." << std::endl;
+    }
+  }
+
+  aliasCache_.reset();
+  if (aliasCacheDir_.Length() != 0 && !aliases_.empty())
+    aliasCache_ = std::make_unique<AliasCache>(aliasCacheDir_);
+
+  // Process-wide settings changed below are restored when execute() returns or throws
+  struct GlobalSettings {
+    ~GlobalSettings() {
+      gErrorAbortLevel = abortLevel;
+      TH1::AddDirectory(addDirectory);
+      if (prefetchChanged) {
+        gEnv->SetValue("TFile.AsyncPrefetching", asyncPrefetching);
+        TTreeCacheUnzip::SetParallelUnzip(parallelUnzip ? TTreeCacheUnzip::kEnable : TTreeCacheUnzip::kDisable);
+      }
+    }
+
+    int abortLevel{gErrorAbortLevel};
+    bool addDirectory{TH1::AddDirectoryStatus()};
+    int asyncPrefetching{gEnv->GetValue("TFile.AsyncPrefetching", 0)};
+    bool parallelUnzip{TTreeCacheUnzip::IsParallelUnzip()};
+    bool prefetchChanged{false};
+  } globalSettings;
+
   if (doAbortOnReadError_)
     gErrorAbortLevel = kError;
 
+  // Process-wide prefetching settings must be in place before the input files are opened
+  if (prefetchCacheSize_ > 0 && processMultiplexing_ > 1 && (doAsyncPrefetch_ || doParallelUnzip_)) {
+    // Prefetching and unzipping threads are not carried over by fork(); the read cache alone is used
+    if (printLevel_ >= 0)
+      std::cerr << "Asynchronous prefetching and parallel unzipping are disabled with process multiplexing." << std::endl;
+  }
+  else if (prefetchCacheSize_ > 0) {
+    globalSettings.prefetchChanged = true;
+    if (doAsyncPrefetch_)
+      gEnv->SetValue("TFile.AsyncPrefetching", 1);
+    if (doParallelUnzip_)
+      TTreeCacheUnzip::SetParallelUnzip(TTreeCacheUnzip::kEnable);
+  }
+
   TChain mainTree(treeName_);
 
-  for (auto& path : inputPaths_)
-    mainTree.Add(path);
+  // Numbers of entries of the input files, if known from the input index
+  std::vector<Long64_t> fileEntries;
+  if (inputIndexPath_.Length() != 0) {
+    // Expand the wildcards; adding a file without the number of entries does not open it
+    TChain expander(treeName_);
+    for (auto& path : inputPaths_)
+      expander.Add(path);
+
+    std::vector<TString> fileNames;
+    for (auto* elem : *expander.GetListOfFiles())
+      fileNames.emplace_back(elem->GetTitle());
+
+    std::vector<std::vector<Long64_t>> boundaries;
+    if (readClusterBoundaries_(fileNames, boundaries)) {
+      for (unsigned iF(0); iF != fileNames.size(); ++iF) {
+        fileEntries.push_back(boundaries[iF].back());
+        mainTree.Add(fileNames[iF], fileEntries.back());
+      }
+    }
+    else if (printLevel_ >= 0)
+      std::cerr << "Could not read the number of entries of all input files. Ignoring the input index." << std::endl;
+  }
+
+  if (fileEntries.empty()) {
+    for (auto& path : inputPaths_)
+      mainTree.Add(path);
+  }
 
   mainTree.SetEntryList(entryList_);
 
@@ -459,38 +990,81 @@ multidraw::MultiDraw::execute(long _nEntries/* = -1*/, unsigned long _firstEntry
   SynchTools synchTools;
   synchTools.mainThread = std::this_thread::get_id();
 
-  if (inputMultiplexing_ <= 1) {
-    // Single-thread execution
+  // Number of input files
+  unsigned nTrees(mainTree.GetNtrees());
+
+  // Friend trees of the variations are attached to the same chain
+  std::vector<std::tuple<TString, TObjArray, TString> const*> allFriendTrees;
+  std::map<TString, std::pair<TString, TString>> allFriendIndices(friendIndices_);
+  for (auto& ft : friendTrees_)
+    allFriendTrees.push_back(&ft);
+  for (auto& v : variations_) {
+    for (auto& ft : v.second->friendTrees_)
+      allFriendTrees.push_back(&ft);
+    allFriendIndices.insert(v.second->friendIndices_.begin(), v.second->friendIndices_.end());
+  }
+
+  // Attach the friend trees to a chain holding the input files [_firstFile, _endFile). Friends with an index
+  // are aligned through the index values and always get all their files. Otherwise the friend must consist
+  // of the same number of files as the input, and only the files with the same indices are attached.
+  auto attachFriends([&allFriendTrees, &allFriendIndices, &friendTrees, nTrees](TChain& _chain, unsigned _firstFile, unsigned _endFile) {
+      for (auto* ftp : allFriendTrees) {
+        auto& ft(*ftp);
+        TString const& ftName(std::get<0>(ft));
+        TString const& alias(std::get<2>(ft));
+
+        std::unique_ptr<TChain> chain(new TChain(ftName));
+        for (auto* path : std::get<1>(ft)) {
+          if (path->InheritsFrom(TChainElement::Class()))
+            chain->Add(path->GetTitle());
+          else
+            chain->Add(path->GetName());
+        }
 
-    for (auto& ft : friendTrees_) {
-      friendTrees.emplace_back(new TChain(std::get<0>(ft)));
-      auto& chain{friendTrees.back()};
+        auto iItr(allFriendIndices.find(alias.Length() == 0 ? ftName : alias));
+        if (iItr != allFriendIndices.end()) {
+          chain->BuildIndex(iItr->second.first, iItr->second.second);
+        }
+        else if (_firstFile != 0 || _endFile != nTrees) {
+          if (unsigned(chain->GetNtrees()) != nTrees) {
+            std::stringstream ss;
+            ss << "Friend tree " << ftName << " has " << chain->GetNtrees() << " files while the input has " << nTrees;
+            ss << "; cannot split the input over threads. Set an index with setFriendIndex or use a single thread.";
+            std::cerr << ss.str() << std::endl;
+            throw std::runtime_error(ss.str());
+          }
 
-      for (auto* path : std::get<1>(ft)) {
-        if (path->InheritsFrom(TChainElement::Class()))
-          chain->Add(path->GetTitle());
-        else
-          chain->Add(path->GetName());
+          std::unique_ptr<TChain> subset(new TChain(ftName));
+          auto& friendFiles(*chain->GetListOfFiles());
+          for (unsigned iS(_firstFile); iS != _endFile; ++iS)
+            subset->Add(friendFiles.At(iS)->GetTitle());
+
+          chain = std::move(subset);
+        }
+
+        _chain.AddFriend(chain.get(), alias);
+        friendTrees.push_back(std::move(chain));
       }
+    });
 
-      mainTree.AddFriend(chain.get(), std::get<2>(ft));
-    }
+  // Building a friend index opens the friend files; with process multiplexing, each process attaches the
+  // friends after the fork
+  if (processMultiplexing_ <= 1)
+    attachFriends(mainTree, 0, nTrees);
 
-    totalEvents_ = executeOne_(_nEntries, _firstEntry, mainTree, synchTools);
+  if (inputMultiplexing_ <= 1 || processMultiplexing_ > 1) {
+    // Single-thread execution (in each process if multiplexing processes)
+
+    if (processMultiplexing_ > 1) {
+      auto attachAll([&attachFriends, nTrees](TChain& _chain) { attachFriends(_chain, 0, nTrees); });
+      totalEvents_ = executeForked_(_nEntries, _firstEntry, mainTree, synchTools, attachAll);
+    }
+    else
+      totalEvents_ = executeOne_(_nEntries, _firstEntry, mainTree, synchTools);
   }
   else {
     // Multi-thread execution
 
-    if (!friendTrees_.empty()) {
-      std::stringstream ss;
-      ss << "MultiDraw does not know how to split the input by file when there are friend trees." << std::endl;
-      std::cerr << ss.str() << std::endl;
-      std::runtime_error(ss.str());
-    }
-
-    // Number of input files
-    unsigned nTrees(mainTree.GetNtrees());
-
     // Actual file names (can be different from inputPaths_ which can include wildcards)
     std::vector<TString> fileNames;
     auto& fileElements(*mainTree.GetListOfFiles());
@@ -500,19 +1074,18 @@ multidraw::MultiDraw::execute(long _nEntries/* = -1*/, unsigned long _firstEntry
     std::vector<std::unique_ptr<TChain>> trees;
     std::vector<std::unique_ptr<std::thread>> threads;
 
-    // threads will clone the histograms; need to disable adding to gDirectory
-    bool currentTH1AddDirectory(TH1::AddDirectoryStatus());
+    // threads will clone the histograms; need to disable adding to gDirectory (restored by globalSettings)
     TH1::AddDirectory(false);
 
     // treeOffsets are used in executeOne_ to identify tree transitions and lock the thread
     // Except: newer versions of ROOT is more thread-safe and does not require this lock
     Long64_t* treeOffsets(nullptr);
 
-    auto threadTask([this, &treeOffsets, &synchTools](long _nE, long _fE, TChain* _tree, unsigned _treeNumberOffset) {
+    auto threadTask([this, &treeOffsets, &synchTools](long _nE, long _fE, TChain* _tree, unsigned _treeNumberOffset, int _queueIndex) {
 #if ROOT_VERSION_CODE < ROOT_VERSION(6,12,0)
-        this->executeOne_(_nE, _fE, *_tree, synchTools, _treeNumberOffset, treeOffsets);
+        this->executeOne_(_nE, _fE, *_tree, synchTools, _treeNumberOffset, _queueIndex < 0 ? treeOffsets : _tree->GetTreeOffset(), false, _queueIndex);
 #else
-        this->executeOne_(_nE, _fE, *_tree, synchTools, _treeNumberOffset);
+        this->executeOne_(_nE, _fE, *_tree, synchTools, _treeNumberOffset, false, _queueIndex);
 #endif
       });
 
@@ -520,11 +1093,58 @@ multidraw::MultiDraw::execute(long _nEntries/* = -1*/, unsigned long _firstEntry
     long nEntriesMain(0);
     unsigned long firstEntryMain(0);
     bool byTreeMain(false);
+    TChain* treeMain(&mainTree);
+    int queueIndexMain(-1);
 #if ROOT_VERSION_CODE < ROOT_VERSION(6,12,0)
     Long64_t* treeOffsetsMain(nullptr);
 #endif
 
-    if (_nEntries == -1 && _firstEntry == 0 && nTrees > inputMultiplexing_) {
+    std::unique_ptr<EntryRangeQueues> rangeQueues{};
+    std::unique_ptr<TChain> dynamicMainTree{};
+
+    if (schedulingMode_ == kDynamic) {
+      if (entryList_ != nullptr) {
+        if (printLevel_ >= 0)
+          std::cerr << "Dynamic scheduling is not supported with an entry list. Falling back to static scheduling." << std::endl;
+      }
+      else {
+        if (printLevel_ > 0) {
+          std::cout << "Reading the cluster structure of " << nTrees;
+          std::cout << " files to schedule the input over " << inputMultiplexing_ << " threads" << std::endl;
+        }
+
+        rangeQueues = makeEntryRangeQueues_(fileNames, _nEntries, _firstEntry);
+      }
+    }
+
+    if (rangeQueues) {
+      // Every thread gets the full chain with known tree offsets and pulls entry ranges from the queues.
+      // Tree numbers are identical across the threads, so tree weights need no offset.
+
+      synchTools.rangeQueues = rangeQueues.get();
+
+      auto makeChain([this, &fileNames, &rangeQueues, &attachFriends]()->TChain* {
+          auto* tree(new TChain(this->treeName_));
+          for (unsigned iS(0); iS != fileNames.size(); ++iS)
+            tree->Add(fileNames[iS], rangeQueues->fileEntries[iS]);
+          attachFriends(*tree, 0, fileNames.size());
+          return tree;
+        });
+
+      for (unsigned iT(1); iT != inputMultiplexing_; ++iT) {
+        auto* tree(makeChain());
+        threads.emplace_back(new std::thread(threadTask, 0, 0, tree, 0, iT));
+        trees.emplace_back(tree);
+      }
+
+      dynamicMainTree.reset(makeChain());
+      treeMain = dynamicMainTree.get();
+      queueIndexMain = 0;
+#if ROOT_VERSION_CODE < ROOT_VERSION(6,12,0)
+      treeOffsetsMain = treeMain->GetTreeOffset();
+#endif
+    }
+    else if (_nEntries == -1 && _firstEntry == 0 && nTrees > inputMultiplexing_) {
       // If there are more trees than threads and we are not limiting the number of entries to process,
       // we can split by file and avoid having to open all files up front with GetEntries.
 
@@ -550,7 +1170,10 @@ multidraw::MultiDraw::execute(long _nEntries/* = -1*/, unsigned long _firstEntry
 
         for (unsigned iS(treeNumberOffset); iS != treeNumberOffset + nFilesPerThread; ++iS) {
           auto& fileName(fileNames[iS]);
-          tree->Add(fileName);
+          if (fileEntries.empty())
+            tree->Add(fileName);
+          else
+            tree->Add(fileName, fileEntries[iS]);
           if (threadElist != nullptr)
             threadElist->Add(entryList_->GetEntryList(treeName_, fileName));
         }
@@ -558,7 +1181,9 @@ multidraw::MultiDraw::execute(long _nEntries/* = -1*/, unsigned long _firstEntry
         if (threadElist != nullptr)
           tree->SetEntryList(threadElist);
 
-        threads.emplace_back(new std::thread(threadTask, -1, 0, tree, treeNumberOffset));
+        attachFriends(*tree, treeNumberOffset, treeNumberOffset + nFilesPerThread);
+
+        threads.emplace_back(new std::thread(threadTask, -1, 0, tree, treeNumberOffset, -1));
         trees.emplace_back(tree);
       }
 
@@ -575,23 +1200,25 @@ multidraw::MultiDraw::execute(long _nEntries/* = -1*/, unsigned long _firstEntry
       }
 
       // This step also fills the offsets array of the TChain
-      unsigned long long nTotal(mainTree.GetEntries() - _firstEntry);
+      long long nAvailable(mainTree.GetEntries());
 
       if (entryList_ != nullptr)
-        nTotal = entryList_->GetN() - _firstEntry;
+        nAvailable = entryList_->GetN();
+
+      unsigned long long nTotal(nAvailable > (long long)(_firstEntry) ? nAvailable - _firstEntry : 0);
 
       if (_nEntries >= 0 && _nEntries < (long long)(nTotal))
         nTotal = _nEntries;
 
-      if (nTotal <= _firstEntry)
-        return;
+      // An empty range is left to the main thread alone, so that the epilogue below still runs
+      unsigned nThreads(nTotal == 0 ? 1 : inputMultiplexing_);
 
-      long long nPerThread(nTotal / inputMultiplexing_);
+      long long nPerThread(nTotal / nThreads);
 
       treeOffsets = mainTree.GetTreeOffset();
 
       long firstEntry(_firstEntry); // first entry in the full chain
-      for (unsigned iT(0); iT != inputMultiplexing_ - 1; ++iT) {
+      for (unsigned iT(0); iT != nThreads - 1; ++iT) {
         auto* tree(new TChain(treeName_));
 
         unsigned treeNumberOffset(0);
@@ -623,7 +1250,10 @@ multidraw::MultiDraw::execute(long _nEntries/* = -1*/, unsigned long _firstEntry
         // Add file names from treeNumberOffset to max, but may only use a part (depends on how many events the thread will process)
         for (unsigned iS(treeNumberOffset); iS != fileNames.size(); ++iS) {
           auto& fileName(fileNames[iS]);
-          tree->Add(fileName);
+          if (fileEntries.empty())
+            tree->Add(fileName);
+          else
+            tree->Add(fileName, fileEntries[iS]);
           if (threadElist != nullptr)
             threadElist->Add(entryList_->GetEntryList(treeName_, fileName));
         }
@@ -631,7 +1261,9 @@ multidraw::MultiDraw::execute(long _nEntries/* = -1*/, unsigned long _firstEntry
         if (threadElist != nullptr)
           tree->SetEntryList(threadElist);
 
-        threads.push_back(std::make_unique<std::thread>(threadTask, nPerThread, threadFirstEntry, tree, treeNumberOffset));
+        attachFriends(*tree, treeNumberOffset, fileNames.size());
+
+        threads.push_back(std::make_unique<std::thread>(threadTask, nPerThread, threadFirstEntry, tree, treeNumberOffset, -1));
         trees.emplace_back(tree);
 
         firstEntry += nPerThread;
@@ -647,9 +1279,9 @@ multidraw::MultiDraw::execute(long _nEntries/* = -1*/, unsigned long _firstEntry
     // Started N-1 threads. Process the rest of events (staring from 0) in the main thread
 
 #if ROOT_VERSION_CODE < ROOT_VERSION(6,12,0)
-    executeOne_(nEntriesMain, firstEntryMain, mainTree, synchTools, 0, treeOffsetsMain, byTreeMain);
+    executeOne_(nEntriesMain, firstEntryMain, *treeMain, synchTools, 0, treeOffsetsMain, byTreeMain, queueIndexMain);
 #else
-    executeOne_(nEntriesMain, firstEntryMain, mainTree, synchTools, 0, byTreeMain);
+    executeOne_(nEntriesMain, firstEntryMain, *treeMain, synchTools, 0, byTreeMain, queueIndexMain);
 #endif
 
     {
@@ -665,23 +1297,53 @@ multidraw::MultiDraw::execute(long _nEntries/* = -1*/, unsigned long _firstEntry
     threads.clear();
 
     // Tree deletion should not be concurrent with THx deletion, which happens during the last part of executeOne_ (in Cut dtors)
-    for (unsigned iT(0); iT != inputMultiplexing_ - 1; ++iT) {
-      auto* threadElist(trees[iT]->GetEntryList());
-      trees[iT]->SetEntryList(nullptr);
+    for (auto& tree : trees) {
+      auto* threadElist(tree->GetEntryList());
+      tree->SetEntryList(nullptr);
       delete threadElist;
     }
 
-    TH1::AddDirectory(currentTH1AddDirectory);
-
     totalEvents_ = synchTools.totalEvents;
   }
 
-  if (doAbortOnReadError_)
-    gErrorAbortLevel = abortLevel;
+  // Write the merged histogram buffers of all threads
+  std::vector<MultiDraw*> allDrawers{this};
+  for (auto& v : variations_)
+    allDrawers.push_back(v.second.get());
+
+  for (auto* drawer : allDrawers) {
+    drawer->filter_->finalizeExprs();
+    for (auto& namecut : drawer->cuts_)
+      namecut.second->finalizeExprs();
+  }
 
   for (auto& ft : friendTrees)
     mainTree.RemoveFriend(ft.get());
 
+  if (cutCache_) {
+    unsigned nSaved(cutCache_->save());
+    cutCache_.reset();
+
+    if (printLevel_ > 1)
+      std::cout << " Recorded the cut results of " << nSaved << " files in " << cutCacheDir_ << std::endl;
+  }
+
+  if (aliasCache_) {
+    unsigned nSaved(aliasCache_->save());
+    aliasCache_.reset();
+
+    if (printLevel_ > 1)
+      std::cout << " Recorded the alias values of " << nSaved << " files in " << aliasCacheDir_ << std::endl;
+  }
+
+  if (profiler_) {
+    profiler_->writeJSON(profileOutput_);
+    profiler_.reset();
+
+    if (printLevel_ > 1)
+      std::cout << " Wrote the execution profile to " << profileOutput_ << std::endl;
+  }
+
   if (printLevel_ >= 0) {
     std::cout << "\r      " << totalEvents_ << " events" << std::endl;
     if (printLevel_ > 0) {
@@ -695,20 +1357,259 @@ multidraw::MultiDraw::execute(long _nEntries/* = -1*/, unsigned long _firstEntry
           }
         });
 
-      printCut(*filter_);
+      auto printCuts([&printCut](MultiDraw const& drawer) {
+          printCut(*drawer.filter_);
 
-      for (auto& namecut : cuts_) {
-        auto& cut(*namecut.second);
-        if (namecut.first.Length() != 0 && cut.getNFillers() == 0) // skip non-default cut with no filler
-          continue;
+          for (auto& namecut : drawer.cuts_) {
+            auto& cut(*namecut.second);
+            if (namecut.first.Length() != 0 && cut.getNFillers() == 0) // skip non-default cut with no filler
+              continue;
+
+            printCut(cut);
+          }
+        });
 
-        printCut(cut);
+      printCuts(*this);
+
+      for (auto& v : variations_) {
+        std::cout << "      Variation " << v.first << std::endl;
+        printCuts(*v.second);
       }
     }
   }
 }
 
-typedef std::chrono::steady_clock SteadyClock;
+long
+multidraw::MultiDraw::executeForked_(long _nEntries, unsigned long _firstEntry, TChain& _mainTree, SynchTools& _synchTools, std::function<void(TChain&)> const& _attachFriends)
+{
+  // Fillers of all drawers, in a fixed order shared by the parent and the workers
+  std::vector<ExprFiller*> fillers;
+  std::vector<MultiDraw*> allDrawers{this};
+  for (auto& v : variations_)
+    allDrawers.push_back(v.second.get());
+
+  for (auto* drawer : allDrawers) {
+    std::vector<Cut*> cuts{drawer->filter_.get()};
+    for (auto& namecut : drawer->cuts_)
+      cuts.push_back(namecut.second.get());
+
+    for (auto* cut : cuts) {
+      for (unsigned iF(0); iF != cut->getNFillers(); ++iF)
+        fillers.push_back(cut->getFiller(iF));
+    }
+  }
+
+  // Layout of the shared region of each worker: [done flag, number of events, histogram buffers...]
+  std::vector<unsigned> offsets;
+  unsigned long regionSize(2);
+  bool useFiles(false);
+  for (auto* filler : fillers) {
+    unsigned size(filler->getSharedBufferSize());
+    offsets.push_back(size == 0 ? 0 : regionSize);
+    regionSize += size;
+
+    if (size != 0)
+      continue;
+
+    useFiles = true;
+
+    // A worker filling a tree attached to a file would write into the file of the parent
+    TObject& obj(filler->getObj(0));
+    if (obj.InheritsFrom(TTree::Class())) {
+      auto* dir(static_cast<TTree&>(obj).GetDirectory());
+      if (dir != nullptr && dir->GetFile() != nullptr)
+        throw std::runtime_error(("Tree " + TString(obj.GetName()) + " is attached to a file; cannot fill it in multiple processes").Data());
+    }
+  }
+
+  // Count the entries with a separate chain, closed before the fork; no input file may be open in the parent
+  // at fork() (the processes would share the file offsets), which is why the friends are attached afterwards
+  long long nTotal(0);
+  if (entryList_ != nullptr)
+    nTotal = entryList_->GetN();
+  else if (_mainTree.GetEntriesFast() != TTree::kMaxEntries) {
+    // numbers of entries known from the input index
+    nTotal = _mainTree.GetEntriesFast();
+  }
+  else {
+    TChain counter(treeName_);
+    for (auto& path : inputPaths_)
+      counter.Add(path);
+    nTotal = counter.GetEntries();
+  }
+
+  if ((long long)_firstEntry >= nTotal)
+    return 0;
+
+  nTotal -= _firstEntry;
+  if (_nEntries >= 0 && _nEntries < nTotal)
+    nTotal = _nEntries;
+
+  if (nTotal <= 0)
+    return 0;
+
+  unsigned nProc(processMultiplexing_);
+  if (nTotal < nProc)
+    nProc = nTotal;
+
+  auto rangeStart([_firstEntry, nTotal, nProc](unsigned _iP)->long long {
+      return _firstEntry + nTotal * _iP / nProc;
+    });
+
+  unsigned long nBytes(regionSize * sizeof(double) * (nProc - 1));
+  void* shm(nullptr);
+  if (nBytes != 0) {
+    shm = mmap(nullptr, nBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (shm == MAP_FAILED)
+      throw std::runtime_error("Failed to allocate shared memory for the worker processes");
+  }
+  double* shared(static_cast<double*>(shm));
+
+  TString tmpBase(TString::Format("%s/multidraw_%d_", gSystem->TempDirectory(), gSystem->GetPid()));
+
+  if (printLevel_ > 0)
+    std::cout << "Processing " << nTotal << " events in " << nProc << " processes" << std::endl;
+
+  // Unflushed output would be duplicated in the workers
+  std::cout.flush();
+  std::cerr.flush();
+
+  std::vector<pid_t> workers;
+  for (unsigned iP(1); iP < nProc; ++iP) {
+    pid_t pid(fork());
+    if (pid < 0) {
+      for (pid_t worker : workers) {
+        kill(worker, SIGKILL);
+        waitpid(worker, nullptr, 0);
+      }
+      munmap(shm, nBytes);
+      throw std::runtime_error("fork() failed");
+    }
+
+    if (pid != 0) {
+      workers.push_back(pid);
+      continue;
+    }
+
+    // Worker process; never returns
+    int status(0);
+    try {
+      double* region(shared + (iP - 1) * regionSize);
+
+      printLevel_ = -1;
+      doTimeProfile_ = false;
+      profiler_.reset();
+
+      // the objects returned through files must hold the fills of this worker only
+      if (useFiles) {
+        for (unsigned iF(0); iF != fillers.size(); ++iF) {
+          if (offsets[iF] == 0)
+            fillers[iF]->resetObj();
+        }
+      }
+
+      _attachFriends(_mainTree);
+
+      long nEvents(executeOne_(rangeStart(iP + 1) - rangeStart(iP), rangeStart(iP), _mainTree, _synchTools));
+
+      // files processed entirely by this worker
+      if (cutCache_)
+        cutCache_->save();
+      if (aliasCache_)
+        aliasCache_->save();
+
+      for (unsigned iF(0); iF != fillers.size(); ++iF) {
+        if (offsets[iF] != 0)
+          fillers[iF]->exportBuffer(region + offsets[iF]);
+      }
+
+      if (useFiles) {
+        TFile file(tmpBase + TString::Format("%u.root", iP), "recreate");
+        for (unsigned iF(0); iF != fillers.size(); ++iF) {
+          if (offsets[iF] != 0)
+            continue;
+          // collects the output streamed by the thread clones (see TreeFiller::setStreamingDirectory)
+          fillers[iF]->finalize();
+          fillers[iF]->writeObj(file, TString::Format("filler%u", iF));
+        }
+        file.Close();
+      }
+
+      region[1] = nEvents;
+      region[0] = 1.;
+    }
+    catch (std::exception& ex) {
+      std::cerr << "MultiDraw worker process " << iP << ": " << ex.what() << std::endl;
+      status = 1;
+    }
+
+    // Skip the atexit handlers and destructors (ROOT cleanup belongs to the parent)
+    std::cout.flush();
+    std::cerr.flush();
+    _exit(status);
+  }
+
+  // The calling process takes the first range
+  long nEvents(0);
+  std::string error;
+  try {
+    _attachFriends(_mainTree);
+    nEvents = executeOne_(rangeStart(1) - rangeStart(0), rangeStart(0), _mainTree, _synchTools);
+  }
+  catch (std::exception& ex) {
+    error = ex.what();
+  }
+
+  bool workerFailed(false);
+  for (pid_t worker : workers) {
+    int status(0);
+    if (waitpid(worker, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+      workerFailed = true;
+  }
+
+  if (error.empty() && !workerFailed) {
+    for (unsigned iP(1); iP < nProc; ++iP) {
+      double const* region(shared + (iP - 1) * regionSize);
+      if (region[0] != 1.) {
+        workerFailed = true;
+        break;
+      }
+
+      nEvents += region[1];
+
+      for (unsigned iF(0); iF != fillers.size(); ++iF) {
+        if (offsets[iF] != 0)
+          fillers[iF]->importBuffer(region + offsets[iF]);
+      }
+    }
+  }
+
+  if (shm != nullptr)
+    munmap(shm, nBytes);
+
+  if (useFiles) {
+    for (unsigned iP(1); iP < nProc; ++iP) {
+      TString path(tmpBase + TString::Format("%u.root", iP));
+      if (error.empty() && !workerFailed) {
+        TFile file(path);
+        for (unsigned iF(0); iF != fillers.size(); ++iF) {
+          if (offsets[iF] == 0)
+            fillers[iF]->mergeObj(file, TString::Format("filler%u", iF));
+        }
+      }
+      gSystem->Unlink(path);
+    }
+  }
+
+  if (!error.empty())
+    throw std::runtime_error(error);
+  if (workerFailed)
+    throw std::runtime_error("A MultiDraw worker process failed");
+
+  return nEvents;
+}
+
+typedef std::chrono::steady_clock SteadyClock;
 
 double
 millisec(SteadyClock::duration const& interval)
@@ -721,30 +1622,80 @@ namespace multidraw {
   thread_local TTree* currentTree{nullptr};
 }
 
+namespace {
+  struct AliasSpec {
+    unsigned index{0};
+    bool isArray{false};
+    std::unique_ptr<multidraw::CompiledExpr> sourceExpr{};
+    // alias cache column key, cached values in the current file, and values recorded in the current file
+    TString cacheKey{};
+    multidraw::AliasCache::Column const* cached{nullptr};
+    multidraw::AliasCache::Column* recording{nullptr};
+  };
+}
+
+//! Per-thread state of the nominal drawer or of a variation
+/*
+ * Each drawer has its own FormulaLibrary and FunctionLibrary, so that the branch replacements of a variation
+ * do not affect the nominal expressions.
+ */
+struct multidraw::MultiDraw::ThreadDrawer {
+  ThreadDrawer(MultiDraw& _drawer, TTree& _tree, TString const& _variation = "") :
+    drawer(_drawer),
+    variation(_variation),
+    library(_tree),
+    flibrary(_tree)
+  {
+  }
+
+  MultiDraw& drawer;
+  TString variation;
+  FormulaLibrary library;
+  FunctionLibrary flibrary;
+  CutAtomLibrary atoms{library};
+  std::vector<AliasSpec> aliases{};
+  CutPtr filter{};
+  std::vector<CutPtr> cuts{};
+  ReweightPtr globalReweight{nullptr};
+  std::unordered_map<unsigned, std::pair<ReweightPtr, bool>> treeReweights{};
+  double treeWeight{1.};
+  Reweight* treeReweight{nullptr};
+  bool exclusiveTreeReweight{false};
+  bool filterHasAliases{false};
+  bool passFilter{false};
+  std::vector<double> eventWeights{};
+  // time profile of the cuts, the filter last
+  std::vector<ProfileCounter> cutProfiles{};
+  std::vector<unsigned long long> cutPasses{};
+};
+
 long
 #if ROOT_VERSION_CODE < ROOT_VERSION(6,12,0)
-multidraw::MultiDraw::executeOne_(long _nEntries, unsigned long _firstEntry, TChain& _tree, SynchTools& _synchTools, unsigned _treeNumberOffset/* = 0*/, Long64_t* _treeOffsets/* = nullptr*/, bool _byTree/* = false*/)
+multidraw::MultiDraw::executeOne_(long _nEntries, unsigned long _firstEntry, TChain& _tree, SynchTools& _synchTools, unsigned _treeNumberOffset/* = 0*/, Long64_t* _treeOffsets/* = nullptr*/, bool _byTree/* = false*/, int _queueIndex/* = -1*/)
 #else
-multidraw::MultiDraw::executeOne_(long _nEntries, unsigned long _firstEntry, TChain& _tree, SynchTools& _synchTools, unsigned _treeNumberOffset/* = 0*/, bool _byTree/* = false*/)
+multidraw::MultiDraw::executeOne_(long _nEntries, unsigned long _firstEntry, TChain& _tree, SynchTools& _synchTools, unsigned _treeNumberOffset/* = 0*/, bool _byTree/* = false*/, int _queueIndex/* = -1*/)
 #endif
 {
   // treeNumberOffset: The offset of the given tree with respect to the original
 
-  std::vector<SteadyClock::duration> cutTimers;
-  SteadyClock::duration ioTimer(SteadyClock::duration::zero());
-  SteadyClock::duration eventTimer(SteadyClock::duration::zero());
+  Profiler::ThreadProfile profile;
   SteadyClock::time_point start;
+  Long64_t bytesReadStart(TFile::GetFileBytesRead());
 
   bool isMainThread(std::this_thread::get_id() == _synchTools.mainThread);
 
   int printLevel(-1);
-  bool doTimeProfile(false);
+  bool printTimeProfile(false);
 
   if (isMainThread) {
     printLevel = printLevel_;
-    doTimeProfile = doTimeProfile_;
+    printTimeProfile = doTimeProfile_;
   }
 
+  // All threads are timed if the profile is recorded
+  bool doTimeProfile(printTimeProfile || profiler_ != nullptr);
+  unsigned sampling(profiler_ == nullptr ? 0 : profiler_->getSampling());
+
   if (_tree.GetNtrees() == 0) {
     // TTreeFormula compilation crashes if there is no tree in the chain
     if (printLevel >= 0)
@@ -755,37 +1706,67 @@ multidraw::MultiDraw::executeOne_(long _nEntries, unsigned long _firstEntry, TCh
 
   currentTree = &_tree;
 
-  // Create the repository of all TTreeFormulas
-  FormulaLibrary library(_tree);
-  // and of all TTreeFunctions
-  FunctionLibrary flibrary(_tree);
+  // Create the repository of all TTreeFormulas and TTreeFunctions for the nominal drawer and each variation
+  std::vector<std::unique_ptr<ThreadDrawer>> drawers;
+  drawers.emplace_back(new ThreadDrawer(*this, _tree));
+  for (auto& v : variations_)
+    drawers.emplace_back(new ThreadDrawer(*v.second, _tree, v.first));
+
+  auto& nominal(*drawers.front());
+  auto& library(nominal.library);
 
   // If we have custom-defined aliases, must compile them before cuts and fillers refer to them
-  struct AliasSpec {
-    TBranch* nbranch{nullptr};
-    TBranch* vbranch{nullptr};
-    unsigned nD{0};
-    std::vector<double> values{};
-    std::unique_ptr<CompiledExpr> sourceExpr{};
-  };
+  std::unique_ptr<AliasStore> aliasStore(nullptr);
+  TTree* aliasesTree(nullptr);
+
+  // Book the alias in the store given the compiled expression
+  auto bookAlias([&aliasStore, printLevel](AliasSpec& _varspec, TString const& _name, std::vector<TString>& _negativeMultiplicity) {
+      int multiplicity(0);
+
+      if (_varspec.sourceExpr->getFormula() != nullptr) {
+        if (printLevel >= 1)
+          std::cout << " = " << _varspec.sourceExpr->getFormula()->GetTitle();
+
+        auto* formula(_varspec.sourceExpr->getFormula());
+        auto* formulaManager(formula->GetManager());
+        formulaManager->Sync();
+
+        multiplicity = formulaManager->GetMultiplicity();
+      }
+      else {
+        multiplicity = _varspec.sourceExpr->getFunction()->getMultiplicity();
+
+        if (printLevel >= 1)
+          std::cout << " = [" << _varspec.sourceExpr->getFunction()->getName();
+      }
+
+      if (printLevel >= 1)
+        std::cout << " (multiplicity " << multiplicity << ")" << std::endl;
+
+      // multiplicity > 0 or -1 -> number of values may change (case -1: either 0 or 1)
+      // array, or expression composed of dynamic array elements
+      if (multiplicity < 0)
+        _negativeMultiplicity.push_back(_name);
 
-  std::unique_ptr<TTree> aliasesTree(nullptr);
-  std::vector<AliasSpec> aliases;
+      _varspec.isArray = (multiplicity != 0);
+      _varspec.index = aliasStore->book(_name, _varspec.isArray);
+    });
 
-  //int const maxTreeSize(100);
+  std::vector<TString> negativeMultiplicity;
 
   if (!aliases_.empty()) {
     {
       std::lock_guard<std::mutex> lock(_synchTools.mutex);
-      TDirectory::TContext(nullptr);
-      aliasesTree = std::make_unique<TTree>("_aliases", "");
+      aliasStore = std::make_unique<AliasStore>();
     }
 
-    _tree.AddFriend(aliasesTree.get());
+    aliasesTree = &aliasStore->getTree();
+    _tree.AddFriend(aliasesTree);
 
-    aliases.reserve(aliases_.size());
+    for (auto& d : drawers)
+      d->flibrary.setAliasStore(aliasStore.get());
 
-    std::vector<TString> negativeMultiplicity;
+    nominal.aliases.reserve(aliases_.size());
 
     // Adding aliases in given order - aliases dependent on others must be declared in order
     for (auto& v : aliases_) {
@@ -795,125 +1776,118 @@ multidraw::MultiDraw::executeOne_(long _nEntries, unsigned long _firstEntry, TCh
       if (_tree.GetBranch(name) != nullptr)
         throw std::runtime_error(("Branch with name " + name + " already exists in the input tree. Cannot define alias.").Data());
 
-      aliases.resize(aliases.size() + 1);
-      auto& varspec(aliases.back());
-
-      varspec.sourceExpr = std::move(exprSource.compile(library, flibrary));
+      nominal.aliases.resize(nominal.aliases.size() + 1);
+      auto& varspec(nominal.aliases.back());
 
-      int multiplicity(0);
+      varspec.sourceExpr = std::move(exprSource.compile(library, nominal.flibrary));
 
       if (printLevel >= 1)
         std::cout << " Adding alias " << name;
 
-      if (varspec.sourceExpr->getFormula() != nullptr) {
-        if (printLevel >= 1)
-          std::cout << " = " << exprSource.getFormula();
-
-        auto* formula(varspec.sourceExpr->getFormula());
-        auto* formulaManager(formula->GetManager());
-        formulaManager->Sync();
-
-        multiplicity = formulaManager->GetMultiplicity();
-      }
-      else {
-        multiplicity = varspec.sourceExpr->getFunction()->getMultiplicity();
+      bookAlias(varspec, name, negativeMultiplicity);
+    }
+  }
 
-        if (printLevel >= 1)
-          std::cout << " = [" << varspec.sourceExpr->getFunction()->getName();
+  // Aliases of the variations are compiled against the nominal alias branches. Branches are booked only for
+  // those that turn out to depend on the replaced branches (see below).
+  for (unsigned iV(1); iV < drawers.size(); ++iV) {
+    auto& vdrawer(*drawers[iV]);
+
+    for (auto& v : vdrawer.drawer.aliases_) {
+      if (!aliasStore || aliasStore->find(v.first) < 0) {
+        std::stringstream ss;
+        ss << "Alias " << v.first << " of variation " << vdrawer.variation << " is not defined in the nominal MultiDraw";
+        std::cerr << ss.str() << std::endl;
+        throw std::runtime_error(ss.str());
       }
 
-      if (printLevel >= 1)
-        std::cout << " (multiplicity " << multiplicity << ")" << std::endl;
-
-      if (multiplicity == 0) {
-        // singlet branch
-        varspec.values.resize(1);
-        varspec.vbranch = aliasesTree->Branch(name, varspec.values.data(), name + "/D");
-      }
-      else {
-        if (multiplicity < 0)
-          negativeMultiplicity.push_back(name);
-
-        // multiplicity > 0 or -1 -> number of values may change (case -1: either 0 or 1)
-        // give some reasonable initial size
-        varspec.values.resize(64);
-        // array, or expression composed of dynamic array elements
-        varspec.nbranch = aliasesTree->Branch("size__" + name, &varspec.nD, "size__" + name + "/i");
-        varspec.vbranch = aliasesTree->Branch(name, varspec.values.data(), name + "[size__" + name + "]/D");
-      }
+      vdrawer.aliases.resize(vdrawer.aliases.size() + 1);
+      vdrawer.aliases.back().sourceExpr = std::move(v.second.compile(vdrawer.library, vdrawer.flibrary));
     }
+  }
 
-    if (!negativeMultiplicity.empty()) {
-      TString names;
-      for (unsigned iS(0); iS != negativeMultiplicity.size(); ++iS) {
-        names += negativeMultiplicity[iS];
-        if (iS != negativeMultiplicity.size() - 1)
-          names += ", ";
-      }
-
-      if (printLevel >= 1) {
-        std::cout << " Aliases " << names << " are singlets but are represented as arrays";
-        std::cout << " within MultiDraw. Use index [0] whenever using the alias to ensure";
-        std::cout << " we don't try to iterate over the values, especially in an expression";
-        std::cout << " used for cuts." << std::endl;
-      }
+  AliasCache* aliasCache(aliasCache_.get());
+  if (aliasCache != nullptr) {
+    auto keys(aliasCacheKeys_());
+    for (unsigned iA(0); iA != keys.size(); ++iA)
+      nominal.aliases[iA].cacheKey = keys[iA];
+
+    // Values of the variation aliases depend on the full nominal alias configuration
+    for (unsigned iV(1); iV < drawers.size() && keys.back().Length() != 0; ++iV) {
+      auto& vdrawer(*drawers[iV]);
+      auto vkeys(vdrawer.drawer.aliasCacheKeys_(keys.back()));
+      for (unsigned iA(0); iA != vkeys.size(); ++iA)
+        vdrawer.aliases[iA].cacheKey = vkeys[iA];
     }
   }
 
   // Set up the cuts and filler objects
-  CutPtr filter;
-  std::vector<CutPtr> cuts;
+  for (auto& d : drawers) {
+    auto& drawer(d->drawer);
 
-  if (isMainThread) {
-    filter = std::move(filter_);
-    filter->setPrintLevel(printLevel);
-    filter->bindTree(library, flibrary);
+    if (isMainThread) {
+      d->filter = std::move(drawer.filter_);
+      d->filter->setPrintLevel(printLevel);
+      d->filter->bindTree(d->library, d->flibrary);
 
-    filter->initialize();
+      d->filter->initialize();
 
-    for (auto& namecut : cuts_) {
-      if (namecut.first.Length() != 0 && namecut.second->getNFillers() == 0)
-        continue;
+      for (auto& namecut : drawer.cuts_) {
+        if (namecut.first.Length() != 0 && namecut.second->getNFillers() == 0)
+          continue;
 
-      cuts.emplace_back(std::move(namecut.second));
-      cuts.back()->setPrintLevel(printLevel);
-      cuts.back()->bindTree(library, flibrary);
+        d->cuts.emplace_back(std::move(namecut.second));
+        d->cuts.back()->setPrintLevel(printLevel);
+        d->cuts.back()->bindTree(d->library, d->flibrary);
 
-      if (printLevel >= 1)
-        std::cout << "Initializing cut \"" << namecut.first << "\"" << std::endl;
+        if (printLevel >= 1) {
+          std::cout << "Initializing cut \"" << namecut.first << "\"";
+          if (d->variation.Length() != 0)
+            std::cout << " of variation " << d->variation;
+          std::cout << std::endl;
+        }
 
-      cuts.back()->initialize();
+        d->cuts.back()->initialize();
+      }
     }
-  }
-  else {
-    filter = filter_->threadClone(library, flibrary);
+    else {
+      d->filter = drawer.filter_->threadClone(d->library, d->flibrary);
 
-    for (auto& namecut : cuts_) {
-      if (namecut.first.Length() != 0 && namecut.second->getNFillers() == 0)
-        continue;
+      for (auto& namecut : drawer.cuts_) {
+        if (namecut.first.Length() != 0 && namecut.second->getNFillers() == 0)
+          continue;
 
-      cuts.emplace_back(namecut.second->threadClone(library, flibrary));
+        d->cuts.emplace_back(namecut.second->threadClone(d->library, d->flibrary));
 
-      cuts.back()->initialize();
+        d->cuts.back()->initialize();
+      }
     }
-  }
 
-  if (isMainThread && doTimeProfile)
-    cutTimers.assign(1 + cuts.size(), SteadyClock::duration::zero());
+    // Cuts sharing top-level && clauses evaluate them once per event
+    d->filter->bindAtoms(d->atoms);
+    for (auto& cut : d->cuts)
+      cut->bindAtoms(d->atoms);
 
-  // Compile the reweight expressions
-  ReweightPtr globalReweight{nullptr};
-  std::unordered_map<unsigned, std::pair<ReweightPtr, bool>> treeReweights;
+    if (doTimeProfile) {
+      d->cutProfiles.assign(1 + d->cuts.size(), ProfileCounter());
+      d->cutPasses.assign(1 + d->cuts.size(), 0);
+    }
 
-  if (globalReweightSource_)
-    globalReweight = globalReweightSource_->compile(library, flibrary);
+    if (profiler_) {
+      d->filter->setProfileFillers(true);
+      for (auto& cut : d->cuts)
+        cut->setProfileFillers(true);
+    }
 
-  for (auto& tr : treeReweightSources_)
-    treeReweights.emplace(tr.first, std::make_pair(tr.second.first->compile(library, flibrary), tr.second.second));
+    // Compile the reweight expressions
+    if (drawer.globalReweightSource_)
+      d->globalReweight = drawer.globalReweightSource_->compile(d->library, d->flibrary);
 
-  // Preparing for the event loop
-  std::vector<double> eventWeights;
+    for (auto& tr : drawer.treeReweightSources_)
+      d->treeReweights.emplace(tr.first, std::make_pair(tr.second.first->compile(d->library, d->flibrary), tr.second.second));
+  }
 
+  // Preparing for the event loop
   long long iEntry(0);
   int treeNumber(-1);
 
@@ -937,10 +1911,6 @@ multidraw::MultiDraw::executeOne_(long _nEntries, unsigned long _firstEntry, TCh
   TBranch* weightBranch(nullptr);
   TBranch* evtNumBranch(nullptr);
 
-  double treeWeight(1.);
-  Reweight* treeReweight{nullptr};
-  bool exclusiveTreeReweight(false);
-
   // Applying good run list
   std::function<bool()> isGoodRunEvent;
   TTreeFormula* goodRunBranch[2]{};
@@ -970,9 +1940,197 @@ multidraw::MultiDraw::executeOne_(long _nEntries, unsigned long _firstEntry, TCh
   }
 
   // Replace branches in the expressions
-  for (auto& repl : branchReplacements_) {
-    library.replaceAll(repl.first, repl.second);
-    flibrary.replaceAll(repl.first, repl.second);
+  for (auto& d : drawers) {
+    bool functionReplaced(false);
+
+    for (auto& repl : d->drawer.branchReplacements_) {
+      d->library.replaceAll(repl.first, repl.second);
+      if (d->flibrary.replaceAll(repl.first, repl.second))
+        functionReplaced = true;
+    }
+
+    if (d.get() == &nominal)
+      continue;
+
+    // Book the aliases of the variation that depend on a replaced branch and let the expressions of the
+    // variation point to them. Aliases are processed in the order of declaration, so renaming an alias
+    // marks the aliases depending on it as varied.
+    auto& valiases(d->drawer.aliases_);
+    for (unsigned iA(0); iA != valiases.size(); ++iA) {
+      auto& name(valiases[iA].first);
+      auto& varspec(d->aliases[iA]);
+
+      bool varied(false);
+      if (varspec.sourceExpr->getFormula() != nullptr)
+        varied = d->library.isVaried(*varspec.sourceExpr->getFormula());
+      else
+        varied = functionReplaced; // cannot tell which branches a function reads; assume the worst
+
+      if (!varied) {
+        // read the nominal alias value
+        varspec.sourceExpr.reset();
+        continue;
+      }
+
+      TString vname(name + "__" + d->variation);
+
+      if (printLevel >= 1)
+        std::cout << " Adding alias " << vname;
+
+      bookAlias(varspec, vname, negativeMultiplicity);
+
+      // Leaves in friend trees are named <friend alias>.<branch> in TTreeFormula
+      d->library.replaceAll(name, vname);
+      d->library.replaceAll(TString(aliasesTree->GetName()) + "." + name, TString(aliasesTree->GetName()) + "." + vname);
+      if (d->flibrary.replaceAll(name, vname))
+        functionReplaced = true;
+    }
+
+    d->aliases.erase(std::remove_if(d->aliases.begin(), d->aliases.end(), [](AliasSpec const& a) { return !a.sourceExpr; }), d->aliases.end());
+
+    d->library.shareCaches(library);
+  }
+
+  if (doCompileFormulas_) {
+    for (auto& d : drawers) {
+      unsigned nCompiled(d->library.compileFormulas(formulaCacheDir_));
+
+      if (printLevel > 1)
+        std::cout << " Compiled " << nCompiled << " of " << d->library.size() << " formulas" << std::endl;
+    }
+  }
+
+  if (doShareSubexpressions_) {
+    for (auto& d : drawers) {
+      unsigned nShared(d->library.shareSubexpressions());
+
+      if (printLevel > 1)
+        std::cout << " Evaluating " << nShared << " of " << d->library.size() << " formulas through " << d->library.getNSubexpressions() << " shared subexpressions" << std::endl;
+    }
+  }
+
+  if (profiler_) {
+    for (auto& d : drawers)
+      d->library.setProfiling(true);
+  }
+
+  // Collect the branches read in the event loop, for the input chain and each of its friends
+  std::vector<TTree*> inputTrees{&_tree};
+  if (_tree.GetListOfFriends() != nullptr) {
+    for (auto* obj : *_tree.GetListOfFriends()) {
+      auto* ftree(static_cast<TFriendElement*>(obj)->GetTree());
+      if (ftree != nullptr && ftree != aliasesTree)
+        inputTrees.push_back(ftree);
+    }
+  }
+
+  std::vector<std::set<TString>> usedBranches(inputTrees.size());
+  if (doPruneBranches_ || prefetchCacheSize_ > 0 || profiler_) {
+    for (unsigned iT(0); iT != inputTrees.size(); ++iT) {
+      TTree* tree(inputTrees[iT]->GetTree());
+      if (tree == nullptr)
+        continue;
+
+      auto& names(usedBranches[iT]);
+
+      // Branches bound by name; GetBranch also searches the friends, hence the tree check
+      auto addBranch([tree, &names](TString const& _name) {
+          auto* branch(tree->GetBranch(_name));
+          if (branch == nullptr || branch->GetTree() != tree)
+            return;
+
+          names.insert(branch->GetMother()->GetName());
+
+          for (auto* obj : *branch->GetListOfLeaves()) {
+            auto* count(static_cast<TLeaf*>(obj)->GetLeafCount());
+            if (count != nullptr)
+              names.insert(count->GetBranch()->GetMother()->GetName());
+          }
+        });
+
+      for (auto& d : drawers) {
+        for (auto& name : d->library.getBranchNames(*tree))
+          names.insert(name);
+        for (auto& name : d->flibrary.getBranchNames())
+          addBranch(name);
+        // functions keep the original branch names after replaceAll
+        for (auto& repl : d->drawer.branchReplacements_)
+          addBranch(repl.second);
+      }
+
+      if (weightBranchName_.Length() != 0)
+        addBranch(weightBranchName_);
+      if (prescale_ > 1 && evtNumBranchName_.Length() != 0)
+        addBranch(evtNumBranchName_);
+    }
+  }
+
+  if (doPruneBranches_) {
+    // SetBranchStatus of a chain is also applied to same-name branches of the friends; only disable
+    // branches that are not read from any of the trees
+    auto isUsed([&usedBranches](char const* _name)->bool {
+        for (auto& names : usedBranches) {
+          if (names.count(_name) != 0)
+            return true;
+        }
+        return false;
+      });
+
+    unsigned nDisabled(0);
+    for (auto* tree : inputTrees) {
+      if (tree->GetTree() == nullptr)
+        continue;
+
+      for (auto* obj : *tree->GetTree()->GetListOfBranches()) {
+        if (isUsed(obj->GetName()))
+          continue;
+
+        tree->SetBranchStatus(obj->GetName(), false);
+        ++nDisabled;
+      }
+    }
+
+    if (printLevel > 1)
+      std::cout << " Disabled " << nDisabled << " unused input branches" << std::endl;
+  }
+
+  // Cache exactly the branches read in the event loop
+  if (doPruneBranches_ || prefetchCacheSize_ > 0) {
+    unsigned nCached(0);
+    for (unsigned iT(0); iT != inputTrees.size(); ++iT) {
+      auto* tree(inputTrees[iT]);
+
+      if (prefetchCacheSize_ > 0)
+        tree->SetCacheSize(prefetchCacheSize_ / std::max(inputMultiplexing_, 1u));
+      else if (tree->GetCacheSize() <= 0)
+        continue;
+
+      for (auto& name : usedBranches[iT]) {
+        tree->AddBranchToCache(name, true);
+        ++nCached;
+      }
+
+      tree->StopCacheLearningPhase();
+    }
+
+    if (printLevel > 1)
+      std::cout << " Read cache of " << _tree.GetCacheSize() << " bytes for " << nCached << " branches" << std::endl;
+  }
+
+  if (!negativeMultiplicity.empty()) {
+    TString names;
+    for (unsigned iS(0); iS != negativeMultiplicity.size(); ++iS) {
+      names += negativeMultiplicity[iS];
+      if (iS != negativeMultiplicity.size() - 1)
+        names += ", ";
+    }
+
+    if (printLevel >= 1) {
+      std::cout << " Aliases " << names << " are singlets but are represented as arrays";
+      std::cout << " within MultiDraw. Use index [0] whenever using the alias to ensure";
+      std::cout << " we don't try to iterate over the values, especially in an expression";
+      std::cout << " used for cuts." << std::endl;
+    }
   }
 
 #if ROOT_VERSION_CODE < ROOT_VERSION(6,12,0)
@@ -992,12 +2150,45 @@ multidraw::MultiDraw::executeOne_(long _nEntries, unsigned long _firstEntry, TCh
   }
 
   long nextTreeBoundary(0);
+  // Entry ranges pulled from the queues can start anywhere in the chain; lock at the first LoadTree of each range
+  bool rangeStart(false);
 #endif
 
-  bool filterHasAliases(filter->dependsOn(*aliasesTree.get()));
+  for (auto& d : drawers)
+    d->filterHasAliases = (aliasesTree != nullptr && d->filter->dependsOn(*aliasesTree));
 
   long nEntries(_byTree ? -1 : _nEntries);
 
+  // Current entry range [iChainEntry, endEntry) in the chain (endEntry = -1 -> until the end of the chain)
+  long long iChainEntry(_firstEntry);
+  long long endEntry(nEntries < 0 ? -1 : iChainEntry + nEntries);
+
+  EntryRangeQueues* rangeQueues(_queueIndex < 0 ? nullptr : _synchTools.rangeQueues);
+
+  // Cut results of the current file: read from the cut cache if recorded completely before, recorded otherwise
+  CutCache* cutCache(cutCache_.get());
+  int cutCacheTreeNumber(-1);
+  CutCache::FileRecord const* cachedFile(nullptr);
+  int const* cachedBlocks(nullptr);
+  CutCache::FileRecord recording;
+  TString recordingPath;
+  std::vector<int> recordedBlocks;
+
+  // Alias values of the current file: read from the alias cache where available, recorded otherwise
+  int aliasCacheTreeNumber(-1);
+  AliasCache::FileRecord aliasRecording;
+  TString aliasRecordingPath;
+
+  auto recordCut([&recordedBlocks](Cut const& _cut, bool _pass) {
+      if (!_pass) {
+        recordedBlocks.push_back(0);
+        return;
+      }
+      auto& categoryIndex(_cut.getCategoryIndex());
+      recordedBlocks.push_back(categoryIndex.size() + 1);
+      recordedBlocks.insert(recordedBlocks.end(), categoryIndex.begin(), categoryIndex.end());
+    });
+
   long printEvery(100000);
   if (printLevel == 3)
     printEvery = 1000;
@@ -1007,22 +2198,35 @@ multidraw::MultiDraw::executeOne_(long _nEntries, unsigned long _firstEntry, TCh
   if (printLevel >= 0)
     (std::cout << "      0 events").flush();
 
-  while (iEntry != nEntries) {
+  while (true) {
+    if (iChainEntry == endEntry) {
+      // Current range is exhausted; take the next one from the queues if scheduling dynamically
+      if (rangeQueues == nullptr || !rangeQueues->pop(_queueIndex, iChainEntry, endEntry))
+        break;
+
+#if ROOT_VERSION_CODE < ROOT_VERSION(6,12,0)
+      rangeStart = true;
+#endif
+    }
+
     if (doTimeProfile)
       start = SteadyClock::now();
 
-    // iEntryNumber != iEntry if tree has a TEntryList set
-    long long iEntryNumber(_tree.GetEntryNumber(iEntry + _firstEntry));
+    // iEntryNumber != iChainEntry if tree has a TEntryList set
+    long long iEntryNumber(_tree.GetEntryNumber(iChainEntry));
     if (iEntryNumber < 0)
       break;
 
 #if ROOT_VERSION_CODE < ROOT_VERSION(6,12,0)
     long long iLocalEntry(0);
     
-    if (treeOffsets != nullptr && iEntryNumber >= nextTreeBoundary) {
+    if (treeOffsets != nullptr && (rangeStart || iEntryNumber >= nextTreeBoundary)) {
       // we are crossing a tree boundary in a multi-thread environment
       std::lock_guard<std::mutex> lock(_synchTools.mutex);
       iLocalEntry = _tree.LoadTree(iEntryNumber);
+      if (rangeStart && iLocalEntry >= 0)
+        nextTreeBoundary = treeOffsets[_tree.GetTreeNumber() + 1] - treeOffsets[0];
+      rangeStart = false;
     }
     else {
       iLocalEntry = _tree.LoadTree(iEntryNumber);
@@ -1035,10 +2239,73 @@ multidraw::MultiDraw::executeOne_(long _nEntries, unsigned long _firstEntry, TCh
     if (iLocalEntry < 0)
       break;
 
-    flibrary.setEntry(iEntryNumber);
+    if (cutCache != nullptr) {
+      if (cutCacheTreeNumber != _tree.GetTreeNumber()) {
+        if (recordingPath.Length() != 0)
+          cutCache->add(recordingPath, std::move(recording));
+
+        cutCacheTreeNumber = _tree.GetTreeNumber();
+
+        auto* file(_tree.GetCurrentFile());
+        TString uuid(file->GetUUID().AsString());
+        cachedFile = cutCache->find(file->GetName(), uuid);
+
+        recording = CutCache::FileRecord();
+        recordingPath = "";
+        if (cachedFile == nullptr) {
+          recordingPath = file->GetName();
+          recording.uuid = uuid;
+          recording.nEntries = _tree.GetTree()->GetEntries();
+        }
+      }
+
+      if (recordingPath.Length() != 0)
+        recording.cover(iLocalEntry);
+    }
+
+    if (aliasCache != nullptr && aliasCacheTreeNumber != _tree.GetTreeNumber()) {
+      if (aliasRecordingPath.Length() != 0)
+        aliasCache->add(aliasRecordingPath, std::move(aliasRecording));
+
+      aliasCacheTreeNumber = _tree.GetTreeNumber();
 
+      auto* file(_tree.GetCurrentFile());
+      aliasRecordingPath = file->GetName();
+      aliasRecording = AliasCache::FileRecord();
+      aliasRecording.uuid = file->GetUUID().AsString();
+
+      auto* cachedAliases(aliasCache->find(aliasRecordingPath, aliasRecording.uuid));
+
+      for (auto& d : drawers) {
+        for (auto& v : d->aliases) {
+          // aliases without a key are not cached
+          if (v.cacheKey.Length() == 0) {
+            v.cached = nullptr;
+            v.recording = nullptr;
+            continue;
+          }
+          v.cached = (cachedAliases == nullptr ? nullptr : cachedAliases->getColumn(v.cacheKey));
+          v.recording = &aliasRecording.columns[v.cacheKey];
+        }
+      }
+    }
+
+    if (doTimeProfile && treeNumber != _tree.GetTreeNumber()) {
+      // LoadTree opened a new file
+      profile.open.time += SteadyClock::now() - start;
+      ++profile.open.calls;
+      start = SteadyClock::now();
+    }
+
+    for (auto& d : drawers)
+      d->flibrary.setEntry(iEntryNumber);
+
+    ++iChainEntry;
     ++iEntry;
 
+    if (sampling != 0)
+      Profiler::setSampling(iEntry % sampling == 0);
+
     // Print progress
     if (iEntry % printEvery == 0) {
       _synchTools.totalEvents += printEvery;
@@ -1118,31 +2385,68 @@ multidraw::MultiDraw::executeOne_(long _nEntries, unsigned long _firstEntry, TCh
       }
 
       // Underlying tree changed; formulas must update their pointers
-      library.updateFormulaLeaves();
+      for (auto& d : drawers)
+        d->library.updateFormulaLeaves();
+
+      if (doTimeProfile) {
+        profile.treeSwitch.time += SteadyClock::now() - start;
+        ++profile.treeSwitch.calls;
+        start = SteadyClock::now();
+      }
+
+      if (profiler_) {
+        std::vector<std::pair<TString, TBranch*>> branches;
+        for (unsigned iT(0); iT != inputTrees.size(); ++iT) {
+          TTree* tree(inputTrees[iT]->GetTree());
+          // entries of indexed friends do not follow the input entries
+          if (tree == nullptr || (iT != 0 && inputTrees[iT]->GetTreeIndex() != nullptr))
+            continue;
+
+          for (auto& name : usedBranches[iT]) {
+            auto* branch(tree->GetBranch(name));
+            if (branch == nullptr || branch->GetTree() != tree)
+              continue;
+
+            if (iT == 0)
+              branches.emplace_back(name, branch);
+            else
+              branches.emplace_back(TString(inputTrees[iT]->GetName()) + "." + name, branch);
+          }
+        }
+
+        profile.openFile(branches);
+      }
 
       if (isGoodRunEvent && !isGoodRunEvent())
         continue;
 
-      // Constant overall tree weights
-      auto wItr(treeWeights_.find(treeNumber + _treeNumberOffset));
-      if (wItr == treeWeights_.end())
-        treeWeight = globalWeight_;
-      else if (wItr->second.second) // exclusive tree-by-tree weight
-        treeWeight = wItr->second.first;
-      else
-        treeWeight = globalWeight_ * wItr->second.first;
+      for (auto& d : drawers) {
+        auto& drawer(d->drawer);
 
-      auto rItr(treeReweights.find(treeNumber + _treeNumberOffset));
-      if (rItr == treeReweights.end()) {
-        treeReweight = globalReweight.get();
-        exclusiveTreeReweight = true;
-      }
-      else {
-        treeReweight = rItr->second.first.get();
-        exclusiveTreeReweight = (!globalReweight || rItr->second.second);
+        // Constant overall tree weights
+        auto wItr(drawer.treeWeights_.find(treeNumber + _treeNumberOffset));
+        if (wItr == drawer.treeWeights_.end())
+          d->treeWeight = drawer.globalWeight_;
+        else if (wItr->second.second) // exclusive tree-by-tree weight
+          d->treeWeight = wItr->second.first;
+        else
+          d->treeWeight = drawer.globalWeight_ * wItr->second.first;
+
+        auto rItr(d->treeReweights.find(treeNumber + _treeNumberOffset));
+        if (rItr == d->treeReweights.end()) {
+          d->treeReweight = d->globalReweight.get();
+          d->exclusiveTreeReweight = true;
+        }
+        else {
+          d->treeReweight = rItr->second.first.get();
+          d->exclusiveTreeReweight = (!d->globalReweight || rItr->second.second);
+        }
       }
     }
 
+    if (profiler_)
+      profile.addEntry(iLocalEntry);
+
     if (prescale_ > 1) {
       if (evtNumBranch != nullptr)
         evtNumBranch->GetEntry(iLocalEntry);
@@ -1154,97 +2458,128 @@ multidraw::MultiDraw::executeOne_(long _nEntries, unsigned long _firstEntry, TCh
         continue;
     }
 
+    cachedBlocks = nullptr;
+    if (cachedFile != nullptr) {
+      // Entries not in the record were rejected by the filter
+      cachedBlocks = cachedFile->find(iLocalEntry);
+      if (cachedBlocks == nullptr)
+        continue;
+    }
+
     // Reset formula cache
-    library.resetCache();
+    for (auto& d : drawers) {
+      d->library.resetCache();
+      d->atoms.resetEvent();
+    }
 
     if (doTimeProfile) {
-      ioTimer += SteadyClock::now() - start;
+      profile.input.time += SteadyClock::now() - start;
+      ++profile.input.calls;
       start = SteadyClock::now();
     }
 
-    if (!filterHasAliases) {
-      // Optimization in the case when the global filter does not depend on aliases
-
-      bool passFilter(filter->evaluate());
+    // Optimization in the case when the global filter does not depend on aliases
+    bool anyPass(false);
+    for (auto& d : drawers) {
+      if (cachedBlocks != nullptr) {
+        // block of the filter: n + 1 followed by n category indices
+        d->filter->setCategoryIndex(cachedBlocks + 1, cachedBlocks + cachedBlocks[0]);
+        d->passFilter = true;
+      }
+      else if (d->filterHasAliases)
+        d->passFilter = true;
+      else
+        d->passFilter = d->filter->evaluate();
 
       if (doTimeProfile) {
-        cutTimers.back() += SteadyClock::now() - start;
+        d->cutProfiles.back().time += SteadyClock::now() - start;
+        if (!d->filterHasAliases)
+          ++d->cutProfiles.back().calls;
         start = SteadyClock::now();
       }
 
-      if (!passFilter)
-        continue;
+      anyPass = anyPass || d->passFilter;
     }
 
-    if (aliasesTree) {
-      // Need to set fReadEntry to the current number first for aliases dependent on other aliases to work
-      // Need to set fEntries before fReadEntry (the latter has to be always smaller than the former)
-      aliasesTree->SetEntries(aliasesTree->GetEntries() + 1);
-      aliasesTree->LoadTree(aliasesTree->GetEntries() - 1);
-
-      for (auto& v : aliases) {
-        if (v.nbranch == nullptr) {
-          v.sourceExpr->getNdata();
-          v.values[0] = v.sourceExpr->evaluate(0);
+    if (!anyPass)
+      continue;
 
-          if (printLevel > 3)
-            std::cout << "        Alias " << v.vbranch->GetName() << ": static value " << v.values[0] << std::endl;
+    if (aliasStore) {
+      // Nominal aliases are always evaluated because the variations may refer to them
+      for (auto& d : drawers) {
+        if (d.get() != &nominal && !d->passFilter)
+          continue;
 
-          v.vbranch->Fill();
-        }
-        else {
-          auto* currentData(v.values.data());
-          v.nD = v.sourceExpr->getNdata();
-          v.values.resize(v.nD);
+        for (auto& v : d->aliases) {
+          unsigned nCached(0);
+          double const* cached(v.cached == nullptr ? nullptr : v.cached->find(iLocalEntry, nCached));
+
+          if (!v.isArray) {
+            if (cached != nullptr && nCached == 1)
+              aliasStore->set(v.index, *cached);
+            else {
+              v.sourceExpr->getNdata();
+              aliasStore->set(v.index, v.sourceExpr->evaluate(0));
+              if (v.recording != nullptr)
+                v.recording->add(iLocalEntry, aliasStore->data(v.index), 1);
+            }
 
-          if (v.values.data() != currentData) {
-            // vector was reallocated
-            v.vbranch->SetAddress(v.values.data());
+            if (printLevel > 3)
+              std::cout << "        Alias " << aliasStore->getName(v.index) << ": static value " << aliasStore->get(v.index) << std::endl;
           }
+          else {
+            unsigned nD(0);
+            double* values(nullptr);
+
+            if (cached != nullptr) {
+              nD = nCached;
+              values = aliasStore->resize(v.index, nD);
+              std::copy(cached, cached + nD, values);
+            }
+            else {
+              nD = v.sourceExpr->getNdata();
+              values = aliasStore->resize(v.index, nD);
+              v.sourceExpr->evaluateAll(values);
+              if (v.recording != nullptr)
+                v.recording->add(iLocalEntry, values, nD);
+            }
 
-          for (unsigned iD(0); iD != v.nD; ++iD)
-            v.values[iD] = v.sourceExpr->evaluate(iD);
-
-          if (printLevel > 3) {
-            std::cout << "        Alias " << v.vbranch->GetName() << ": dynamic size " << v.nD;
-            std::cout << " values [";
-            for (unsigned iD(0); iD != v.nD; ++iD) {
-              std::cout << v.values[iD];
-              if (iD != v.nD - 1)
-                std::cout << ", ";
+            if (printLevel > 3) {
+              std::cout << "        Alias " << aliasStore->getName(v.index) << ": dynamic size " << nD;
+              std::cout << " values [";
+              for (unsigned iD(0); iD != nD; ++iD) {
+                std::cout << values[iD];
+                if (iD != nD - 1)
+                  std::cout << ", ";
+              }
+              std::cout << "]" << std::endl;
             }
-            std::cout << "]" << std::endl;
           }
-
-          v.nbranch->Fill();
-          v.vbranch->Fill();
         }
       }
-      
-      // tree KeepCircular is a protected method
-      // it essentially does the following to keep the in-memory buffer finite
-      // buffer size 10000 to have fewer cycles
-      // NEVER MIND THIS SEGFAULTS FOR WHATEVER REASON - 22.11.2018
-      // if (aliasesTree->GetEntries() > maxTreeSize) {
-      //   int newSize(maxTreeSize - maxTreeSize / 10);
-      //   for (auto& v : aliases) {
-      //     v.vbranch->KeepCircular(newSize);
-      //     if (v.nbranch != nullptr)
-      //       v.nbranch->KeepCircular(newSize);
-      //   }
-      //   aliasesTree->SetEntries(newSize);
-      // }
-    }
-
-    if (filterHasAliases) {
-      bool passFilter(filter->evaluate());
 
       if (doTimeProfile) {
-        cutTimers.back() += SteadyClock::now() - start;
+        profile.aliases.time += SteadyClock::now() - start;
+        ++profile.aliases.calls;
         start = SteadyClock::now();
       }
 
-      if (!passFilter)
+      anyPass = false;
+      for (auto& d : drawers) {
+        if (d->filterHasAliases && cachedBlocks == nullptr) {
+          d->passFilter = d->filter->evaluate();
+
+          if (doTimeProfile) {
+            d->cutProfiles.back().time += SteadyClock::now() - start;
+            ++d->cutProfiles.back().calls;
+            start = SteadyClock::now();
+          }
+        }
+
+        anyPass = anyPass || d->passFilter;
+      }
+
+      if (!anyPass)
         continue;
     }
 
@@ -1256,109 +2591,228 @@ multidraw::MultiDraw::executeOne_(long _nEntries, unsigned long _firstEntry, TCh
     }
 
     if (doTimeProfile) {
-      ioTimer += SteadyClock::now() - start;
+      profile.input.time += SteadyClock::now() - start;
       start = SteadyClock::now();
     }
 
-    double commonWeight(getWeight() * treeWeight);
+    if (recordingPath.Length() != 0) {
+      recordedBlocks.clear();
+      recordCut(*nominal.filter, true);
+    }
 
-    if (treeReweight != nullptr) {
-      unsigned nD(treeReweight->getNdata());
-      if (!exclusiveTreeReweight)
-        nD = std::max(nD, globalReweight->getNdata());
-      
-      if (nD == 0)
-        continue; // skip event
+    for (auto& d : drawers) {
+      if (!d->passFilter)
+        continue;
 
-      eventWeights.resize(nD);
+      auto& eventWeights(d->eventWeights);
 
-      for (unsigned iD(0); iD != nD; ++iD) {
-        eventWeights[iD] = treeReweight->evaluate(iD) * commonWeight;
-        if (!exclusiveTreeReweight)
-          eventWeights[iD] *= globalReweight->evaluate(iD);
-      }
-    }
-    else {
-      eventWeights.assign(1, commonWeight);
-    }
+      double commonWeight(getWeight() * d->treeWeight);
 
-    if (printLevel > 3) {
-      std::cout << "         Global weights: ";
-      for (double w : eventWeights)
-        std::cout << w << " ";
-      std::cout << std::endl;
-    }
+      if (d->treeReweight != nullptr) {
+        unsigned nD(d->treeReweight->getNdata());
+        if (!d->exclusiveTreeReweight)
+          nD = std::max(nD, d->globalReweight->getNdata());
+      
+        if (nD == 0) {
+          // skip event; the cut results are still recorded
+          if (recordingPath.Length() != 0) {
+            for (auto& cut : d->cuts)
+              recordCut(*cut, cut->evaluate());
+            recording.add(iLocalEntry, recordedBlocks);
+          }
+          continue;
+        }
 
-    if (doTimeProfile) {
-      eventTimer += SteadyClock::now() - start;
-      start = SteadyClock::now();
-    }
+        eventWeights.resize(nD);
 
-    filter->fillExprs(eventWeights);
+        for (unsigned iD(0); iD != nD; ++iD) {
+          eventWeights[iD] = d->treeReweight->evaluate(iD) * commonWeight;
+          if (!d->exclusiveTreeReweight)
+            eventWeights[iD] *= d->globalReweight->evaluate(iD);
+        }
+      }
+      else {
+        eventWeights.assign(1, commonWeight);
+      }
 
-    if (doTimeProfile) {
-      cutTimers.back() += SteadyClock::now() - start;
-      start = SteadyClock::now();
-    }
+      if (printLevel > 3) {
+        std::cout << "         Global weights";
+        if (d->variation.Length() != 0)
+          std::cout << " (" << d->variation << ")";
+        std::cout << ": ";
+        for (double w : eventWeights)
+          std::cout << w << " ";
+        std::cout << std::endl;
+      }
+
+      if (doTimeProfile) {
+        profile.reweight.time += SteadyClock::now() - start;
+        ++profile.reweight.calls;
+        start = SteadyClock::now();
+      }
 
-    for (unsigned iC(0); iC != cuts.size(); ++iC) {
-      if (cuts[iC]->evaluate())
-        cuts[iC]->fillExprs(eventWeights);
+      d->filter->fillExprs(eventWeights);
 
       if (doTimeProfile) {
-        cutTimers[iC] += SteadyClock::now() - start;
+        d->cutProfiles.back().time += SteadyClock::now() - start;
+        ++d->cutPasses.back();
         start = SteadyClock::now();
       }
+
+      // blocks of the cuts follow the block of the filter
+      int const* block(cachedBlocks == nullptr ? nullptr : cachedBlocks + cachedBlocks[0]);
+
+      for (unsigned iC(0); iC != d->cuts.size(); ++iC) {
+        bool pass(false);
+        if (block != nullptr) {
+          pass = (*block != 0);
+          if (pass)
+            d->cuts[iC]->setCategoryIndex(block + 1, block + *block);
+          block += (pass ? *block : 1);
+        }
+        else {
+          pass = d->cuts[iC]->evaluate();
+          if (recordingPath.Length() != 0)
+            recordCut(*d->cuts[iC], pass);
+        }
+
+        if (pass)
+          d->cuts[iC]->fillExprs(eventWeights);
+
+        if (doTimeProfile) {
+          d->cutProfiles[iC].time += SteadyClock::now() - start;
+          ++d->cutProfiles[iC].calls;
+          if (pass)
+            ++d->cutPasses[iC];
+          start = SteadyClock::now();
+        }
+      }
+
+      if (recordingPath.Length() != 0)
+        recording.add(iLocalEntry, recordedBlocks);
     }
   }
 
+  if (profiler_) {
+    Profiler::setSampling(false);
+    profile.closeFile();
+  }
+
+  if (recordingPath.Length() != 0)
+    cutCache->add(recordingPath, std::move(recording));
+
+  if (aliasRecordingPath.Length() != 0)
+    aliasCache->add(aliasRecordingPath, std::move(aliasRecording));
+
   // Add the residual number of events
   _synchTools.totalEvents += (iEntry % printEvery);
 
-  if (printLevel >= 0 && doTimeProfile) {
-    double totalTime(millisec(ioTimer) + millisec(eventTimer));
-    totalTime += millisec(std::accumulate(cutTimers.begin(), cutTimers.end(), SteadyClock::duration::zero()));
+  if (printLevel >= 0 && printTimeProfile) {
+    double totalTime(profile.open.millisec() + profile.treeSwitch.millisec() + profile.input.millisec() + profile.aliases.millisec() + profile.reweight.millisec());
+    for (auto& d : drawers) {
+      for (auto& counter : d->cutProfiles)
+        totalTime += counter.millisec();
+    }
     std::cout << std::endl;
     std::cout << " Execution time: " << (totalTime / iEntry) << " ms/evt" << std::endl;
 
-    std::cout << "        Time spent on tree input: " << (millisec(ioTimer) / iEntry) << " ms/evt" << std::endl;
-    std::cout << "        Time spent on event reweighting: " << (millisec(eventTimer) / iEntry) << " ms/evt" << std::endl;
+    std::cout << "        Time spent on opening files: " << (profile.open.millisec() / iEntry) << " ms/evt" << std::endl;
+    std::cout << "        Time spent on switching trees: " << (profile.treeSwitch.millisec() / iEntry) << " ms/evt (" << profile.treeSwitch.calls << " files)" << std::endl;
+    std::cout << "        Time spent on tree input: " << (profile.input.millisec() / iEntry) << " ms/evt" << std::endl;
+    if (prefetchCacheSize_ > 0) {
+      std::cout << "        Bytes read from input (all threads): " << (TFile::GetFileBytesRead() - bytesReadStart) << std::endl;
+      auto* cache(_tree.GetCurrentFile() == nullptr ? nullptr : _tree.GetReadCache(_tree.GetCurrentFile()));
+      if (cache != nullptr)
+        std::cout << "        Read cache efficiency (last file): " << cache->GetEfficiency() << std::endl;
+    }
+    if (aliasStore)
+      std::cout << "        Time spent on aliases: " << (profile.aliases.millisec() / iEntry) << " ms/evt" << std::endl;
+    std::cout << "        Time spent on event reweighting: " << (profile.reweight.millisec() / iEntry) << " ms/evt" << std::endl;
 
     if (printLevel > 0) {
-      std::cout << "        cut " << filter->getName() << ": ";
-      std::cout << (millisec(cutTimers.back()) / iEntry) << " ms/evt" << std::endl;
-      for (unsigned iC(0); iC != cuts.size(); ++iC) {
-        std::cout << "        cut " << cuts[iC]->getName() << ": ";
-        std::cout << (millisec(cutTimers[iC]) / cuts[0]->getCount()) << " ms/evt" << std::endl;
+      auto printCut([iEntry](Cut const& _cut, ProfileCounter const& _counter, unsigned long long _passes) {
+          std::cout << "        cut " << _cut.getName() << ": " << (_counter.millisec() / iEntry) << " ms/evt";
+          std::cout << " (" << _counter.calls << " evaluations, " << _passes << " passed)" << std::endl;
+        });
+
+      for (auto& d : drawers) {
+        if (d->variation.Length() != 0)
+          std::cout << "        variation " << d->variation << std::endl;
+
+        printCut(*d->filter, d->cutProfiles.back(), d->cutPasses.back());
+        for (unsigned iC(0); iC != d->cuts.size(); ++iC)
+          printCut(*d->cuts[iC], d->cutProfiles[iC], d->cutPasses[iC]);
       }
     }
   }
 
+  if (profiler_) {
+    profile.mainThread = isMainThread;
+    profile.entries = iEntry;
+
+    for (auto& d : drawers) {
+      auto addCut([&profile, &d](Cut const& _cut, unsigned _iC) {
+          profile.cuts.emplace_back();
+          auto& cutProfile(profile.cuts.back());
+          cutProfile.variation = d->variation;
+          cutProfile.name = _cut.getName();
+          cutProfile.counter = d->cutProfiles[_iC];
+          cutProfile.passed = d->cutPasses[_iC];
+          for (unsigned iF(0); iF != _cut.getNFillers(); ++iF) {
+            cutProfile.fillers.emplace_back();
+            cutProfile.fillers.back().name = _cut.getFiller(iF)->getObj(0).GetName();
+            cutProfile.fillers.back().counter = _cut.getFillerProfiles().at(iF);
+          }
+        });
+
+      addCut(*d->filter, d->cuts.size());
+      for (unsigned iC(0); iC != d->cuts.size(); ++iC)
+        addCut(*d->cuts[iC], iC);
+
+      profile.addFormulas(d->library);
+    }
+
+    profiler_->addThread(std::move(profile));
+  }
+
   if (isMainThread) {
     // unlink and return pointers
 
-    filter->unlinkTree();
-    filter_ = std::move(filter);
+    for (auto& d : drawers) {
+      d->filter->reduceExprs();
+      d->filter->unlinkTree();
+      d->drawer.filter_ = std::move(d->filter);
 
-    for (auto& cut : cuts) {
-      cut->unlinkTree();
-      cuts_[cut->getName()] = std::move(cut);
+      for (auto& cut : d->cuts) {
+        cut->reduceExprs();
+        cut->unlinkTree();
+        d->drawer.cuts_[cut->getName()] = std::move(cut);
+      }
     }
   }
   else {
     // merge & cleanup
 
+    // Histogram buffers are merged pairwise among the threads without waiting for the main thread
+    for (auto& d : drawers) {
+      d->filter->reduceExprs();
+      for (auto& cut : d->cuts)
+        cut->reduceExprs();
+    }
+
     // Again we'll just lock the entire block
     std::unique_lock<std::mutex> lock(_synchTools.mutex);
     _synchTools.condition.wait(lock, [&_synchTools]() { return _synchTools.mainDone; });
 
     // Clone fillers will merge themselves to the main object in the destructor of the cuts
-    filter.reset();
-    cuts.clear();
+    for (auto& d : drawers) {
+      d->filter.reset();
+      d->cuts.clear();
+    }
   }
 
-  if (aliasesTree)
-    _tree.RemoveFriend(aliasesTree.get());
+  if (aliasesTree != nullptr)
+    _tree.RemoveFriend(aliasesTree);
 
   return iEntry;
 }
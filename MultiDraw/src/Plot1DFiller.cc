@@ -2,6 +2,7 @@
 #include "../interface/FormulaLibrary.h"
 
 #include <iostream>
+#include <limits>
 #include <sstream>
 #include <thread>
 
@@ -37,6 +38,33 @@ multidraw::Plot1DFiller::Plot1DFiller(TObjArray& _histlist, Plot1DFiller const&
 {
 }
 
+void
+multidraw::Plot1DFiller::initialize_()
+{
+  // The main-thread filler accumulates into a dense buffer too (thread clones get theirs in clone_)
+  if (cloneSource_ == nullptr && HistogramBuffer::canBuffer(tobj_, categorized_))
+    histBuffer_ = makeHistBuffer_();
+
+  // Resolve the overflow treatment into a threshold and a replacement value per category
+  unsigned nCat(categorized_ ? static_cast<TObjArray&>(tobj_).GetEntriesFast() : 1);
+  overflowThresholds_.assign(nCat, std::numeric_limits<double>::infinity());
+  overflowValues_.assign(nCat, 0.);
+
+  if (overflowMode_ == OverflowMode::kDefault)
+    return;
+
+  for (unsigned icat(0); icat != nCat; ++icat) {
+    auto& axis(*getHist(categorized_ ? icat : -1).GetXaxis());
+    int nbins(axis.GetNbins());
+
+    overflowValues_[icat] = axis.GetBinLowEdge(nbins);
+    if (overflowMode_ == OverflowMode::kDedicated)
+      overflowThresholds_[icat] = axis.GetBinLowEdge(nbins);
+    else
+      overflowThresholds_[icat] = axis.GetBinUpEdge(nbins);
+  }
+}
+
 void
 multidraw::Plot1DFiller::doFill_(unsigned _iD, int _icat/* = -1*/)
 {
@@ -45,27 +73,52 @@ multidraw::Plot1DFiller::doFill_(unsigned _iD, int _icat/* = -1*/)
   if (printLevel_ > 3)
     std::cout << "            Fill(" << x << "; " << entryWeight_ << ")" << std::endl;
 
-  auto& hist(getHist(_icat));
-
-  switch (overflowMode_) {
-  case OverflowMode::kDefault:
-    break;
-  case OverflowMode::kDedicated:
-    if (x > hist.GetXaxis()->GetBinLowEdge(hist.GetNbinsX()))
-      x = hist.GetXaxis()->GetBinLowEdge(hist.GetNbinsX());
-    break;
-  case OverflowMode::kMergeLast:
-    if (x > hist.GetXaxis()->GetBinUpEdge(hist.GetNbinsX()))
-      x = hist.GetXaxis()->GetBinLowEdge(hist.GetNbinsX());
-    break;
+  unsigned icat(categorized_ ? _icat : 0);
+
+  unsigned nV(variationReweights_.size());
+  if (nV != 0) {
+    // objects of the category start at icat * nV
+    icat *= nV;
+
+    if (x > overflowThresholds_.at(icat))
+      x = overflowValues_[icat];
+
+    double const* factors(evaluateVariations_(_iD));
+
+    if (histBuffer_)
+      histBuffer_->fillVariations(icat, x, entryWeight_, factors);
+    else {
+      for (unsigned iV(0); iV != nV; ++iV)
+        getHist(icat + iV).Fill(x, entryWeight_ * factors[iV]);
+    }
+    return;
   }
 
-  hist.Fill(x, entryWeight_);
+  if (x > overflowThresholds_.at(icat))
+    x = overflowValues_[icat];
+
+  if (histBuffer_)
+    histBuffer_->fill(icat, x, entryWeight_);
+  else
+    getHist(_icat).Fill(x, entryWeight_);
 }
 
 multidraw::ExprFiller*
 multidraw::Plot1DFiller::clone_()
 {
+  if (HistogramBuffer::canBuffer(tobj_, categorized_)) {
+    // Accumulate into a dense buffer and read the binning from the shared histograms
+    Plot1DFiller* clone(nullptr);
+    if (categorized_)
+      clone = new Plot1DFiller(static_cast<TObjArray&>(tobj_), *this);
+    else
+      clone = new Plot1DFiller(getHist(), *this);
+
+    clone->sharedObj_ = true;
+    clone->histBuffer_ = makeHistBuffer_();
+    return clone;
+  }
+
   if (categorized_) {
     auto& myArray(static_cast<TObjArray&>(tobj_));
 
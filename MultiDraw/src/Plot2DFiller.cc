@@ -34,6 +34,14 @@ multidraw::Plot2DFiller::Plot2DFiller(TObjArray& _histlist, Plot2DFiller const&
 {
 }
 
+void
+multidraw::Plot2DFiller::initialize_()
+{
+  // The main-thread filler accumulates into a dense buffer too (thread clones get theirs in clone_)
+  if (cloneSource_ == nullptr && HistogramBuffer::canBuffer(tobj_, categorized_))
+    histBuffer_ = makeHistBuffer_();
+}
+
 void
 multidraw::Plot2DFiller::doFill_(unsigned _iD, int _icat/* = -1*/)
 {
@@ -43,14 +51,43 @@ multidraw::Plot2DFiller::doFill_(unsigned _iD, int _icat/* = -1*/)
   if (printLevel_ > 3)
     std::cout << "            Fill(" << x << ", " << y << "; " << entryWeight_ << ")" << std::endl;
 
-  auto& hist(getHist(_icat));
+  unsigned nV(variationReweights_.size());
+  if (nV != 0) {
+    // objects of the category start at icat * nV
+    unsigned icat(_icat * nV);
+    double const* factors(evaluateVariations_(_iD));
+
+    if (histBuffer_)
+      histBuffer_->fillVariations(icat, x, y, entryWeight_, factors);
+    else {
+      for (unsigned iV(0); iV != nV; ++iV)
+        getHist(icat + iV).Fill(x, y, entryWeight_ * factors[iV]);
+    }
+    return;
+  }
 
-  hist.Fill(x, y, entryWeight_);
+  if (histBuffer_)
+    histBuffer_->fill(categorized_ ? _icat : 0, x, y, entryWeight_);
+  else
+    getHist(_icat).Fill(x, y, entryWeight_);
 }
 
 multidraw::ExprFiller*
 multidraw::Plot2DFiller::clone_()
 {
+  if (HistogramBuffer::canBuffer(tobj_, categorized_)) {
+    // Accumulate into a dense buffer and read the binning from the shared histograms
+    Plot2DFiller* clone(nullptr);
+    if (categorized_)
+      clone = new Plot2DFiller(static_cast<TObjArray&>(tobj_), *this);
+    else
+      clone = new Plot2DFiller(getHist(), *this);
+
+    clone->sharedObj_ = true;
+    clone->histBuffer_ = makeHistBuffer_();
+    return clone;
+  }
+
   if (categorized_) {
     auto& myArray(static_cast<TObjArray&>(tobj_));
 
@@ -0,0 +1,277 @@
+#include "../interface/Profiler.h"
+#include "../interface/FormulaLibrary.h"
+
+#include "TBranch.h"
+#include "TObjArray.h"
+
+#include <fstream>
+#include <algorithm>
+#include <stdexcept>
+
+namespace {
+
+  thread_local bool sampling{false};
+
+  //! JSON string literal
+  std::string
+  quote(TString const& _str)
+  {
+    std::string result("\"");
+    for (char c : std::string(_str.Data())) {
+      switch (c) {
+      case '"':
+        result += "\\\"";
+        break;
+      case '\\':
+        result += "\\\\";
+        break;
+      case '\n':
+        result += "\\n";
+        break;
+      case '\t':
+        result += "\\t";
+        break;
+      default:
+        result += c;
+      }
+    }
+    result += "\"";
+    return result;
+  }
+
+  void
+  writeCounter(std::ostream& _out, multidraw::ProfileCounter const& _counter)
+  {
+    _out << "\"calls\": " << _counter.calls << ", \"timed\": " << _counter.timed << ", \"ms\": " << _counter.millisec();
+  }
+
+  void
+  writeCuts(std::ostream& _out, std::vector<multidraw::Profiler::CutProfile> const& _cuts, char const* _indent)
+  {
+    _out << "[";
+    for (unsigned iC(0); iC != _cuts.size(); ++iC) {
+      auto& cut(_cuts[iC]);
+      _out << (iC == 0 ? "\n" : ",\n") << _indent << "  {\"variation\": " << quote(cut.variation) << ", \"name\": " << quote(cut.name) << ", ";
+      writeCounter(_out, cut.counter);
+      _out << ", \"passed\": " << cut.passed << ", \"fillers\": [";
+      for (unsigned iF(0); iF != cut.fillers.size(); ++iF) {
+        auto& filler(cut.fillers[iF]);
+        _out << (iF == 0 ? "" : ", ") << "{\"name\": " << quote(filler.name) << ", ";
+        writeCounter(_out, filler.counter);
+        _out << "}";
+      }
+      _out << "]}";
+    }
+    _out << "\n" << _indent << "]";
+  }
+
+}
+
+double
+multidraw::ProfileCounter::millisec() const
+{
+  double ms(std::chrono::duration_cast<std::chrono::nanoseconds>(time).count() * 1.e-6);
+  if (timed == 0 || timed >= calls)
+    return ms;
+
+  return ms * calls / timed;
+}
+
+multidraw::ProfileCounter&
+multidraw::ProfileCounter::operator+=(ProfileCounter const& _rhs)
+{
+  time += _rhs.time;
+  calls += _rhs.calls;
+  timed += _rhs.timed;
+  return *this;
+}
+
+void
+multidraw::Profiler::ThreadProfile::addFormulas(FormulaLibrary const& _library)
+{
+  for (auto& ec : _library.getCaches()) {
+    auto& cache(*ec.second);
+    if (cache.fNCalls == 0 || !addedCaches_.insert(&cache).second)
+      continue;
+
+    auto& formula(formulas[ec.first.c_str()]);
+    formula.calls += cache.fNCalls;
+    formula.evaluations.calls += cache.fNEvaluations;
+    formula.evaluations.timed += cache.fNTimed;
+    formula.evaluations.time += std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::nanoseconds(cache.fTimedNanosec));
+  }
+}
+
+void
+multidraw::Profiler::ThreadProfile::openFile(std::vector<std::pair<TString, TBranch*>> const& _branches)
+{
+  closeFile();
+
+  for (auto& nb : _branches) {
+    fileBaskets_.emplace_back(nb.first, std::vector<Basket>());
+    auto& baskets(fileBaskets_.back().second);
+
+    std::vector<TBranch*> queue{nb.second};
+    while (!queue.empty()) {
+      TBranch* b(queue.back());
+      queue.pop_back();
+
+      for (auto* obj : *b->GetListOfBranches())
+        queue.push_back(static_cast<TBranch*>(obj));
+
+      Long64_t const* basketEntry(b->GetBasketEntry());
+      Int_t const* basketBytes(b->GetBasketBytes());
+      if (basketEntry == nullptr || basketBytes == nullptr)
+        continue;
+
+      // basket iB holds the entries [basketEntry[iB], basketEntry[iB + 1])
+      int nBaskets(b->GetWriteBasket());
+      for (int iB(0); iB != nBaskets; ++iB) {
+        Long64_t last(iB + 1 < nBaskets ? basketEntry[iB + 1] - 1 : b->GetEntries() - 1);
+        baskets.push_back(Basket{basketEntry[iB], last, basketBytes[iB]});
+      }
+    }
+  }
+}
+
+void
+multidraw::Profiler::ThreadProfile::closeFile()
+{
+  if (fileFirst_ >= 0) {
+    for (auto& nb : fileBaskets_) {
+      Long64_t& bytes(branchBytes[nb.first]);
+      for (auto& basket : nb.second) {
+        if (basket.last >= fileFirst_ && basket.first <= fileLast_)
+          bytes += basket.bytes;
+      }
+    }
+  }
+
+  fileBaskets_.clear();
+  fileFirst_ = -1;
+  fileLast_ = -1;
+}
+
+void
+multidraw::Profiler::addThread(ThreadProfile&& _profile)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  threads_.push_back(std::move(_profile));
+}
+
+void
+multidraw::Profiler::writeJSON(char const* _path) const
+{
+  std::ofstream out(_path);
+  if (!out.is_open())
+    throw std::runtime_error(TString::Format("Cannot open %s for writing", _path).Data());
+
+  // Sums over the threads
+  ThreadProfile total;
+  for (auto& thread : threads_) {
+    total.entries += thread.entries;
+    total.open += thread.open;
+    total.treeSwitch += thread.treeSwitch;
+    total.input += thread.input;
+    total.aliases += thread.aliases;
+    total.reweight += thread.reweight;
+
+    // All threads have the same cuts and fillers in the same order
+    if (total.cuts.empty())
+      total.cuts = thread.cuts;
+    else {
+      for (unsigned iC(0); iC != thread.cuts.size(); ++iC) {
+        auto& cut(total.cuts.at(iC));
+        cut.counter += thread.cuts[iC].counter;
+        cut.passed += thread.cuts[iC].passed;
+        for (unsigned iF(0); iF != cut.fillers.size(); ++iF)
+          cut.fillers[iF].counter += thread.cuts[iC].fillers.at(iF).counter;
+      }
+    }
+
+    for (auto& ef : thread.formulas) {
+      auto& formula(total.formulas[ef.first]);
+      formula.calls += ef.second.calls;
+      formula.evaluations += ef.second.evaluations;
+    }
+
+    for (auto& bb : thread.branchBytes)
+      total.branchBytes[bb.first] += bb.second;
+  }
+
+  std::vector<std::pair<TString, FormulaProfile const*>> formulas;
+  for (auto& ef : total.formulas)
+    formulas.emplace_back(ef.first, &ef.second);
+  std::sort(formulas.begin(), formulas.end(), [](std::pair<TString, FormulaProfile const*> const& a, std::pair<TString, FormulaProfile const*> const& b) {
+      return a.second->evaluations.millisec() > b.second->evaluations.millisec();
+    });
+
+  std::vector<std::pair<TString, Long64_t>> branches(total.branchBytes.begin(), total.branchBytes.end());
+  std::sort(branches.begin(), branches.end(), [](std::pair<TString, Long64_t> const& a, std::pair<TString, Long64_t> const& b) {
+      return a.second > b.second;
+    });
+
+  auto writeThread([&out](ThreadProfile const& _thread, char const* _indent) {
+      out << "{\n";
+      out << _indent << "  \"entries\": " << _thread.entries << ",\n";
+      out << _indent << "  \"open\": {";
+      writeCounter(out, _thread.open);
+      out << "},\n" << _indent << "  \"tree_switch\": {";
+      writeCounter(out, _thread.treeSwitch);
+      out << "},\n" << _indent << "  \"input\": {";
+      writeCounter(out, _thread.input);
+      out << "},\n" << _indent << "  \"aliases\": {";
+      writeCounter(out, _thread.aliases);
+      out << "},\n" << _indent << "  \"reweight\": {";
+      writeCounter(out, _thread.reweight);
+      out << "},\n" << _indent << "  \"cuts\": ";
+      writeCuts(out, _thread.cuts, (TString(_indent) + "  ").Data());
+      out << "\n" << _indent << "}";
+    });
+
+  out << "{\n";
+  out << "  \"sampling\": " << sampling_ << ",\n";
+  out << "  \"total\": ";
+  writeThread(total, "  ");
+  out << ",\n";
+
+  out << "  \"threads\": [";
+  for (unsigned iT(0); iT != threads_.size(); ++iT) {
+    out << (iT == 0 ? "\n" : ",\n") << "    {\"main\": " << (threads_[iT].mainThread ? "true" : "false") << ", \"profile\": ";
+    writeThread(threads_[iT], "    ");
+    out << "}";
+  }
+  out << "\n  ],\n";
+
+  out << "  \"formulas\": [";
+  for (unsigned iF(0); iF != formulas.size(); ++iF) {
+    auto& formula(*formulas[iF].second);
+    double hitRate(formula.calls == 0 ? 0. : 1. - double(formula.evaluations.calls) / formula.calls);
+    out << (iF == 0 ? "\n" : ",\n") << "    {\"expr\": " << quote(formulas[iF].first) << ", \"eval_instance\": " << formula.calls;
+    out << ", \"cache_hit_rate\": " << hitRate << ", ";
+    writeCounter(out, formula.evaluations);
+    out << "}";
+  }
+  out << "\n  ],\n";
+
+  out << "  \"branches\": [";
+  for (unsigned iB(0); iB != branches.size(); ++iB)
+    out << (iB == 0 ? "\n" : ",\n") << "    {\"name\": " << quote(branches[iB].first) << ", \"bytes\": " << branches[iB].second << "}";
+  out << "\n  ]\n";
+
+  out << "}" << std::endl;
+}
+
+/*static*/
+void
+multidraw::Profiler::setSampling(bool _s)
+{
+  sampling = _s;
+}
+
+/*static*/
+bool
+multidraw::Profiler::isSampling()
+{
+  return sampling;
+}
@@ -5,15 +5,17 @@
 #include "TClass.h"
 #include "TTreeFormulaManager.h"
 
-multidraw::Reweight::Reweight(CompiledExprPtr&& _x, TObject const* _source/* = nullptr*/) :
-  source_(_source)
+multidraw::Reweight::Reweight(CompiledExprPtr&& _x, TObject const* _source/* = nullptr*/, ReweightSnapshot const& _snapshot/* = ReweightSnapshot()*/) :
+  source_(_source),
+  snapshot_(_snapshot)
 {
   exprs_.emplace_back(std::move(_x));
   setEvalType_();
 }
   
-multidraw::Reweight::Reweight(CompiledExprPtr&& _x, CompiledExprPtr&& _y, TObject const* _source) :
-  source_(_source)
+multidraw::Reweight::Reweight(CompiledExprPtr&& _x, CompiledExprPtr&& _y, TObject const* _source, ReweightSnapshot const& _snapshot/* = ReweightSnapshot()*/) :
+  source_(_source),
+  snapshot_(_snapshot)
 {
   exprs_.emplace_back(std::move(_x));
   exprs_.emplace_back(std::move(_y));
@@ -38,10 +40,14 @@ multidraw::Reweight::setEvalType_()
     if (hist.GetDimension() != int(exprs_.size()))
       throw std::runtime_error(std::string("Invalid number of formulas given for histogram source of type ") + hist.IsA()->GetName());
 
+    if (!snapshot_.histogram)
+      snapshot_.histogram = std::make_shared<HistogramLookup const>(hist);
+
     evaluate_ = [this](unsigned i)->double { return this->evaluateTH1_(i); };
   }
   else if (source_->InheritsFrom(TGraph::Class())) {
-    spline_.reset(new TSpline3("interpolation", static_cast<TGraph const*>(source_)));
+    if (!snapshot_.graph)
+      snapshot_.graph = std::make_shared<GraphInterpolator const>(static_cast<TGraph const&>(*source_));
   
     evaluate_ = [this](unsigned i)->double { return this->evaluateTGraph_(i); };
   }
@@ -90,8 +96,6 @@ multidraw::Reweight::evaluateRaw_(unsigned _iD)
 double
 multidraw::Reweight::evaluateTH1_(unsigned _iD)
 {
-  auto& hist(static_cast<TH1 const&>(*source_));
-
   double x[2]{};
   for (unsigned iDim(0); iDim != exprs_.size(); ++iDim) {
     auto& expr(*exprs_[iDim]);
@@ -104,27 +108,19 @@ multidraw::Reweight::evaluateTH1_(unsigned _iD)
     x[iDim] = expr.evaluate(_iD);
   }
 
-  int iBin(hist.FindFixBin(x[0], x[1]));
-
-  // not handling over/underflow at the moment
-
-  return hist.GetBinContent(iBin);
+  return snapshot_.histogram->getValue(x[0], x[1], snapshot_.clampOverflow);
 }
 
 double
 multidraw::Reweight::evaluateTGraph_(unsigned _iD)
 {
-  auto& graph(static_cast<TGraph const&>(*source_));
-
   if (exprs_[0]->getFormula() != nullptr) {
     exprs_[0]->getNdata();
     if (_iD != 0)
       exprs_[0]->evaluate(0);
   }
   
-  double x(exprs_[0]->evaluate(_iD));
-
-  return graph.Eval(x, spline_.get());
+  return snapshot_.graph->eval(exprs_[0]->evaluate(_iD));
 }
 
 double
@@ -164,7 +160,9 @@ multidraw::FactorizedReweight::getFormula(unsigned i/* = 0*/) const
 
 multidraw::ReweightSource::ReweightSource(ReweightSource const& _orig) :
   exprs_(_orig.exprs_),
-  source_(_orig.source_)
+  source_(_orig.source_),
+  interpolation_(_orig.interpolation_),
+  snapshot_(_orig.snapshot_)
 {
   if (_orig.subReweights_[0]) {
     subReweights_[0] = std::make_unique<ReweightSource>(*_orig.subReweights_[0]);
@@ -172,6 +170,48 @@ multidraw::ReweightSource::ReweightSource(ReweightSource const& _orig) :
   }
 }
 
+void
+multidraw::ReweightSource::setClampOverflow(bool _c)
+{
+  snapshot_.clampOverflow = _c;
+
+  if (subReweights_[0]) {
+    subReweights_[0]->setClampOverflow(_c);
+    subReweights_[1]->setClampOverflow(_c);
+  }
+}
+
+void
+multidraw::ReweightSource::setInterpolation(GraphInterpolator::Mode _mode)
+{
+  interpolation_ = _mode;
+
+  if (subReweights_[0]) {
+    subReweights_[0]->setInterpolation(_mode);
+    subReweights_[1]->setInterpolation(_mode);
+  }
+  else if (snapshot_.graph && snapshot_.graph->getMode() != _mode)
+    snapshot_.graph = std::make_shared<GraphInterpolator const>(static_cast<TGraph const&>(*source_), _mode);
+}
+
+void
+multidraw::ReweightSource::makeSnapshot_()
+{
+  if (source_ == nullptr)
+    return;
+
+  if (source_->InheritsFrom(TH1::Class())) {
+    auto& hist(static_cast<TH1 const&>(*source_));
+    // Reweight throws for the dimension mismatch at compile time
+    if (hist.GetDimension() != int(exprs_.size()))
+      return;
+
+    snapshot_.histogram = std::make_shared<HistogramLookup const>(hist);
+  }
+  else if (source_->InheritsFrom(TGraph::Class()))
+    snapshot_.graph = std::make_shared<GraphInterpolator const>(static_cast<TGraph const&>(*source_), interpolation_);
+}
+
 multidraw::ReweightPtr
 multidraw::ReweightSource::compile(FormulaLibrary& _formulaLibrary, FunctionLibrary& _functionLibrary) const
 {
@@ -179,7 +219,7 @@ multidraw::ReweightSource::compile(FormulaLibrary& _formulaLibrary, FunctionLibr
     return ReweightPtr(new FactorizedReweight(subReweights_[0]->compile(_formulaLibrary, _functionLibrary), subReweights_[1]->compile(_formulaLibrary, _functionLibrary)));
 
   if (exprs_.size() == 1)
-    return std::make_unique<Reweight>(exprs_[0].compile(_formulaLibrary, _functionLibrary), source_);
+    return std::make_unique<Reweight>(exprs_[0].compile(_formulaLibrary, _functionLibrary), source_, snapshot_);
   else
-    return std::make_unique<Reweight>(exprs_[0].compile(_formulaLibrary, _functionLibrary), exprs_[1].compile(_formulaLibrary, _functionLibrary), source_);
+    return std::make_unique<Reweight>(exprs_[0].compile(_formulaLibrary, _functionLibrary), exprs_[1].compile(_formulaLibrary, _functionLibrary), source_, snapshot_);
 }
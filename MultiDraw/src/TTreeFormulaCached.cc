@@ -1,11 +1,24 @@
 #include "../interface/TTreeFormulaCached.h"
+#include "../interface/Profiler.h"
+#include "../interface/ExprGraph.h"
 
 #include "TError.h"
 #include "TCutG.h"
 #include "TTree.h"
+#include "TBranch.h"
+#include "TLeaf.h"
+#include "TLeafF.h"
+#include "TLeafD.h"
+#include "TLeafI.h"
+#include "TLeafS.h"
+#include "TLeafL.h"
+#include "TLeafB.h"
+#include "TLeafO.h"
 #include "TNamed.h"
 #include "TTreeFormulaManager.h"
 
+#include <chrono>
+
 ClassImp(TTreeFormulaCached)
 
 TTreeFormulaCached::TTreeFormulaCached(char const* _name, char const* _formula, TTree* _tree, CachePtr const& _cache) :
@@ -117,17 +130,138 @@ TTreeFormulaCached::EvalInstance(Int_t _i, char const* _stringStack[]/* = nullpt
         return EvalInstance(fCache->fValues.size() - 1, _stringStack);
     }
 
+    if (fCache->fProfile)
+      return EvalProfiled(_i, _stringStack);
+
     if (!fCache->fValues[_i].first) {
       fCache->fValues[_i].first = true;
-      fCache->fValues[_i].second = TTreeFormula::EvalInstance(_i, _stringStack);
+      fCache->fValues[_i].second = EvalUncached(_i, _stringStack);
     }
 
     return fCache->fValues[_i].second;
   }
+  else
+    return EvalUncached(_i, _stringStack);
+}
+
+Double_t
+TTreeFormulaCached::EvalUncached(Int_t _i, char const* _stringStack[])
+{
+  if (fCompiled != nullptr)
+    return EvalCompiled();
+  else if (fGraph != nullptr)
+    return fGraph->evaluate(fGraphNode);
   else
     return TTreeFormula::EvalInstance(_i, _stringStack);
 }
 
+Double_t
+TTreeFormulaCached::EvalProfiled(Int_t _i, char const* _stringStack[])
+{
+  // Same as the cached branch of EvalInstance, with the profile counters
+  ++fCache->fNCalls;
+
+  if (!fCache->fValues[_i].first) {
+    ++fCache->fNEvaluations;
+
+    bool timed(multidraw::Profiler::isSampling());
+    std::chrono::steady_clock::time_point start;
+    if (timed)
+      start = std::chrono::steady_clock::now();
+
+    fCache->fValues[_i].first = true;
+    fCache->fValues[_i].second = EvalUncached(_i, _stringStack);
+
+    if (timed) {
+      ++fCache->fNTimed;
+      fCache->fTimedNanosec += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    }
+  }
+
+  return fCache->fValues[_i].second;
+}
+
+Double_t
+TTreeFormulaCached::EvalCompiled()
+{
+  // Compiled formulas are always scalar; branch loading normally done in TTreeFormula::EvalInstance is done here
+  for (unsigned iL(0); iL != fCompiledLeaves.size(); ++iL) {
+    auto* leaf(static_cast<TLeaf*>(fLeaves.UncheckedAt(fCompiledLeaves[iL].fCode)));
+    auto* branch(leaf->GetBranch());
+    Long64_t entry(branch->GetTree()->GetReadEntry());
+    if (branch->GetReadEntry() != entry)
+      branch->GetEntry(entry);
+
+    // value pointers are fetched every time because they change when the branch address is reset
+    fCompiledValues[iL] = leaf->GetValuePointer();
+    fCompiledLengths[iL] = leaf->GetLen();
+  }
+
+  return fCompiled(fCompiledValues.data(), fCompiledLengths.data());
+}
+
+void
+TTreeFormulaCached::UpdateFormulaLeaves()
+{
+  TTreeFormula::UpdateFormulaLeaves();
+
+  CheckCompiledLeaves();
+}
+
+void
+TTreeFormulaCached::SetCompiledFunction(CompiledFunction _function, std::vector<CompiledLeaf> const& _leaves)
+{
+  fCompiled = _function;
+  fCompiledLeaves = _leaves;
+  fCompiledValues.assign(_leaves.size(), nullptr);
+  fCompiledLengths.assign(_leaves.size(), 0);
+
+  CheckCompiledLeaves();
+}
+
+void
+TTreeFormulaCached::CheckCompiledLeaves()
+{
+  if (fCompiled == nullptr)
+    return;
+
+  for (auto& cl : fCompiledLeaves) {
+    auto* leaf(static_cast<TLeaf*>(fLeaves.At(cl.fCode)));
+    char const* ctype(leaf == nullptr ? nullptr : GetLeafCType(leaf));
+    if (ctype == nullptr || cl.fType != ctype || (cl.fScalar && (leaf->GetLeafCount() != nullptr || leaf->GetLenStatic() != 1))) {
+      // fall back to interpretation
+      fCompiled = nullptr;
+      return;
+    }
+  }
+}
+
+/*static*/
+char const*
+TTreeFormulaCached::GetLeafCType(TLeaf const* _leaf)
+{
+  // fixed-size arrays with a leaf count are multi-dimensional
+  if (_leaf->GetLeafCount() != nullptr && _leaf->GetLenStatic() != 1)
+    return nullptr;
+
+  if (_leaf->InheritsFrom(TLeafF::Class()))
+    return "float";
+  else if (_leaf->InheritsFrom(TLeafD::Class()))
+    return "double";
+  else if (_leaf->InheritsFrom(TLeafI::Class()))
+    return _leaf->IsUnsigned() ? "unsigned int" : "int";
+  else if (_leaf->InheritsFrom(TLeafS::Class()))
+    return _leaf->IsUnsigned() ? "unsigned short" : "short";
+  else if (_leaf->InheritsFrom(TLeafL::Class()))
+    return _leaf->IsUnsigned() ? "unsigned long long" : "long long";
+  else if (_leaf->InheritsFrom(TLeafB::Class()))
+    return _leaf->IsUnsigned() ? "unsigned char" : "signed char";
+  else if (_leaf->InheritsFrom(TLeafO::Class()))
+    return "bool";
+  else
+    return nullptr;
+}
+
 bool
 TTreeFormulaCached::ReplaceLeaf(TString const& _from, TString const& _to)
 {
@@ -158,6 +292,9 @@ TTreeFormulaCached::ReplaceLeaf(TString const& _from, TString const& _to)
     if (leaf==0) SetBit( kMissingLeaf );
   }
 
+  if (replaced)
+    CheckCompiledLeaves();
+
   for (Int_t j=0; j<kMAXCODES; j++) {
     for (Int_t k = 0; k<kMAXFORMDIM; k++) {
       if (fVarIndexes[j][k]) {
@@ -217,6 +354,73 @@ TTreeFormulaCached::ReplaceLeaf(TString const& _from, TString const& _to)
   return replaced;
 }
 
+void
+TTreeFormulaCached::CollectLeaves(std::vector<TLeaf*>& _leaves) const
+{
+  // same traversal as ReplaceLeaf
+  Int_t nleaves = fLeaves.GetEntriesFast();
+  for (Int_t i=0;i<nleaves;i++) {
+    auto* leaf = static_cast<TLeaf*>(fLeaves.UncheckedAt(i));
+    if (leaf) _leaves.push_back(leaf);
+  }
+
+  for (Int_t j=0; j<kMAXCODES; j++) {
+    for (Int_t k = 0; k<kMAXFORMDIM; k++) {
+      if (fVarIndexes[j][k]) {
+        static_cast<TTreeFormulaCached const*>(fVarIndexes[j][k])->CollectLeaves(_leaves);
+      }
+    }
+    if (j<fNval && fCodes[j]<0) {
+      TCutG *gcut = (TCutG*)fExternalCuts.At(j);
+      if (gcut) {
+        auto* fx = static_cast<TTreeFormulaCached const*>(gcut->GetObjectX());
+        auto* fy = static_cast<TTreeFormulaCached const*>(gcut->GetObjectY());
+        if (fx) {
+          fx->CollectLeaves(_leaves);
+        }
+        if (fy) {
+          fy->CollectLeaves(_leaves);
+        }
+      }
+    }
+  }
+  for(Int_t k=0;k<fNoper;k++) {
+    const Int_t oper = GetOper()[k];
+    switch(oper >> kTFOperShift) {
+    case kAlias:
+    case kAliasString:
+    case kAlternate:
+    case kAlternateString:
+    case kMinIf:
+    case kMaxIf:
+      {
+        auto* subform = static_cast<TTreeFormulaCached const*>(fAliases.UncheckedAt(k));
+        subform->CollectLeaves(_leaves);
+        break;
+      }
+    case kDefinedVariable:
+      {
+        Int_t code = GetActionParam(k);
+        if (fCodes[code]==0) switch(fLookupType[code]) {
+          case kLengthFunc:
+          case kSum:
+          case kMin:
+          case kMax:
+            {
+              auto* subform = static_cast<TTreeFormulaCached const*>(fAliases.UncheckedAt(k));
+              subform->CollectLeaves(_leaves);
+              break;
+            }
+          default:
+            break;
+          }
+      }
+    default:
+      break;
+    }
+  }
+}
+
 struct ErrorHandlerReport {
   thread_local static Int_t lastErrorLevel;
   static void errorHandler(Int_t _level, Bool_t _abort, char const* _location, char const* _msg) {
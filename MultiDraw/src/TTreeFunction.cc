@@ -9,3 +9,23 @@ multidraw::TTreeFunction::linkedCopy(FunctionLibrary& _library) const
 
   return TTreeFunctionPtr(copy);
 }
+
+void
+multidraw::TTreeFunction::evaluateAll(double* _out)
+{
+  unsigned nD(getNdata());
+  for (unsigned iD(0); iD != nD; ++iD)
+    _out[iD] = evaluate(iD);
+}
+
+std::vector<double> const&
+multidraw::TTreeFunction::getValues()
+{
+  if (!valuesValid_) {
+    values_.resize(getNdata());
+    evaluateAll(values_.data());
+    valuesValid_ = true;
+  }
+
+  return values_;
+}
@@ -2,98 +2,132 @@
 #include "../interface/FormulaLibrary.h"
 
 #include "TDirectory.h"
+#include "TSystem.h"
+#include "TTreeCloner.h"
 
 #include <iostream>
 #include <sstream>
 #include <thread>
+#include <cstring>
+#include <stdexcept>
+#include <algorithm>
+#include <atomic>
+
+namespace {
+
+  char const* const leafCodes[multidraw::TreeFiller::nBranchTypes] = {"D", "F", "I", "O"};
+
+  //! Copy n values into a branch buffer of type T
+  template<class T>
+  void
+  convert(void* _dest, double const* _src, unsigned _n)
+  {
+    T* dest(static_cast<T*>(_dest));
+    for (unsigned i(0); i != _n; ++i)
+      dest[i] = T(_src[i]);
+  }
+
+  void
+  store(multidraw::TreeFiller::BranchType _type, void* _dest, double const* _src, unsigned _n)
+  {
+    switch (_type) {
+    case multidraw::TreeFiller::kDouble:
+      std::copy(_src, _src + _n, static_cast<Double_t*>(_dest));
+      break;
+    case multidraw::TreeFiller::kFloat:
+      convert<Float_t>(_dest, _src, _n);
+      break;
+    case multidraw::TreeFiller::kInt:
+      convert<Int_t>(_dest, _src, _n);
+      break;
+    case multidraw::TreeFiller::kBool:
+      convert<Bool_t>(_dest, _src, _n);
+      break;
+    default:
+      break;
+    }
+  }
+
+  //! Initial capacity of array branch buffers
+  unsigned const arrayReserve(64);
+
+  //! Serial number of the streaming files of this process
+  std::atomic<unsigned> streamingFileIndex(0);
+
+}
 
 multidraw::TreeFiller::TreeFiller(TTree& _tree, char const* _reweight) :
   ExprFiller(_tree, _reweight)
 {
-  if (_tree.GetBranch("weight") == nullptr)
-    _tree.Branch("weight", &entryWeight_, "weight/D");
-  else
-    _tree.SetBranchAddress("weight", &entryWeight_);
-
-  bvalues_.reserve(NBRANCHMAX);
+  setupBranch_(_tree, "weight", &entryWeight_, "weight/D", true);
 }
 
 multidraw::TreeFiller::TreeFiller(TObjArray& _treelist, char const* _reweight) :
   ExprFiller(_treelist, _reweight)
 {
-  //for (int iT(0); iT != _treelist.GetEntries(); ++iT) {
-  for (auto* obj : _treelist) {
-  //auto& tree(static_cast<TTree&>(*_treelist.At(iT)));
-    auto& tree(static_cast<TTree&>(*obj));
-    if (tree.GetBranch("weight") == nullptr)
-      tree.Branch("weight", &entryWeight_, "weight/D");
-    else
-      tree.SetBranchAddress("weight", &entryWeight_);
-  }
-
-  bvalues_.reserve(NBRANCHMAX);
+  for (auto* obj : _treelist)
+    setupBranch_(static_cast<TTree&>(*obj), "weight", &entryWeight_, "weight/D", true);
 }
 
 multidraw::TreeFiller::TreeFiller(TreeFiller const& _orig) :
   ExprFiller(_orig),
-  bnames_(_orig.bnames_)
-{
-  bvalues_.reserve(NBRANCHMAX);
-  bvalues_ = _orig.bvalues_;
-
-  auto setupTree([this](TTree& tree) {
-      tree.SetBranchAddress("weight", &this->entryWeight_);
-  
-      for (unsigned iB(0); iB != this->bvalues_.size(); ++iB)
-        tree.SetBranchAddress(this->bnames_[iB], &this->bvalues_[iB]);
-  });
-  
+  branches_(_orig.branches_),
+  counts_(_orig.counts_),
+  scalarBranches_(_orig.scalarBranches_),
+  arrayBranches_(_orig.arrayBranches_),
+  arraySources_(_orig.arraySources_),
+  streamingDirectory_(_orig.streamingDirectory_)
+{
   if (categorized_) {
     for (auto* obj : static_cast<TObjArray&>(tobj_))
-      setupTree(static_cast<TTree&>(*obj));
+      setupTree_(static_cast<TTree&>(*obj));
   }
   else
-    setupTree(static_cast<TTree&>(tobj_));
+    setupTree_(static_cast<TTree&>(tobj_));
 }
 
 multidraw::TreeFiller::TreeFiller(TTree& _tree, TreeFiller const& _orig) :
   ExprFiller(_tree, _orig),
-  bnames_(_orig.bnames_)
+  branches_(_orig.branches_),
+  counts_(_orig.counts_),
+  scalarBranches_(_orig.scalarBranches_),
+  arrayBranches_(_orig.arrayBranches_),
+  arraySources_(_orig.arraySources_),
+  streamingDirectory_(_orig.streamingDirectory_)
 {
-  auto& tree(static_cast<TTree&>(tobj_));
-
-  tree.SetBranchAddress("weight", &entryWeight_);
-
-  bvalues_.reserve(NBRANCHMAX);
-  bvalues_ = _orig.bvalues_;
-
-  for (unsigned iB(0); iB != bvalues_.size(); ++iB)
-    tree.SetBranchAddress(bnames_[iB], &bvalues_[iB]);
+  // The thread-clone tree is empty; branches are created here
+  setupTree_(_tree);
 }
 
 multidraw::TreeFiller::TreeFiller(TObjArray& _treelist, TreeFiller const& _orig) :
   ExprFiller(_treelist, _orig),
-  bnames_(_orig.bnames_)
+  branches_(_orig.branches_),
+  counts_(_orig.counts_),
+  scalarBranches_(_orig.scalarBranches_),
+  arrayBranches_(_orig.arrayBranches_),
+  arraySources_(_orig.arraySources_),
+  streamingDirectory_(_orig.streamingDirectory_)
 {
-  bvalues_.reserve(NBRANCHMAX);
-  bvalues_ = _orig.bvalues_;
-  
-  auto& treelist(static_cast<TObjArray&>(tobj_));
-
-  //for (int iT(0); iT != treelist.GetEntries(); ++iT) {
-  for (auto* obj : treelist) {
-    //auto& tree(static_cast<TTree&>(*treelist.At(iT)));
-    auto& tree(static_cast<TTree&>(*obj));
-
-    tree.SetBranchAddress("weight", &entryWeight_);
-
-    for (unsigned iB(0); iB != bvalues_.size(); ++iB)
-      tree.SetBranchAddress(bnames_[iB], &bvalues_[iB]);
-  }
+  for (auto* obj : _treelist)
+    setupTree_(static_cast<TTree&>(*obj));
 }
 
 multidraw::TreeFiller::~TreeFiller()
 {
+  if (streamingFile_) {
+    // Not merged back (aborted event loop); the trees are deleted by ExprFiller
+    TString path(streamingFile_->GetName());
+    if (categorized_) {
+      for (auto* obj : static_cast<TObjArray&>(tobj_))
+        static_cast<TTree&>(*obj).SetDirectory(nullptr);
+    }
+    else
+      static_cast<TTree&>(tobj_).SetDirectory(nullptr);
+
+    streamingFile_->Close();
+    gSystem->Unlink(path);
+  }
+
   if (cloneSource_ != nullptr) {
     if (categorized_) {
       for (auto* obj : static_cast<TObjArray&>(tobj_))
@@ -107,31 +141,210 @@ multidraw::TreeFiller::~TreeFiller()
 void
 multidraw::TreeFiller::addBranch(char const* _bname, char const* _expr, bool _rebind/* = false*/)
 {
-  if (bvalues_.size() == NBRANCHMAX)
-    throw std::runtime_error("Cannot add any more branches");
+  addBranch_(_bname, CompiledExprSource(_expr), kDouble, nullptr, _rebind);
+}
+
+void
+multidraw::TreeFiller::addBranch(char const* _bname, char const* _expr, BranchType _type, bool _rebind/* = false*/)
+{
+  addBranch_(_bname, CompiledExprSource(_expr), _type, nullptr, _rebind);
+}
+
+void
+multidraw::TreeFiller::addBranch(char const* _bname, TTreeFunction const& _func, BranchType _type/* = kDouble*/, bool _rebind/* = false*/)
+{
+  addBranch_(_bname, CompiledExprSource(_func), _type, nullptr, _rebind);
+}
+
+void
+multidraw::TreeFiller::addArrayBranch(char const* _bname, char const* _expr, char const* _countName, BranchType _type/* = kDouble*/, bool _rebind/* = false*/)
+{
+  addBranch_(_bname, CompiledExprSource(_expr), _type, _countName, _rebind);
+}
+
+void
+multidraw::TreeFiller::addArrayBranch(char const* _bname, TTreeFunction const& _func, char const* _countName, BranchType _type/* = kDouble*/, bool _rebind/* = false*/)
+{
+  addBranch_(_bname, CompiledExprSource(_func), _type, _countName, _rebind);
+}
 
-  bvalues_.resize(bvalues_.size() + 1);
+void
+multidraw::TreeFiller::addBranch_(char const* _bname, CompiledExprSource const& _source, BranchType _type, char const* _countName, bool _rebind)
+{
+  if (unsigned(_type) >= nBranchTypes)
+    throw std::runtime_error(TString::Format("Invalid type for branch %s", _bname).Data());
 
-  auto addBranchForTree([_bname, _rebind, this](TTree& tree) {
-      if (tree.GetBranch(_bname) != nullptr) {
-        if (_rebind)
-          tree.SetBranchAddress(_bname, &this->bvalues_.back());
-        else
-          throw std::runtime_error(TString::Format("Tree already has a branch named %s", _bname).Data());
+  for (auto& branch : branches_) {
+    if (branch.name == _bname)
+      throw std::runtime_error(TString::Format("Branch %s is already filled by this filler", _bname).Data());
+  }
+
+  bool isArray(_countName != nullptr);
+  bool newCount(false);
+
+  if (isArray) {
+    if (std::strlen(_countName) == 0)
+      throw std::runtime_error(TString::Format("Array branch %s needs a count branch name", _bname).Data());
+
+    int count(-1);
+    for (unsigned iC(0); iC != counts_.size(); ++iC) {
+      if (counts_[iC].name == _countName)
+        count = iC;
+    }
+    if (count == -1) {
+      count = counts_.size();
+      counts_.emplace_back();
+      counts_.back().name = _countName;
+      newCount = true;
+    }
+
+    branches_.emplace_back();
+    branches_.back().count = count;
+    branches_.back().buffer.resize(arrayReserve);
+  }
+  else {
+    branches_.emplace_back();
+    branches_.back().buffer.resize(1);
+  }
+
+  auto& branch(branches_.back());
+  branch.name = _bname;
+  branch.type = _type;
+
+  auto addBranchForTree([&](TTree& _tree) {
+      if (newCount) {
+        auto& count(counts_.back());
+        setupBranch_(_tree, count.name, &count.n, count.name + "/I", _rebind);
       }
-      else
-        tree.Branch(_bname, &this->bvalues_.back(), TString::Format("%s/D", _bname));
-  });
+      setupBranch_(_tree, branch.name, branch.buffer.data(), leaflist_(branch), _rebind);
+    });
 
+  try {
+    if (categorized_) {
+      for (auto* obj : static_cast<TObjArray&>(tobj_))
+        addBranchForTree(static_cast<TTree&>(*obj));
+    }
+    else
+      addBranchForTree(static_cast<TTree&>(tobj_));
+  }
+  catch (std::exception&) {
+    branches_.pop_back();
+    if (newCount)
+      counts_.pop_back();
+    throw;
+  }
+
+  if (isArray) {
+    arrayBranches_.push_back(branches_.size() - 1);
+    arraySources_.push_back(_source);
+  }
+  else {
+    scalarBranches_.push_back(branches_.size() - 1);
+    sources_.push_back(_source);
+  }
+}
+
+void
+multidraw::TreeFiller::setupTree_(TTree& _tree)
+{
+  setupBranch_(_tree, "weight", &entryWeight_, "weight/D", true);
+
+  for (auto& count : counts_)
+    setupBranch_(_tree, count.name, &count.n, count.name + "/I", true);
+
+  for (auto& branch : branches_)
+    setupBranch_(_tree, branch.name, branch.buffer.data(), leaflist_(branch), true);
+}
+
+void
+multidraw::TreeFiller::setupBranch_(TTree& _tree, TString const& _name, void* _address, TString const& _leaflist, bool _rebind)
+{
+  if (_tree.GetBranch(_name) != nullptr) {
+    if (_rebind)
+      _tree.SetBranchAddress(_name, _address);
+    else
+      throw std::runtime_error(TString::Format("Tree already has a branch named %s", _name.Data()).Data());
+  }
+  else
+    _tree.Branch(_name, _address, _leaflist);
+}
+
+TString
+multidraw::TreeFiller::leaflist_(Branch const& _branch) const
+{
+  if (_branch.count < 0)
+    return _branch.name + "/" + leafCodes[_branch.type];
+  else
+    return _branch.name + "[" + counts_[_branch.count].name + "]/" + leafCodes[_branch.type];
+}
+
+void
+multidraw::TreeFiller::bindTree_(FormulaLibrary& _formulaLibrary, FunctionLibrary& _functionLibrary)
+{
+  // Array expressions iterate independently of the filler instances and are kept out of its formula manager
+  arrayExprs_.clear();
+  for (auto& source : arraySources_)
+    arrayExprs_.emplace_back(source.compile(_formulaLibrary, _functionLibrary));
+}
+
+void
+multidraw::TreeFiller::fillArray_(Branch& _branch, CompiledExpr& _expr)
+{
+  unsigned nD(_expr.getNdata());
+
+  auto& count(counts_[_branch.count]);
+  if (!count.filled) {
+    count.n = nD;
+    count.filled = true;
+  }
+  else if (unsigned(count.n) != nD)
+    throw std::runtime_error(TString::Format("Array branch %s has %d values but %s = %d", _branch.name.Data(), nD, count.name.Data(), count.n).Data());
+
+  if (nD > _branch.buffer.size()) {
+    _branch.buffer.resize(std::max(nD, unsigned(2 * _branch.buffer.size())));
+    setAddress_(_branch);
+  }
+
+  if (nD == 0)
+    return;
+
+  if (_branch.type == kDouble) {
+    // evaluated directly into the branch buffer
+    _expr.evaluateAll(_branch.buffer.data());
+  }
+  else {
+    if (arrayValues_.size() < nD)
+      arrayValues_.resize(nD);
+    _expr.evaluateAll(arrayValues_.data());
+    store(_branch.type, _branch.buffer.data(), arrayValues_.data(), nD);
+  }
+}
+
+void
+multidraw::TreeFiller::reserveArrays_(TTree& _source)
+{
+  for (unsigned iB : arrayBranches_) {
+    auto& branch(branches_[iB]);
+    if (_source.GetEntries() == 0 || _source.GetBranch(counts_[branch.count].name) == nullptr)
+      continue;
+
+    unsigned nMax(_source.GetMaximum(counts_[branch.count].name));
+    if (nMax > branch.buffer.size()) {
+      branch.buffer.resize(nMax);
+      setAddress_(branch);
+    }
+  }
+}
+
+void
+multidraw::TreeFiller::setAddress_(Branch& _branch)
+{
   if (categorized_) {
     for (auto* obj : static_cast<TObjArray&>(tobj_))
-      addBranchForTree(static_cast<TTree&>(*obj));
+      static_cast<TTree&>(*obj).SetBranchAddress(_branch.name, _branch.buffer.data());
   }
   else
-    addBranchForTree(static_cast<TTree&>(tobj_));
-
-  bnames_.emplace_back(_bname);
-  sources_.emplace_back(_expr);
+    static_cast<TTree&>(tobj_).SetBranchAddress(_branch.name, _branch.buffer.data());
 }
 
 void
@@ -141,15 +354,30 @@ multidraw::TreeFiller::doFill_(unsigned _iD, int _icat/* = -1*/)
     std::cout << "            Fill(";
 
   for (unsigned iE(0); iE != compiledExprs_.size(); ++iE) {
-    bvalues_[iE] = compiledExprs_[iE]->evaluate(_iD);
+    auto& branch(branches_[scalarBranches_[iE]]);
+    double value(compiledExprs_[iE]->evaluate(_iD));
+    store(branch.type, branch.buffer.data(), &value, 1);
 
     if (printLevel_ > 3) {
-      std::cout << bvalues_[iE];
+      std::cout << value;
       if (iE != compiledExprs_.size() - 1)
         std::cout << ", ";
     }
   }
 
+  if (!arrayExprs_.empty()) {
+    for (auto& count : counts_)
+      count.filled = false;
+
+    for (unsigned iA(0); iA != arrayExprs_.size(); ++iA)
+      fillArray_(branches_[arrayBranches_[iA]], *arrayExprs_[iA]);
+
+    if (printLevel_ > 3) {
+      for (auto& count : counts_)
+        std::cout << "; " << count.name << " = " << count.n;
+    }
+  }
+
   if (printLevel_ > 3)
     std::cout << "; " << entryWeight_ << ")" << std::endl;
 
@@ -159,56 +387,142 @@ multidraw::TreeFiller::doFill_(unsigned _iD, int _icat/* = -1*/)
 multidraw::ExprFiller*
 multidraw::TreeFiller::clone_()
 {
+  std::unique_ptr<TFile> streamingFile;
+  if (streamingDirectory_.Length() != 0) {
+    TString path(TString::Format("%s/multidraw_tree_%d_%u.root", streamingDirectory_.Data(), gSystem->GetPid(), streamingFileIndex++));
+    streamingFile.reset(TFile::Open(path, "recreate"));
+    if (!streamingFile || streamingFile->IsZombie())
+      throw std::runtime_error(("Cannot create streaming file " + path).Data());
+
+    // Same compression as the target so that the baskets can be copied as they are
+    auto* targetFile(getTree(0).GetCurrentFile());
+    if (targetFile != nullptr)
+      streamingFile->SetCompressionSettings(targetFile->GetCompressionSettings());
+  }
+
+  auto newTree([&streamingFile](TTree& _myTree)->TTree* {
+      std::stringstream name;
+      name << _myTree.GetName() << "_thread" << std::this_thread::get_id();
+
+      // Thread-unsafe - in newer ROOT versions we can do new TTree(name.str().c_str(), myTree.GetTitle(), 99, myTree.GetDirectory());
+      TDirectory::TContext(_myTree.GetDirectory());
+      auto* tree(new TTree(name.str().c_str(), _myTree.GetTitle()));
+      if (streamingFile)
+        tree->SetDirectory(streamingFile.get());
+
+      return tree;
+    });
+
+  TreeFiller* clone(nullptr);
+
   if (categorized_) {
     auto& myArray(static_cast<TObjArray&>(tobj_));
 
     auto* array(new TObjArray());
     array->SetOwner(true);
 
-    for (auto* obj : myArray) {
-      std::stringstream name;
-      name << obj->GetName() << "_thread" << std::this_thread::get_id();
-
-      auto& myTree(static_cast<TTree&>(*obj));
-
-      // Thread-unsafe - in newer ROOT versions we can do new TTree(name.str().c_str(), myTree.GetTitle(), 99, myTree.GetDirectory());
-      TDirectory::TContext(myTree.GetDirectory());
-      array->Add(new TTree(name.str().c_str(), myTree.GetTitle()));
-    }
+    for (auto* obj : myArray)
+      array->Add(newTree(static_cast<TTree&>(*obj)));
 
-    return new TreeFiller(*array, *this);
+    clone = new TreeFiller(*array, *this);
   }
-  else {
-    auto& myTree(static_cast<TTree&>(tobj_));
-
-    std::stringstream name;
-    name << myTree.GetName() << "_thread" << std::this_thread::get_id();
+  else
+    clone = new TreeFiller(*newTree(static_cast<TTree&>(tobj_)), *this);
 
-    // Thread-unsafe - in newer ROOT versions we can do new TTree(name.str().c_str(), myTree.GetTitle(), 99, myTree.GetDirectory());
-    TDirectory::TContext(myTree.GetDirectory());
-    auto* tree(new TTree(name.str().c_str(), myTree.GetTitle()));
+  clone->streamingFile_ = std::move(streamingFile);
 
-    return new TreeFiller(*tree, *this);
-  }
+  return clone;
 }
 
 void
 multidraw::TreeFiller::mergeBack_()
 {
+  auto& cloneSource(static_cast<TreeFiller&>(*cloneSource_));
+
+  if (streamingFile_) {
+    // Write the remaining baskets and the tree headers; the trees are appended in finalize_ of the source
+    TDirectory::TContext context(streamingFile_.get());
+
+    int nTrees(categorized_ ? static_cast<TObjArray&>(tobj_).GetEntries() : 1);
+    for (int icat(0); icat < nTrees; ++icat) {
+      auto& tree(getTree(categorized_ ? icat : -1));
+      tree.Write(TString::Format("tree%d", icat));
+      tree.SetDirectory(nullptr);
+    }
+
+    TString path(streamingFile_->GetName());
+    streamingFile_->Close();
+    streamingFile_.reset();
+
+    cloneSource.streamedFiles_.push_back(path);
+    return;
+  }
+
   if (categorized_) {
-    auto& cloneSource(static_cast<TreeFiller&>(*cloneSource_));
     auto& myArray(static_cast<TObjArray&>(tobj_));
 
     for (int icat(0); icat < myArray.GetEntries(); ++icat) {
+      cloneSource.reserveArrays_(getTree(icat));
+
       TObjArray arr;
       arr.Add(&getTree(icat));
       cloneSource.getTree(icat).Merge(&arr);
     }
   }
   else {
+    cloneSource.reserveArrays_(getTree());
+
     auto& sourceTree(static_cast<TTree&>(cloneSource_->getObj()));
     TObjArray arr;
     arr.Add(&tobj_);
     sourceTree.Merge(&arr);
   }
 }
+
+void
+multidraw::TreeFiller::finalize_()
+{
+  for (auto& path : streamedFiles_) {
+    std::unique_ptr<TFile> file(TFile::Open(path));
+    if (!file || file->IsZombie())
+      throw std::runtime_error(("Cannot open streaming file " + path).Data());
+
+    int nTrees(categorized_ ? static_cast<TObjArray&>(tobj_).GetEntries() : 1);
+    for (int icat(0); icat < nTrees; ++icat) {
+      auto* source(static_cast<TTree*>(file->Get(TString::Format("tree%d", icat))));
+      if (source == nullptr)
+        throw std::runtime_error(TString::Format("Tree %d not found in streaming file %s", icat, path.Data()).Data());
+
+      appendStreamed_(getTree(categorized_ ? icat : -1), *source);
+    }
+
+    file->Close();
+    gSystem->Unlink(path);
+  }
+
+  streamedFiles_.clear();
+}
+
+void
+multidraw::TreeFiller::appendStreamed_(TTree& _target, TTree& _source)
+{
+  if (_source.GetEntries() == 0)
+    return;
+
+  // Basket-level copy, as in TTree::Merge with the fast option
+  if (_target.GetCurrentFile() != nullptr) {
+    TTreeCloner cloner(&_source, &_target, "fast", TTreeCloner::kNoWarnings);
+    if (cloner.IsValid()) {
+      _target.SetEntries(_target.GetEntries() + _source.GetEntries());
+      cloner.Exec();
+      return;
+    }
+  }
+
+  reserveArrays_(_source);
+
+  _target.CopyEntries(&_source);
+
+  // CopyEntries points the branches of the source to our buffers
+  _source.ResetBranchAddresses();
+}
@@ -0,0 +1,95 @@
+// Checks of the AxisLookup bin search against TAxis::FindFixBin.
+// Usage: testAxisLookup
+// Exits with a nonzero status if any check fails.
+
+#include "../interface/HistogramLookup.h"
+
+#include "TAxis.h"
+#include "TRandom3.h"
+#include "TString.h"
+
+#include <iostream>
+#include <vector>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+namespace {
+
+  unsigned nFailed(0);
+
+  void
+  check(TAxis const& _axis, char const* _label, double _x)
+  {
+    multidraw::AxisLookup lookup(_axis);
+
+    int expected(_axis.FindFixBin(_x));
+    int bin(lookup.findBin(_x));
+    if (bin != expected) {
+      ++nFailed;
+      std::cerr << _label << ": findBin(" << TString::Format("%.17g", _x) << ") = " << bin << ", FindFixBin = " << expected << std::endl;
+    }
+
+    int expectedClamped(std::min(std::max(expected, 1), _axis.GetNbins()));
+    int binClamped(lookup.findBinClamped(_x));
+    if (binClamped != expectedClamped) {
+      ++nFailed;
+      std::cerr << _label << ": findBinClamped(" << TString::Format("%.17g", _x) << ") = " << binClamped << ", expected " << expectedClamped << std::endl;
+    }
+  }
+
+  void
+  checkAxis(TAxis const& _axis, char const* _label)
+  {
+    double const nan(std::numeric_limits<double>::quiet_NaN());
+    double const inf(std::numeric_limits<double>::infinity());
+
+    // exact edges and one ulp around them, including xmin and xmax
+    for (int iB(1); iB <= _axis.GetNbins() + 1; ++iB) {
+      double edge(_axis.GetBinLowEdge(iB));
+      check(_axis, _label, edge);
+      check(_axis, _label, std::nextafter(edge, -inf));
+      check(_axis, _label, std::nextafter(edge, inf));
+    }
+
+    for (double x : {_axis.GetXmin(), _axis.GetXmax(), nan, inf, -inf})
+      check(_axis, _label, x);
+
+    TRandom3 rand(1234);
+    double width(_axis.GetXmax() - _axis.GetXmin());
+    for (unsigned iP(0); iP != 10000; ++iP)
+      check(_axis, _label, rand.Uniform(_axis.GetXmin() - 0.1 * width, _axis.GetXmax() + 0.1 * width));
+  }
+
+}
+
+int
+main()
+{
+  // uniform bins, with bin widths that are not exactly representable
+  checkAxis(TAxis(10, 0., 1.), "uniform 10 [0, 1]");
+  checkAxis(TAxis(3, 0., 0.3), "uniform 3 [0, 0.3]");
+  checkAxis(TAxis(7, -2.5, 3.7), "uniform 7 [-2.5, 3.7]");
+  checkAxis(TAxis(100, -0.1, 0.1), "uniform 100 [-0.1, 0.1]");
+  checkAxis(TAxis(49, 1.e-3, 1.e3), "uniform 49 [1e-3, 1e3]");
+  checkAxis(TAxis(1, 0., 1.), "uniform 1 [0, 1]");
+
+  std::vector<double> edges{0., 0.1, 0.3, 0.7, 1.5, 3.1, 10.};
+  checkAxis(TAxis(edges.size() - 1, edges.data()), "variable");
+
+  std::vector<double> logEdges;
+  for (int iE(0); iE <= 40; ++iE)
+    logEdges.push_back(std::pow(10., -2. + 0.1 * iE));
+  checkAxis(TAxis(logEdges.size() - 1, logEdges.data()), "variable log");
+
+  std::vector<double> singleBin{-1., 1.};
+  checkAxis(TAxis(singleBin.size() - 1, singleBin.data()), "variable 1 bin");
+
+  if (nFailed != 0) {
+    std::cerr << nFailed << " checks failed" << std::endl;
+    return 1;
+  }
+
+  std::cout << "all checks passed" << std::endl;
+  return 0;
+}
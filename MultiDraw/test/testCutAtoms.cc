@@ -0,0 +1,52 @@
+// Checks of the splitting of cut expressions into atoms.
+// Usage: testCutAtoms
+// Exits with a nonzero status if any check fails.
+
+#include "../interface/CutAtomLibrary.h"
+
+#include "TString.h"
+
+#include <iostream>
+#include <vector>
+
+namespace {
+
+  unsigned nFailed(0);
+
+  void
+  check(char const* _expr, std::vector<TString> const& _expected)
+  {
+    auto clauses(multidraw::CutAtomLibrary::split(_expr));
+    if (clauses == _expected)
+      return;
+
+    ++nFailed;
+    std::cerr << "split(\"" << _expr << "\") returned";
+    for (auto& clause : clauses)
+      std::cerr << " [" << clause << "]";
+    std::cerr << std::endl;
+  }
+
+}
+
+int
+main()
+{
+  check("a>0 && b>1", {"a>0", "b>1"});
+  check("a>0 && TMath::Abs(b)<2", {"a>0", "TMath::Abs(b)<2"});
+  check("(a>0 || b>1) && c>2", {"(a>0 || b>1)", "c>2"});
+  check("a>0 || b>1 && c>2", {"a>0 || b>1 && c>2"});
+  check("a>0 & b>1 && c>2", {"a>0 & b>1 && c>2"});
+  // a ternary binds looser than &&: neither branch is an atom of the whole cut
+  check("a>0 ? b>1 && c>2 : d>3", {"a>0 ? b>1 && c>2 : d>3"});
+  check("a>0 && b>1 ? c>2 : TMath::Abs(d)>3", {"a>0 && b>1 ? c>2 : TMath::Abs(d)>3"});
+  check("a>0 && (b>1 ? c>2 : d>3)", {"a>0", "(b>1 ? c>2 : d>3)"});
+
+  if (nFailed != 0) {
+    std::cerr << nFailed << " checks failed" << std::endl;
+    return 1;
+  }
+
+  std::cout << "all checks passed" << std::endl;
+  return 0;
+}
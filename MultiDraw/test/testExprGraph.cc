@@ -0,0 +1,245 @@
+// Checks of ExprParser and ExprGraph against TTreeFormula.
+// Usage: testExprGraph
+// Exits with a nonzero status if any check fails.
+
+#include "../interface/ExprParser.h"
+#include "../interface/ExprGraph.h"
+#include "../interface/TTreeFormulaCached.h"
+
+#include "TTree.h"
+#include "TRandom3.h"
+#include "TString.h"
+
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include <memory>
+#include <cmath>
+#include <algorithm>
+
+namespace {
+
+  unsigned nFailed(0);
+
+  void
+  check(bool _ok, TString const& _what)
+  {
+    if (_ok)
+      return;
+
+    ++nFailed;
+    std::cerr << _what << std::endl;
+  }
+
+  //! Syntax tree as an s-expression
+  std::string
+  toString(multidraw::ExprParser::Node const& _node)
+  {
+    std::stringstream ss;
+    if (_node.operands.empty()) {
+      ss << _node.text;
+      if (_node.index >= 0)
+        ss << "[" << _node.index << "]";
+    }
+    else {
+      ss << "(" << _node.text;
+      for (auto& operand : _node.operands)
+        ss << " " << toString(operand);
+      ss << ")";
+    }
+    return ss.str();
+  }
+
+  void
+  checkParse(char const* _expr, char const* _expected)
+  {
+    multidraw::ExprParser::Node root;
+    if (!multidraw::ExprParser::parse(_expr, root)) {
+      check(false, TString::Format("parse(\"%s\") failed", _expr));
+      return;
+    }
+
+    std::string result(toString(root));
+    check(result == _expected, TString::Format("parse(\"%s\") = %s, expected %s", _expr, result.c_str(), _expected));
+  }
+
+  void
+  checkReject(char const* _expr)
+  {
+    multidraw::ExprParser::Node root;
+    check(!multidraw::ExprParser::parse(_expr, root), TString::Format("parse(\"%s\") = %s, expected a failure", _expr, toString(root).c_str()));
+  }
+
+  void
+  testParser()
+  {
+    checkParse("a + b * c", "(+ a (* b c))");
+    checkParse("a - b - c", "(- (- a b) c)");
+    checkParse("-a * b", "(* (- a) b)");
+    checkParse("+a", "a");
+    checkParse("!(a == 1)", "(! (== a 1))");
+    checkParse("a % 2", "(% a 2)");
+    checkParse("sqrt(a) + TMath::Abs(b[1])", "(+ (sqrt a) (TMath::Abs b[1]))");
+    checkParse("pow(a, 2) - atan2(b, c)", "(- (pow a 2) (atan2 b c))");
+    checkParse("TMath::Pi() * 2", "(* 3.14159265358979323846 2)");
+    checkParse("a > 0 && b <= 2 && c != 1", "(&& (&& (> a 0) (<= b 2)) (!= c 1))");
+    checkParse("a > 0 || b >= 1.5e2", "(|| (> a 0) (>= b 1.5e2))");
+    checkParse("(a > 0 && b > 0) || c < 0", "(|| (&& (> a 0) (> b 0)) (< c 0))");
+    checkParse("(a < b) < c", "(< (< a b) c)");
+    checkParse("friendTree.x + 1", "(+ friendTree.x 1)");
+
+    // TFormula precedence differs from C
+    checkReject("a > 0 && b > 0 || c > 0");
+    checkReject("a < b < c");
+    // power operators of TFormula
+    checkReject("a ** 2");
+    checkReject("a ^ 2");
+    checkReject("a > 0 ? b : c");
+    checkReject("foo(a)");
+    checkReject("sqrt(a, b)");
+    checkReject("0x10 + a");
+    checkReject("a[0][1]");
+    checkReject("a[i]");
+    checkReject("sqrt(a");
+    checkReject("a b");
+  }
+
+  //! Graph evaluation through TTreeFormulaCached::SetGraphNode against the TTreeFormula interpreter
+  void
+  testGraph()
+  {
+    TTree tree("events", "");
+    tree.SetDirectory(nullptr);
+
+    float a(0.);
+    double b(0.);
+    int c(0);
+    float arr[3]{};
+    tree.Branch("a", &a, "a/F");
+    tree.Branch("b", &b, "b/D");
+    tree.Branch("c", &c, "c/I");
+    tree.Branch("arr", arr, "arr[3]/F");
+    tree.SetAlias("ab", "a+b");
+
+    TRandom3 rand(4321);
+    for (unsigned iE(0); iE != 200; ++iE) {
+      a = rand.Gaus(0., 2.);
+      b = rand.Uniform(-3., 3.);
+      c = int(rand.Uniform(0., 5.));
+      for (auto& v : arr)
+        v = rand.Gaus(1., 1.);
+      tree.Fill();
+    }
+
+    std::vector<char const*> supported{
+      "a",
+      "a + b * c",
+      "-a * b",
+      "sqrt(abs(a)) + TMath::Abs(b)",
+      "a > 0 && b <= 2 && c != 1",
+      "a > 0 || c == 2",
+      "!(c == 1)",
+      "(a > 0 && b > 0) || c > 2",
+      "arr[1] * 2 - arr[0]",
+      "pow(a, 2) - atan2(b, a)",
+      "TMath::Pi() * a",
+      "c % 3",
+      "a / b",
+      "min(a, b) + TMath::Max(a, c)",
+      "exp(-a * a)",
+      "log(abs(b) + 1)",
+      // commuted and reformatted duplicates of the above
+      "b * c + a",
+      "( ( a ) )"
+    };
+
+    std::vector<char const*> unsupported{
+      "a > 0 && b > 0 || c > 0",
+      "a ** 2",
+      "a ^ 2",
+      "(a < b) < c && a < b < c",
+      "a > 0 ? b : c",
+      // unindexed array and TTree alias
+      "arr * 2",
+      "ab * 2"
+    };
+
+    multidraw::ExprGraph graph;
+
+    std::vector<std::unique_ptr<TTreeFormulaCached>> interpreted;
+    std::vector<std::unique_ptr<TTreeFormulaCached>> inGraph;
+
+    for (char const* expr : supported) {
+      interpreted.emplace_back(new TTreeFormulaCached("interpreted", expr, &tree));
+      inGraph.emplace_back(new TTreeFormulaCached("graph", expr, &tree));
+
+      int node(graph.add(*inGraph.back()));
+      check(node >= 0, TString::Format("ExprGraph::add(\"%s\") failed", expr));
+      if (node >= 0)
+        inGraph.back()->SetGraphNode(&graph, node);
+    }
+
+    // identical subexpressions map to one node
+    TTreeFormulaCached fa("fa", "a", &tree);
+    TTreeFormulaCached fsum("fsum", "b*c+a", &tree);
+    TTreeFormulaCached fsumc("fsumc", "a + c * b", &tree);
+    TTreeFormulaCached fdiff("fdiff", "a - b", &tree);
+    TTreeFormulaCached frdiff("frdiff", "b - a", &tree);
+    check(graph.add(fa) == graph.add(*inGraph[0]), "Formulas of the same leaf are different nodes");
+    check(graph.add(fsum) == graph.add(fsumc), "Commuted operands give different nodes");
+    check(graph.add(fdiff) != graph.add(frdiff), "a - b and b - a are the same node");
+
+    multidraw::ExprGraph fresh;
+    TTreeFormulaCached frepeat("frepeat", "sqrt(a*a + b*b) > 1 && sqrt(a * a + b * b) < 3", &tree);
+    fresh.add(frepeat);
+    // a, b, a*a, b*b, +, sqrt, 1, >, 3, <, &&
+    check(fresh.size() == 11, TString::Format("Repeated subexpression: %u nodes, expected 11", fresh.size()));
+
+    unsigned size(fresh.size());
+    TTreeFormulaCached fextend("fextend", "(a*a+b*b) * 2", &tree);
+    fresh.add(fextend);
+    check(fresh.size() == size + 2, TString::Format("Shared subexpression: %u nodes added, expected 2", fresh.size() - size));
+
+    // rejected forms stay with TTreeFormula
+    for (char const* expr : unsupported) {
+      TTreeFormulaCached formula("unsupported", expr, &tree);
+      size = graph.size();
+      check(graph.add(formula) == -1, TString::Format("ExprGraph::add(\"%s\") did not fall back to TTreeFormula", expr));
+      check(graph.size() == size, TString::Format("ExprGraph::add(\"%s\") added nodes", expr));
+    }
+
+    for (long iE(0); iE != tree.GetEntries(); ++iE) {
+      tree.GetEntry(iE);
+      graph.resetEvent();
+
+      for (unsigned iF(0); iF != supported.size(); ++iF) {
+        if (!inGraph[iF]->IsInGraph())
+          continue;
+
+        interpreted[iF]->GetNdata();
+        inGraph[iF]->GetNdata();
+
+        double expected(interpreted[iF]->EvalInstance(0));
+        double value(inGraph[iF]->EvalInstance(0));
+        check(std::abs(value - expected) <= 1.e-12 * std::max(1., std::abs(expected)),
+              TString::Format("Entry %ld: \"%s\" = %.17g in the graph, %.17g in TTreeFormula", iE, supported[iF], value, expected));
+      }
+    }
+  }
+
+}
+
+int
+main()
+{
+  testParser();
+  testGraph();
+
+  if (nFailed != 0) {
+    std::cerr << nFailed << " checks failed" << std::endl;
+    return 1;
+  }
+
+  std::cout << "all checks passed" << std::endl;
+  return 0;
+}
@@ -0,0 +1,162 @@
+// Checks of GraphInterpolator against TGraph::Eval and TSpline3.
+// Usage: testGraphInterpolator
+// Exits with a nonzero status if any check fails.
+
+#include "../interface/GraphInterpolator.h"
+
+#include "TGraph.h"
+#include "TSpline.h"
+#include "TString.h"
+
+#include <iostream>
+#include <vector>
+#include <cmath>
+#include <algorithm>
+
+namespace {
+
+  unsigned nFailed(0);
+
+  void
+  check(bool _ok, TString const& _what)
+  {
+    if (_ok)
+      return;
+
+    ++nFailed;
+    std::cerr << _what << std::endl;
+  }
+
+  bool
+  close(double _a, double _b)
+  {
+    return std::abs(_a - _b) <= 1.e-9 * std::max(1., std::max(std::abs(_a), std::abs(_b)));
+  }
+
+  //! Evaluation points over the knot range and 30% beyond on each side, and the knots themselves
+  std::vector<double>
+  evaluationPoints(TGraph const& _graph)
+  {
+    double const* gx(_graph.GetX());
+    double xmin(*std::min_element(gx, gx + _graph.GetN()));
+    double xmax(*std::max_element(gx, gx + _graph.GetN()));
+    double margin(0.3 * (xmax - xmin));
+
+    std::vector<double> points(gx, gx + _graph.GetN());
+    for (unsigned iP(0); iP <= 2000; ++iP)
+      points.push_back(xmin - margin + iP * (xmax - xmin + 2. * margin) / 2000.);
+
+    return points;
+  }
+
+  void
+  testCubic(TGraph const& _graph, char const* _label)
+  {
+    multidraw::GraphInterpolator interpolator(_graph, multidraw::GraphInterpolator::kCubic);
+    TSpline3 spline("spline", &_graph);
+
+    for (double x : evaluationPoints(_graph)) {
+      double expected(_graph.Eval(x, &spline));
+      double value(interpolator.eval(x));
+      check(close(value, expected), TString::Format("%s kCubic: eval(%.17g) = %.17g, TGraph::Eval with TSpline3 = %.17g", _label, x, value, expected));
+    }
+  }
+
+  void
+  testLinear(TGraph const& _graph, char const* _label)
+  {
+    multidraw::GraphInterpolator interpolator(_graph, multidraw::GraphInterpolator::kLinear);
+
+    for (double x : evaluationPoints(_graph)) {
+      double expected(_graph.Eval(x));
+      double value(interpolator.eval(x));
+      check(close(value, expected), TString::Format("%s kLinear: eval(%.17g) = %.17g, TGraph::Eval = %.17g", _label, x, value, expected));
+    }
+  }
+
+  //! Monotone data must give a monotone interpolation within the data range, passing through the knots
+  void
+  testMonotone(TGraph const& _graph, char const* _label)
+  {
+    multidraw::GraphInterpolator interpolator(_graph, multidraw::GraphInterpolator::kMonotone);
+
+    unsigned nP(_graph.GetN());
+    double const* gx(_graph.GetX());
+    double const* gy(_graph.GetY());
+
+    for (unsigned iP(0); iP != nP; ++iP) {
+      double value(interpolator.eval(gx[iP]));
+      check(close(value, gy[iP]), TString::Format("%s kMonotone: eval(%g) = %.17g, knot value %.17g", _label, gx[iP], value, gy[iP]));
+    }
+
+    for (unsigned iP(0); iP != nP - 1; ++iP) {
+      double ylow(std::min(gy[iP], gy[iP + 1]));
+      double yhigh(std::max(gy[iP], gy[iP + 1]));
+      double previous(gy[iP]);
+      for (unsigned iS(1); iS <= 100; ++iS) {
+        double x(gx[iP] + iS * (gx[iP + 1] - gx[iP]) / 100.);
+        double value(interpolator.eval(x));
+        check(value >= ylow - 1.e-12 && value <= yhigh + 1.e-12,
+              TString::Format("%s kMonotone: eval(%g) = %.17g outside of [%g, %g]", _label, x, value, ylow, yhigh));
+        check((gy[iP + 1] >= gy[iP]) ? (value >= previous - 1.e-12) : (value <= previous + 1.e-12),
+              TString::Format("%s kMonotone: eval(%g) = %.17g not monotone", _label, x, value));
+        previous = value;
+      }
+    }
+  }
+
+}
+
+int
+main()
+{
+  // equidistant knots (interval by index arithmetic)
+  std::vector<double> ux, uy;
+  for (unsigned iP(0); iP != 11; ++iP) {
+    ux.push_back(-1. + 0.2 * iP);
+    uy.push_back(std::sin(2. * ux.back()) + 0.3 * ux.back());
+  }
+  TGraph uniform(ux.size(), ux.data(), uy.data());
+
+  // irregular knots (binary search)
+  std::vector<double> vx{0.5, 0.7, 1.2, 1.3, 2., 3.5, 3.6, 5., 7.5};
+  std::vector<double> vy;
+  for (double x : vx)
+    vy.push_back(std::exp(-x) * 10. + std::cos(x));
+  TGraph irregular(vx.size(), vx.data(), vy.data());
+
+  std::vector<double> tx{0., 1.};
+  std::vector<double> ty{2., -1.};
+  TGraph twoPoints(tx.size(), tx.data(), ty.data());
+
+  for (auto* graph : {&uniform, &irregular, &twoPoints}) {
+    char const* label(graph == &uniform ? "uniform" : (graph == &irregular ? "irregular" : "two points"));
+    testCubic(*graph, label);
+    testLinear(*graph, label);
+  }
+
+  // kLinear sorts the points; TGraph::Eval finds the neighbours of unsorted points
+  std::vector<double> sx{3., 0., 2., 1., 5.};
+  std::vector<double> sy{1., 4., -2., 0.5, 3.};
+  TGraph unsorted(sx.size(), sx.data(), sy.data());
+  testLinear(unsorted, "unsorted");
+
+  // monotone steps, where a cubic spline overshoots
+  std::vector<double> stepx{0., 1., 2., 3., 4., 5., 6., 7., 8.};
+  std::vector<double> stepy{0., 0., 0., 0.1, 1., 1., 1., 1., 1.};
+  TGraph step(stepx.size(), stepx.data(), stepy.data());
+  testMonotone(step, "step");
+
+  std::vector<double> fallx{0., 0.5, 0.6, 2., 2.2, 4.};
+  std::vector<double> fally{5., 4.9, 1., 0.9, 0.1, 0.};
+  TGraph fall(fallx.size(), fallx.data(), fally.data());
+  testMonotone(fall, "falling");
+
+  if (nFailed != 0) {
+    std::cerr << nFailed << " checks failed" << std::endl;
+    return 1;
+  }
+
+  std::cout << "all checks passed" << std::endl;
+  return 0;
+}
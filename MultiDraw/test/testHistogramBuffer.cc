@@ -0,0 +1,251 @@
+// Checks of HistogramBuffer against TH1::Fill and TH2::Fill.
+// Usage: testHistogramBuffer
+// Exits with a nonzero status if any check fails.
+
+#include "../interface/HistogramBuffer.h"
+
+#include "TH1D.h"
+#include "TH2D.h"
+#include "TObjArray.h"
+#include "TRandom3.h"
+#include "TString.h"
+
+#include <iostream>
+#include <vector>
+#include <memory>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+namespace {
+
+  unsigned nFailed(0);
+
+  void
+  check(bool _ok, TString const& _what)
+  {
+    if (_ok)
+      return;
+
+    ++nFailed;
+    std::cerr << _what << std::endl;
+  }
+
+  bool
+  close(double _a, double _b)
+  {
+    // NaN fills propagate into the statistics when overflows are counted
+    if (std::isnan(_a) || std::isnan(_b))
+      return std::isnan(_a) && std::isnan(_b);
+
+    return std::abs(_a - _b) <= 1.e-9 * std::max(1., std::max(std::abs(_a), std::abs(_b)));
+  }
+
+  void
+  compare(TH1 const& _ref, TH1 const& _test, TString const& _label)
+  {
+    for (int iC(0); iC != _ref.GetNcells(); ++iC) {
+      check(close(_ref.GetBinContent(iC), _test.GetBinContent(iC)),
+            TString::Format("%s: content of cell %d: %g != %g", _label.Data(), iC, _test.GetBinContent(iC), _ref.GetBinContent(iC)));
+      check(close(_ref.GetBinError(iC), _test.GetBinError(iC)),
+            TString::Format("%s: error of cell %d: %g != %g", _label.Data(), iC, _test.GetBinError(iC), _ref.GetBinError(iC)));
+    }
+
+    check(_ref.GetEntries() == _test.GetEntries(),
+          TString::Format("%s: entries: %g != %g", _label.Data(), _test.GetEntries(), _ref.GetEntries()));
+    check((_ref.GetSumw2N() == 0) == (_test.GetSumw2N() == 0),
+          TString::Format("%s: Sumw2 %s", _label.Data(), _test.GetSumw2N() == 0 ? "not set" : "set"));
+
+    double refStats[13]{};
+    double testStats[13]{};
+    _ref.GetStats(refStats);
+    _test.GetStats(testStats);
+    for (unsigned iS(0); iS != 13; ++iS) {
+      check(close(refStats[iS], testStats[iS]),
+            TString::Format("%s: stats[%d]: %g != %g", _label.Data(), iS, testStats[iS], refStats[iS]));
+    }
+  }
+
+  struct Point {
+    double x;
+    double y;
+    double w;
+  };
+
+  //! Points spread beyond the histogram ranges, with occasional NaN
+  std::vector<Point>
+  generate(unsigned _n, bool _weighted, unsigned _seed)
+  {
+    double const nan(std::numeric_limits<double>::quiet_NaN());
+
+    TRandom3 rand(_seed);
+    std::vector<Point> points(_n);
+    for (unsigned iP(0); iP != _n; ++iP) {
+      auto& p(points[iP]);
+      p.x = (iP % 53 == 7) ? nan : rand.Gaus(0., 1.8);
+      p.y = (iP % 71 == 11) ? nan : rand.Gaus(0.5, 1.5);
+      p.w = _weighted ? rand.Uniform(-0.5, 2.) : 1.;
+    }
+    return points;
+  }
+
+  enum HistType {
+    kUniform,
+    kVariable,
+    k2D,
+    nHistTypes
+  };
+
+  char const* histTypeNames[nHistTypes] = {"uniform", "variable", "2D"};
+
+  std::unique_ptr<TH1>
+  makeHist(HistType _type, char const* _name)
+  {
+    static double const edges[] = {-3., -2., -1.2, -0.5, 0., 0.3, 1., 2.2, 3.};
+
+    switch (_type) {
+    case kUniform:
+      return std::unique_ptr<TH1>(new TH1D(_name, "", 20, -3., 3.));
+    case kVariable:
+      return std::unique_ptr<TH1>(new TH1D(_name, "", 8, edges));
+    default:
+      return std::unique_ptr<TH1>(new TH2D(_name, "", 12, -3., 3., 8, edges));
+    }
+  }
+
+  void
+  fillHist(TH1& _hist, Point const& _p, double _w)
+  {
+    if (_hist.GetDimension() == 1)
+      _hist.Fill(_p.x, _w);
+    else
+      static_cast<TH2&>(_hist).Fill(_p.x, _p.y, _w);
+  }
+
+  void
+  fillBuffer(multidraw::HistogramBuffer& _buffer, unsigned _icat, int _ndim, Point const& _p)
+  {
+    if (_ndim == 1)
+      _buffer.fill(_icat, _p.x, _p.w);
+    else
+      _buffer.fill(_icat, _p.x, _p.y, _p.w);
+  }
+
+  //! fill() and writeTo() on a histogram that already has contents
+  void
+  testFill(HistType _type, std::vector<Point> const& _points, TString const& _label)
+  {
+    auto ref(makeHist(_type, "ref"));
+    auto test(makeHist(_type, "test"));
+    int ndim(ref->GetDimension());
+
+    // writeTo must add to the existing contents and statistics
+    unsigned nPre(_points.size() / 10);
+    for (unsigned iP(0); iP != nPre; ++iP) {
+      fillHist(*ref, _points[iP], _points[iP].w);
+      fillHist(*test, _points[iP], _points[iP].w);
+    }
+
+    multidraw::HistogramBuffer buffer(*test, false);
+    for (unsigned iP(nPre); iP != _points.size(); ++iP) {
+      fillHist(*ref, _points[iP], _points[iP].w);
+      fillBuffer(buffer, 0, ndim, _points[iP]);
+    }
+
+    buffer.writeTo(*test, false);
+
+    compare(*ref, *test, _label + " fill");
+  }
+
+  //! Two buffers merged through serialize() and addSerialized()
+  void
+  testSerialize(HistType _type, std::vector<Point> const& _points, TString const& _label)
+  {
+    auto ref(makeHist(_type, "ref"));
+    auto test(makeHist(_type, "test"));
+    int ndim(ref->GetDimension());
+
+    multidraw::HistogramBuffer buffer1(*test, false);
+    multidraw::HistogramBuffer buffer2(*test, false);
+
+    unsigned nHalf(_points.size() / 2);
+    for (unsigned iP(0); iP != _points.size(); ++iP) {
+      fillHist(*ref, _points[iP], _points[iP].w);
+      fillBuffer(iP < nHalf ? buffer1 : buffer2, 0, ndim, _points[iP]);
+    }
+
+    std::vector<double> serialized(buffer1.serializedSize());
+    buffer1.serialize(serialized.data());
+    buffer2.addSerialized(serialized.data());
+
+    buffer2.writeTo(*test, false);
+
+    compare(*ref, *test, _label + " serialize");
+  }
+
+  //! fillVariations() into interleaved categories
+  void
+  testVariations(HistType _type, std::vector<Point> const& _points, TString const& _label)
+  {
+    unsigned const nVariations(3);
+    double const factors[nVariations] = {1., 0.5, 1.3};
+
+    TObjArray refs;
+    refs.SetOwner(true);
+    TObjArray tests;
+    tests.SetOwner(true);
+    // two groups of variations, the second one is never filled
+    for (unsigned iH(0); iH != 2 * nVariations; ++iH) {
+      refs.Add(makeHist(_type, TString::Format("ref%d", iH)).release());
+      tests.Add(makeHist(_type, TString::Format("test%d", iH)).release());
+    }
+
+    multidraw::HistogramBuffer buffer(tests, true, nVariations);
+    for (auto& p : _points) {
+      for (unsigned iV(0); iV != nVariations; ++iV)
+        fillHist(static_cast<TH1&>(*refs.UncheckedAt(iV)), p, p.w * factors[iV]);
+
+      if (_type == k2D)
+        buffer.fillVariations(0, p.x, p.y, p.w, factors);
+      else
+        buffer.fillVariations(0, p.x, p.w, factors);
+    }
+
+    buffer.writeTo(tests, true);
+
+    for (unsigned iH(0); iH != 2 * nVariations; ++iH)
+      compare(static_cast<TH1&>(*refs.UncheckedAt(iH)), static_cast<TH1&>(*tests.UncheckedAt(iH)), _label + TString::Format(" variation %d", iH));
+  }
+
+}
+
+int
+main()
+{
+  TH1::AddDirectory(false);
+
+  for (bool statOverflows : {false, true}) {
+    // HistogramBuffer takes the setting at construction
+    TH1::StatOverflows(statOverflows);
+
+    for (bool weighted : {false, true}) {
+      auto points(generate(5000, weighted, 12345));
+
+      for (int type(0); type != nHistTypes; ++type) {
+        TString label(TString::Format("%s %s%s", histTypeNames[type], weighted ? "weighted" : "unweighted", statOverflows ? " statOverflows" : ""));
+
+        testFill(HistType(type), points, label);
+        testSerialize(HistType(type), points, label);
+        testVariations(HistType(type), points, label);
+      }
+    }
+  }
+
+  if (nFailed != 0) {
+    std::cerr << nFailed << " checks failed" << std::endl;
+    return 1;
+  }
+
+  std::cout << "all checks passed" << std::endl;
+  return 0;
+}
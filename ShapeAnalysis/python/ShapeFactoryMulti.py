@@ -44,6 +44,12 @@ class ShapeFactory:
 
         self._treeName = 'latino'
 
+        # Sidecar index of the numbers of entries of the input files (see MultiDraw::setInputIndex)
+        self._inputIndex = ''
+
+        # Directory of the JSON execution profiles, one per process (see MultiDraw::setProfileOutput)
+        self._profileDir = ''
+
         # Alias TTree expressions
         self.aliases = {}
 
@@ -230,6 +236,7 @@ class ShapeFactory:
 
           nuisanceDrawers = {}
           ndrawers = [] # flat list for convenience
+          inlineDrawers = set() # variations filled by the nominal drawer
 
           basenames = [os.path.basename(s) if '###' in s else s for s in sample['name']]
 
@@ -304,7 +311,9 @@ class ShapeFactory:
                   ndrawer = nuisanceDrawers[nuisanceName][var] = self._connectInputs(sampleName, sample['name'], inputDir, skipMissingFiles=False, friendsDir=(nuisance['folder' + var], friendAlias))
                   prefix = friendAlias + '.'
                 else:
-                  ndrawer = nuisanceDrawers[nuisanceName][var] = self._connectInputs(sampleName, sample['name'], inputDir, skipMissingFiles=False)
+                  # varied branches are in the nominal tree - evaluate in the same event loop as the nominal
+                  ndrawer = nuisanceDrawers[nuisanceName][var] = drawer.addVariation(nuisanceName + var)
+                  inlineDrawers.add(nuisanceName + var)
                   prefix = ''
 
                 # there are various ways to set up branch mapping in NanoGardener, but in practice we use only the branches-suffix configuration
@@ -582,10 +591,47 @@ class ShapeFactory:
 
                   return filler
 
+                def setup_variations_filler(drawer, reweight, variations):
+                  # all weight variations of the variable in one filler; histograms ordered category-major
+                  histlist = ROOT.TObjArray()
+
+                  if 'categories' in cut:
+                    dirNames = [cutName + '_' + catname + '/' + variableName for catname in categoryOrdering]
+                  else:
+                    dirNames = [cutName + '/' + variableName]
+
+                  for dirName in dirNames:
+                    outFile.cd(dirName)
+
+                    for variation, _ in variations:
+                      histoName = 'histo_' + outputFormat.format(sample=sampleName, subsample=slabel, nuisance='_' + variation)
+
+                      hTotal = self._makeshape(histoName, variable['range'])
+                      _allplots.add(hTotal)
+                      hTotal.SetTitle(histoName)
+                      hTotal.SetName(histoName)
+                      histlist.Add(hTotal)
+
+                  if yexpr:
+                    filler = drawer.addPlotVariations2D(histlist, xexpr, yexpr, cutFullName)
+                  else:
+                    filler = drawer.addPlotVariations(histlist, xexpr, cutFullName)
+
+                  if reweight is not None:
+                    filler.setReweight(reweight)
+
+                  for _, weight in variations:
+                    filler.addVariation(ShapeFactory._make_reweight(weight))
+
+                  return filler
+
               # end "if 'tree' in variable: ... else: ..."
 
               nominal_filler = setup_filler(drawer, reweight)
 
+              # weight variations of histograms, filled together
+              weightVariations = []
+
               for nuisanceName, nuisance in applicableNuisances.iteritems():
                 if nuisanceName == 'stat' or 'kind' not in nuisance:
                   continue
@@ -609,12 +655,10 @@ class ShapeFactory:
                       # add a reweighting branch to the nominal tree instead of creating an entirely new tree with only the weight branch modified
                       nominal_filler.addBranch('reweight_' + nuisance['name'] + var, sampleVarWeights[ivar])
                     else:
-                      reweightNuis = ROOT.multidraw.ReweightSource(sampleVarWeights[ivar])
-                      if reweight is not None:
-                        # compound reweight
-                        reweightNuis = ROOT.multidraw.ReweightSource(reweight, reweightNuis)
+                      weightVariations.append((nuisance['name'] + var, sampleVarWeights[ivar]))
 
-                      setup_filler(drawer, reweightNuis, nuisance['name'] + var)
+              if weightVariations:
+                setup_variations_filler(drawer, reweight, weightVariations)
 
             # Done setting up one cut
             print ''
@@ -634,6 +678,8 @@ class ShapeFactory:
           for nuisanceName in nuisanceDrawers.keys():
             ndrawers = nuisanceDrawers.pop(nuisanceName)
             for var, ndrawer in ndrawers.iteritems():
+              if nuisanceName + var in inlineDrawers:
+                continue
               print 'Start', nuisanceName + var, 'histogram fill'
               ndrawer.execute(nevents, firstEvent)
 
@@ -1177,6 +1223,10 @@ class ShapeFactory:
         drawer.setPrintLevel(1)
         drawer.setDoTimeProfile(True)
         drawer.setInputMultiplexing(int(self._nThreads))
+        if self._inputIndex:
+          drawer.setInputIndex(self._inputIndex)
+        if self._profileDir:
+          drawer.setProfileOutput(os.path.join(self._profileDir, 'profile_%s.json' % process))
 
         # lists[process] = []
 
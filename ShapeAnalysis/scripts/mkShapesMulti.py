@@ -242,6 +242,8 @@ if __name__ == '__main__':
     parser.add_option('--redoStat'       , dest='redoStat'        , help='redo stat uncertainty'                        , default=False)
     parser.add_option('--doThreads'      , dest='doThreads'      , help='switch to multi-threading mode'             , default=False)
     parser.add_option('--nThreads'       , dest='numThreads'     , help='number of threads for multi-threading'      , default=1, type='int')
+    parser.add_option('--inputIndex'     , dest='inputIndex'     , help='sidecar index of the numbers of entries of the input files' , default='')
+    parser.add_option('--profileDir'     , dest='profileDir'     , help='write the JSON execution profile of each sample to this directory' , default='')
     parser.add_option('--doNotCleanup'   , dest='doNotCleanup'   , help='do not remove additional support files'     , action='store_true', default=False)
     parser.add_option("-n", "--dry-run"  , dest="dryRun"         , help="do not make shapes"                         , default=False, action="store_true")
     parser.add_option("-W" , "--iihe-wall-time" , dest="IiheWallTime" , help="Requested IIHE queue Wall Time" , default='168:00:00')
@@ -395,6 +397,8 @@ if __name__ == '__main__':
       jobs.InitPy("factory._lumi      = "+str(opt.lumi))
       jobs.InitPy("factory._tag       = '"+str(opt.tag)+"'")
       jobs.InitPy("factory._nThreads  = "+str(nThreads))
+      jobs.InitPy("factory._inputIndex = '"+opt.inputIndex+"'")
+      jobs.InitPy("factory._profileDir = '"+opt.profileDir+"'")
       jobs.InitPy("factory.aliases    = "+str(aliases))
       jobs.InitPy("factory.FixNegativeAfterHadd    = "+str(opt.FixNegativeAfterHadd))
 
@@ -784,6 +788,8 @@ if __name__ == '__main__':
       factory._lumi      = opt.lumi
       factory._tag       = opt.tag
       factory._nThreads  = opt.numThreads
+      factory._inputIndex = opt.inputIndex
+      factory._profileDir = opt.profileDir
       factory.aliases    = aliases
       factory.FixNegativeAfterHadd = opt.FixNegativeAfterHadd
 